@@ -0,0 +1,201 @@
+#include "aio.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+struct tfs_aio {
+    pthread_mutex_t aio_lock;
+    pthread_cond_t aio_submitted; /* signalled when requests are queued */
+    pthread_cond_t aio_completed; /* signalled when requests complete */
+
+    unsigned aio_entries;
+    unsigned aio_in_flight; /* queued + running + completed, not reaped */
+    bool aio_stopping;
+
+    /* Submission ring */
+    tfs_aio_sqe_t *aio_sq;
+    unsigned aio_sq_head;
+    unsigned aio_sq_length;
+
+    /* Completion ring */
+    tfs_aio_cqe_t *aio_cq;
+    unsigned aio_cq_head;
+    unsigned aio_cq_length;
+
+    unsigned aio_worker_count;
+    pthread_t *aio_workers;
+};
+
+static ssize_t aio_execute(tfs_aio_sqe_t const *sqe) {
+    switch (sqe->sqe_op) {
+    case TFS_AIO_OPEN:
+        return tfs_open(sqe->sqe_path, sqe->sqe_flags);
+    case TFS_AIO_CLOSE:
+        return tfs_close(sqe->sqe_fhandle);
+    case TFS_AIO_READ:
+        return tfs_read(sqe->sqe_fhandle, sqe->sqe_buffer, sqe->sqe_len);
+    case TFS_AIO_WRITE:
+        return tfs_write(sqe->sqe_fhandle, sqe->sqe_buffer, sqe->sqe_len);
+    case TFS_AIO_PREAD:
+        return tfs_pread(sqe->sqe_fhandle, sqe->sqe_buffer, sqe->sqe_len,
+                         sqe->sqe_offset);
+    case TFS_AIO_PWRITE:
+        return tfs_pwrite(sqe->sqe_fhandle, sqe->sqe_buffer, sqe->sqe_len,
+                          sqe->sqe_offset);
+    default:
+        return -1;
+    }
+}
+
+static void *aio_worker(void *arg) {
+    tfs_aio_t *aio = arg;
+
+    mutex_lock(&aio->aio_lock);
+    for (;;) {
+        while (aio->aio_sq_length == 0 && !aio->aio_stopping) {
+            pthread_cond_wait(&aio->aio_submitted, &aio->aio_lock);
+        }
+        if (aio->aio_sq_length == 0) {
+            break;
+        }
+
+        tfs_aio_sqe_t sqe = aio->aio_sq[aio->aio_sq_head];
+        aio->aio_sq_head = (aio->aio_sq_head + 1) % aio->aio_entries;
+        aio->aio_sq_length--;
+
+        mutex_unlock(&aio->aio_lock);
+        tfs_aio_cqe_t cqe = {.cqe_result = aio_execute(&sqe),
+                             .cqe_user_data = sqe.sqe_user_data};
+        mutex_lock(&aio->aio_lock);
+
+        /* Never overflows: requests in flight are at most aio_entries */
+        aio->aio_cq[(aio->aio_cq_head + aio->aio_cq_length) %
+                    aio->aio_entries] = cqe;
+        aio->aio_cq_length++;
+        pthread_cond_broadcast(&aio->aio_completed);
+    }
+    mutex_unlock(&aio->aio_lock);
+
+    return NULL;
+}
+
+static void aio_free(tfs_aio_t *aio) {
+    free(aio->aio_sq);
+    free(aio->aio_cq);
+    free(aio->aio_workers);
+    free(aio);
+}
+
+/*
+ * Stops the first `started` workers once the submission ring is empty
+ */
+static void aio_stop(tfs_aio_t *aio, unsigned started) {
+    mutex_lock(&aio->aio_lock);
+    aio->aio_stopping = true;
+    pthread_cond_broadcast(&aio->aio_submitted);
+    mutex_unlock(&aio->aio_lock);
+
+    for (unsigned i = 0; i < started; i++) {
+        pthread_join(aio->aio_workers[i], NULL);
+    }
+
+    destroy_mlock(&aio->aio_lock);
+    pthread_cond_destroy(&aio->aio_submitted);
+    pthread_cond_destroy(&aio->aio_completed);
+}
+
+tfs_aio_t *tfs_aio_create(unsigned entries, unsigned workers) {
+    if (entries == 0) {
+        entries = AIO_DEFAULT_ENTRIES;
+    }
+    if (workers == 0) {
+        workers = AIO_DEFAULT_WORKERS;
+    }
+
+    tfs_aio_t *aio = calloc(1, sizeof(*aio));
+    if (aio == NULL) {
+        return NULL;
+    }
+    aio->aio_entries = entries;
+    aio->aio_worker_count = workers;
+    aio->aio_sq = calloc(entries, sizeof(*aio->aio_sq));
+    aio->aio_cq = calloc(entries, sizeof(*aio->aio_cq));
+    aio->aio_workers = calloc(workers, sizeof(*aio->aio_workers));
+    if (aio->aio_sq == NULL || aio->aio_cq == NULL ||
+        aio->aio_workers == NULL) {
+        aio_free(aio);
+        return NULL;
+    }
+
+    init_mlock(&aio->aio_lock);
+    pthread_cond_init(&aio->aio_submitted, NULL);
+    pthread_cond_init(&aio->aio_completed, NULL);
+
+    for (unsigned i = 0; i < workers; i++) {
+        if (pthread_create(&aio->aio_workers[i], NULL, aio_worker, aio) !=
+            0) {
+            aio_stop(aio, i);
+            aio_free(aio);
+            return NULL;
+        }
+    }
+
+    return aio;
+}
+
+unsigned tfs_aio_submit(tfs_aio_t *aio, tfs_aio_sqe_t const *sqes,
+                        unsigned count) {
+    mutex_lock(&aio->aio_lock);
+
+    unsigned room = aio->aio_entries - aio->aio_in_flight;
+    if (count > room) {
+        count = room;
+    }
+    for (unsigned i = 0; i < count; i++) {
+        aio->aio_sq[(aio->aio_sq_head + aio->aio_sq_length) %
+                    aio->aio_entries] = sqes[i];
+        aio->aio_sq_length++;
+    }
+    aio->aio_in_flight += count;
+
+    if (count == 1) {
+        pthread_cond_signal(&aio->aio_submitted);
+    } else if (count > 1) {
+        pthread_cond_broadcast(&aio->aio_submitted);
+    }
+    mutex_unlock(&aio->aio_lock);
+
+    return count;
+}
+
+unsigned tfs_aio_reap(tfs_aio_t *aio, tfs_aio_cqe_t *cqes, unsigned max,
+                      unsigned wait) {
+    mutex_lock(&aio->aio_lock);
+
+    if (wait > max) {
+        wait = max;
+    }
+    if (wait > aio->aio_in_flight) {
+        wait = aio->aio_in_flight;
+    }
+    while (aio->aio_cq_length < wait) {
+        pthread_cond_wait(&aio->aio_completed, &aio->aio_lock);
+    }
+
+    unsigned count = aio->aio_cq_length < max ? aio->aio_cq_length : max;
+    for (unsigned i = 0; i < count; i++) {
+        cqes[i] = aio->aio_cq[aio->aio_cq_head];
+        aio->aio_cq_head = (aio->aio_cq_head + 1) % aio->aio_entries;
+    }
+    aio->aio_cq_length -= count;
+    aio->aio_in_flight -= count;
+
+    mutex_unlock(&aio->aio_lock);
+
+    return count;
+}
+
+void tfs_aio_destroy(tfs_aio_t *aio) {
+    aio_stop(aio, aio->aio_worker_count);
+    aio_free(aio);
+}
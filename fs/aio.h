@@ -0,0 +1,93 @@
+#ifndef AIO_H
+#define AIO_H
+
+#include "operations.h"
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * Asynchronous interface to TecnicoFS: requests are queued in a submission
+ * ring, carried out by a pool of worker threads, and their results are
+ * queued in a completion ring that the caller polls or waits on. A single
+ * thread can thus keep many operations in flight.
+ *
+ * Requests in flight at the same time run in no particular order: a caller
+ * that needs one to happen after another (say, a read after the open that
+ * gives its file handle) waits for the first one to complete. Reads and
+ * writes that go through the handle's offset and share a handle should not
+ * be in flight together; the positional ones have no such restriction.
+ */
+
+typedef enum {
+    TFS_AIO_OPEN,   /* tfs_open(sqe_path, sqe_flags) */
+    TFS_AIO_CLOSE,  /* tfs_close(sqe_fhandle) */
+    TFS_AIO_READ,   /* tfs_read(sqe_fhandle, sqe_buffer, sqe_len) */
+    TFS_AIO_WRITE,  /* tfs_write(sqe_fhandle, sqe_buffer, sqe_len) */
+    TFS_AIO_PREAD,  /* tfs_pread(..., sqe_offset) */
+    TFS_AIO_PWRITE, /* tfs_pwrite(..., sqe_offset) */
+} tfs_aio_op_t;
+
+/* Submission queue entry: a request */
+typedef struct {
+    tfs_aio_op_t sqe_op;
+    int sqe_fhandle;
+    char const *sqe_path; /* must stay valid until the request completes */
+    int sqe_flags;
+    void *sqe_buffer; /* must stay valid until the request completes */
+    size_t sqe_len;
+    size_t sqe_offset;
+    uint64_t sqe_user_data; /* handed back in the completion */
+} tfs_aio_sqe_t;
+
+/* Completion queue entry: the result of a request */
+typedef struct {
+    ssize_t cqe_result;     /* what the synchronous call returns */
+    uint64_t cqe_user_data; /* sqe_user_data of the request */
+} tfs_aio_cqe_t;
+
+typedef struct tfs_aio tfs_aio_t;
+
+/*
+ * Creates an asynchronous I/O context
+ * Input:
+ *  - entries: most requests in flight (queued, running, or completed and not
+ *    reaped yet) at once; 0 selects AIO_DEFAULT_ENTRIES
+ *  - workers: threads carrying out the requests; 0 selects
+ *    AIO_DEFAULT_WORKERS
+ * Returns: the context if successful, NULL otherwise
+ */
+tfs_aio_t *tfs_aio_create(unsigned entries, unsigned workers);
+
+/*
+ * Submits a batch of requests
+ * Input:
+ *  - aio: the context
+ *  - sqes: the requests
+ *  - count: number of requests
+ * Returns: number of requests queued, which is lower than count if the
+ * context runs out of entries (reap completions to make room)
+ */
+unsigned tfs_aio_submit(tfs_aio_t *aio, tfs_aio_sqe_t const *sqes,
+                        unsigned count);
+
+/*
+ * Reaps completions
+ * Input:
+ *  - aio: the context
+ *  - cqes: where the completions are stored
+ *  - max: room in cqes
+ *  - wait: number of completions to wait for (0 to only poll); capped at
+ *    max and at the number of requests in flight
+ * Returns: number of completions stored in cqes
+ */
+unsigned tfs_aio_reap(tfs_aio_t *aio, tfs_aio_cqe_t *cqes, unsigned max,
+                      unsigned wait);
+
+/*
+ * Waits for every request in flight to complete (dropping the completions
+ * not reaped yet) and destroys the context
+ */
+void tfs_aio_destroy(tfs_aio_t *aio);
+
+#endif // AIO_H
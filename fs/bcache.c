@@ -0,0 +1,212 @@
+#include "bcache.h"
+#include "latency.h"
+#include "state.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+
+typedef struct {
+    atomic_int f_block; /* resident block, -1 if the frame is empty */
+    atomic_bool f_referenced;
+    atomic_bool f_prefetched; /* prefetched and not accessed since */
+} bcache_frame_t;
+
+static bcache_frame_t *frames;
+static size_t frame_count;
+
+/* Frame holding each data block, -1 if it is not resident */
+static atomic_int *block_frame;
+
+static pthread_mutex_t clock_lock;
+static size_t clock_hand;
+
+static atomic_uint_fast64_t hits;
+static atomic_uint_fast64_t misses;
+static atomic_uint_fast64_t evictions;
+static atomic_uint_fast64_t prefetched;
+static atomic_uint_fast64_t prefetch_hits;
+
+/*
+ * Initializes the block cache, with every frame empty
+ * Returns: 0 if successful, -1 otherwise
+ */
+int bcache_init() {
+    frame_count = fs_params.block_cache_blocks;
+    frames = calloc(frame_count, sizeof(*frames));
+    block_frame = calloc(DATA_BLOCKS, sizeof(*block_frame));
+    if (frames == NULL || block_frame == NULL) {
+        free(frames);
+        free(block_frame);
+        return -1;
+    }
+
+    for (size_t i = 0; i < frame_count; i++) {
+        atomic_init(&frames[i].f_block, -1);
+        atomic_init(&frames[i].f_referenced, false);
+        atomic_init(&frames[i].f_prefetched, false);
+    }
+    for (size_t i = 0; i < DATA_BLOCKS; i++) {
+        atomic_init(&block_frame[i], -1);
+    }
+
+    init_mlock(&clock_lock);
+    clock_hand = 0;
+    atomic_store(&hits, 0);
+    atomic_store(&misses, 0);
+    atomic_store(&evictions, 0);
+    atomic_store(&prefetched, 0);
+    atomic_store(&prefetch_hits, 0);
+
+    return 0;
+}
+
+/*
+ * Drops the block cache
+ */
+void bcache_destroy() {
+    destroy_mlock(&clock_lock);
+    free(frames);
+    free(block_frame);
+    frames = NULL;
+    block_frame = NULL;
+    frame_count = 0;
+}
+
+/*
+ * Returns the frame holding a block, or NULL if it is not resident
+ */
+static bcache_frame_t *bcache_lookup(int block) {
+    int frame = atomic_load_explicit(&block_frame[block], memory_order_acquire);
+
+    if (frame == -1 || atomic_load_explicit(&frames[frame].f_block,
+                                            memory_order_acquire) != block) {
+        return NULL;
+    }
+    return &frames[frame];
+}
+
+/*
+ * Advances the clock hand to a frame whose reference bit is clear, clearing
+ * the bits it passes over. Must hold clock_lock.
+ */
+static size_t bcache_victim() {
+    for (;;) {
+        size_t frame = clock_hand;
+        clock_hand = (clock_hand + 1) % frame_count;
+        if (!atomic_exchange_explicit(&frames[frame].f_referenced, false,
+                                      memory_order_relaxed)) {
+            return frame;
+        }
+    }
+}
+
+/*
+ * Makes the blocks of a run that are not resident yet resident
+ * Returns: the number of blocks it loaded
+ */
+static int bcache_load(int first, int count, bool prefetch) {
+    int loaded = 0;
+
+    mutex_lock(&clock_lock);
+    for (int block = first; block < first + count; block++) {
+        /* Another thread may have loaded it meanwhile */
+        if (bcache_lookup(block) != NULL) {
+            continue;
+        }
+
+        size_t frame = bcache_victim();
+        int old = atomic_load_explicit(&frames[frame].f_block,
+                                       memory_order_relaxed);
+        if (old != -1) {
+            atomic_store_explicit(&block_frame[old], -1, memory_order_relaxed);
+            atomic_fetch_add_explicit(&evictions, 1, memory_order_relaxed);
+        }
+        atomic_store_explicit(&frames[frame].f_block, block,
+                              memory_order_release);
+        atomic_store_explicit(&frames[frame].f_referenced, true,
+                              memory_order_relaxed);
+        atomic_store_explicit(&frames[frame].f_prefetched, prefetch,
+                              memory_order_relaxed);
+        atomic_store_explicit(&block_frame[block], (int)frame,
+                              memory_order_release);
+        loaded++;
+    }
+    mutex_unlock(&clock_lock);
+
+    return loaded;
+}
+
+/*
+ * Records an access to a run of consecutive data blocks, charging the
+ * storage latency once if any of them is not resident and making them all
+ * resident
+ * Input:
+ *  - first, count: the run, of valid data block numbers
+ * Returns: true if every block was resident, false otherwise
+ */
+bool bcache_access(int first, int count) {
+    uint64_t missing = 0;
+
+    for (int block = first; block < first + count; block++) {
+        bcache_frame_t *frame = bcache_lookup(block);
+        if (frame == NULL) {
+            missing++;
+            continue;
+        }
+        atomic_store_explicit(&frame->f_referenced, true,
+                              memory_order_relaxed);
+        if (atomic_load_explicit(&frame->f_prefetched, memory_order_relaxed) &&
+            atomic_exchange_explicit(&frame->f_prefetched, false,
+                                     memory_order_relaxed)) {
+            atomic_fetch_add_explicit(&prefetch_hits, 1, memory_order_relaxed);
+        }
+    }
+
+    atomic_fetch_add_explicit(&hits, (uint64_t)count - missing,
+                              memory_order_relaxed);
+    if (missing == 0) {
+        return true;
+    }
+
+    atomic_fetch_add_explicit(&misses, missing, memory_order_relaxed);
+    latency_charge(TFS_ACCESS_BLOCK); // access to the blocks
+    bcache_load(first, count, false);
+    return false;
+}
+
+/*
+ * Makes a run of consecutive data blocks resident ahead of an access,
+ * charging the storage latency once if any of them is not resident yet
+ * Input:
+ *  - first, count: the run, of valid data block numbers
+ */
+void bcache_prefetch(int first, int count) {
+    bool missing = false;
+
+    for (int block = first; block < first + count && !missing; block++) {
+        missing = bcache_lookup(block) == NULL;
+    }
+    if (!missing) {
+        return;
+    }
+
+    latency_charge(TFS_ACCESS_BLOCK); // access to the blocks
+    int loaded = bcache_load(first, count, true);
+    atomic_fetch_add_explicit(&prefetched, (uint64_t)loaded,
+                              memory_order_relaxed);
+}
+
+/*
+ * Reads the cache counters
+ * Input:
+ *  - stats: filled in with the counters since the FS was initialized
+ */
+void bcache_stats(tfs_block_cache_stats_t *stats) {
+    stats->hits = atomic_load_explicit(&hits, memory_order_relaxed);
+    stats->misses = atomic_load_explicit(&misses, memory_order_relaxed);
+    stats->evictions = atomic_load_explicit(&evictions, memory_order_relaxed);
+    stats->prefetched =
+        atomic_load_explicit(&prefetched, memory_order_relaxed);
+    stats->prefetch_hits =
+        atomic_load_explicit(&prefetch_hits, memory_order_relaxed);
+}
@@ -0,0 +1,38 @@
+#ifndef BCACHE_H
+#define BCACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Block buffer cache: keeps track of which data blocks are resident in
+ * memory, in a fixed number of frames (tfs_params_t.block_cache_blocks)
+ * replaced with the CLOCK algorithm. Accesses only pay the storage latency
+ * (see latency.h) when some of the blocks they touch are not resident, and
+ * then pay it once for the whole run of blocks.
+ *
+ * Hits take no lock: they look the block's frame up and set its reference
+ * bit. Misses pay the latency first and then serialize on the clock hand to
+ * make the blocks resident, so misses on different blocks overlap. Two
+ * threads missing the same block both go to storage.
+ *
+ * Blocks can also be made resident ahead of time (bcache_prefetch, used by
+ * readahead); the first access to such a block counts as a prefetch hit.
+ */
+
+typedef struct {
+    uint64_t hits;          /* accessed blocks that were resident */
+    uint64_t misses;        /* accessed blocks that went to storage */
+    uint64_t evictions;     /* resident blocks dropped to make room */
+    uint64_t prefetched;    /* blocks made resident ahead of time */
+    uint64_t prefetch_hits; /* prefetched blocks accessed afterwards */
+} tfs_block_cache_stats_t;
+
+int bcache_init();
+void bcache_destroy();
+
+bool bcache_access(int first, int count);
+void bcache_prefetch(int first, int count);
+void bcache_stats(tfs_block_cache_stats_t *stats);
+
+#endif // BCACHE_H
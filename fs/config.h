@@ -4,12 +4,75 @@
 /* FS root inode number */
 #define ROOT_DIR_INUM (0)
 
-#define BLOCK_SIZE (1024)
-#define DATA_BLOCKS (1024)
-#define INODE_TABLE_SIZE (50)
-#define MAX_OPEN_FILES (20)
+/* Default FS geometry, used for the fields of tfs_params_t left at 0 */
+#define DEFAULT_BLOCK_SIZE (1024)
+#define DEFAULT_DATA_BLOCKS (1024)
+#define DEFAULT_INODE_TABLE_SIZE (50)
+#define DEFAULT_MAX_OPEN_FILES (1024 * 1024)
+#define DEFAULT_BLOCK_CACHE_BLOCKS (256)
+
 #define MAX_FILE_NAME (40)
 
-#define DELAY (5000)
+/* Default cost of each kind of storage access (see latency.h) */
+#define DEFAULT_INODE_ACCESS_NS (1000)
+#define DEFAULT_BITMAP_ACCESS_NS (1000)
+#define DEFAULT_BLOCK_ACCESS_NS (1000)
+
+/* Spin loop iterations timed to calibrate TFS_LATENCY_SPIN */
+#define LATENCY_CALIBRATION_SPINS (1000000)
+
+/* Shortest cost TFS_LATENCY_SLEEP sleeps for; shorter ones just yield */
+#define LATENCY_SLEEP_MIN_NS (10000)
+
+/* Per-thread shards of the storage access counters (see latency_charge) */
+#define LATENCY_COUNTER_SHARDS (16)
+
+/* Optimistic snapshots of an i-node's metadata tried before waiting for its
+ * writer on the i-node's lock (see inode_meta_read) */
+#define INODE_META_RETRIES (64)
+
+/* Initial number of buckets of each directory's name index */
+#define DIR_INDEX_MIN_BUCKETS (16)
+
+/* Epoch-based reclamation (see epoch.h): threads that can read without
+ * locks at once, and nodes retired between attempts to reclaim them */
+#define EPOCH_SLOTS (256)
+#define EPOCH_RETIRE_BATCH (64)
+
+/* Dentry cache geometry (see dcache.h) */
+#define DCACHE_BUCKETS (1024)
+#define DCACHE_BUCKET_DEPTH (8)
+
+/* Number of file blocks whose block numbers are looked up at once by
+ * tfs_write and tfs_read */
+#define BLOCK_MAP_BATCH (1024)
+
+/* Most buffers handed to a single writev when exporting a file */
+#define EXPORT_IOV_BATCH (64)
+
+/* Readahead (see readahead.h): window of blocks read ahead of a sequential
+ * reader, which starts at the minimum and doubles on every sequential read,
+ * and the queue of runs waiting for the workers */
+#define READAHEAD_MIN_BLOCKS (4)
+#define READAHEAD_MAX_BLOCKS (64)
+#define READAHEAD_QUEUE_DEPTH (64)
+#define READAHEAD_WORKERS (2)
+
+/* Delayed allocation (see inode_delalloc_grow): most blocks of appended data
+ * each file keeps buffered, and most bytes buffered by all files together */
+#define DELALLOC_MAX_BLOCKS (64)
+#define DELALLOC_MAX_BYTES (16 * 1024 * 1024)
+
+/* Asynchronous I/O contexts (see aio.h) */
+#define AIO_DEFAULT_ENTRIES (64)
+#define AIO_DEFAULT_WORKERS (4)
+
+/* Entries of each chunk of the open file table, allocated together when the
+ * first of them is needed (a multiple of 64) */
+#define OPEN_FILE_CHUNK (1024)
+
+/* Per-thread free block pools (see data_block_alloc) */
+#define BLOCK_POOL_SHARDS (16)
+#define BLOCK_POOL_BATCH (8)
 
 #endif // CONFIG_H
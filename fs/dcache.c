@@ -0,0 +1,198 @@
+#include "dcache.h"
+#include "epoch.h"
+#include "state.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct dentry {
+    _Atomic(struct dentry *) d_next;
+    int d_parent;
+    int d_inumber; /* -1 for a negative entry */
+    char d_name[MAX_FILE_NAME];
+} dentry_t;
+
+/* Each bucket keeps at most DCACHE_BUCKET_DEPTH entries, most recently
+ * inserted first. The lock serializes changes; lookups walk the bucket
+ * without it (see epoch.h), so entries dropped from it are retired. */
+typedef struct {
+    pthread_mutex_t b_lock;
+    _Atomic(dentry_t *) b_head;
+} dcache_bucket_t;
+
+static dcache_bucket_t dcache[DCACHE_BUCKETS];
+
+/* Bumped on every change to a directory (see dcache_insert) */
+static atomic_uint *dir_generation;
+
+static dcache_bucket_t *dcache_bucket(int parent, char const *name) {
+    size_t hash = 2166136261u ^ (size_t)parent;
+    for (size_t i = 0; i < MAX_FILE_NAME - 1 && name[i] != '\0'; i++) {
+        hash = (hash ^ (unsigned char)name[i]) * 16777619u;
+    }
+    return &dcache[hash % DCACHE_BUCKETS];
+}
+
+static bool dentry_matches(dentry_t *dentry, int parent, char const *name) {
+    return dentry->d_parent == parent &&
+           strncmp(dentry->d_name, name, MAX_FILE_NAME) == 0;
+}
+
+/*
+ * Initializes the dentry cache
+ * Returns: 0 if successful, -1 otherwise
+ */
+int dcache_init() {
+    dir_generation = calloc(INODE_TABLE_SIZE, sizeof(*dir_generation));
+    if (dir_generation == NULL) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < DCACHE_BUCKETS; i++) {
+        init_mlock(&dcache[i].b_lock);
+        atomic_store(&dcache[i].b_head, NULL);
+    }
+
+    return 0;
+}
+
+/*
+ * Drops every cached entry
+ */
+void dcache_destroy() {
+    for (size_t i = 0; i < DCACHE_BUCKETS; i++) {
+        dentry_t *dentry = atomic_load(&dcache[i].b_head);
+        while (dentry != NULL) {
+            dentry_t *next = atomic_load(&dentry->d_next);
+            free(dentry);
+            dentry = next;
+        }
+        atomic_store(&dcache[i].b_head, NULL);
+        destroy_mlock(&dcache[i].b_lock);
+    }
+
+    free(dir_generation);
+    dir_generation = NULL;
+}
+
+/*
+ * Looks for a name in the cache
+ * Input:
+ *  - parent: inumber of the directory
+ *  - name: entry name
+ *  - inumber: where the cached inumber (-1 for a negative entry) is stored
+ * Returns: 1 if the name is cached, 0 otherwise
+ */
+int dcache_lookup(int parent, char const *name, int *inumber) {
+    dcache_bucket_t *bucket = dcache_bucket(parent, name);
+    int found = 0;
+
+    bool locked = !epoch_enter();
+    if (locked) {
+        mutex_lock(&bucket->b_lock);
+    }
+    for (dentry_t *dentry =
+             atomic_load_explicit(&bucket->b_head, memory_order_acquire);
+         dentry != NULL;
+         dentry = atomic_load_explicit(&dentry->d_next, memory_order_acquire)) {
+        if (dentry_matches(dentry, parent, name)) {
+            *inumber = dentry->d_inumber;
+            found = 1;
+            break;
+        }
+    }
+    if (locked) {
+        mutex_unlock(&bucket->b_lock);
+    } else {
+        epoch_exit();
+    }
+
+    return found;
+}
+
+/*
+ * Returns the current generation of a directory, to be passed to
+ * dcache_insert along with what find_in_dir returns afterwards
+ */
+unsigned dcache_generation(int parent) {
+    return atomic_load(&dir_generation[parent]);
+}
+
+/*
+ * Caches the result of looking up a name in a directory, unless the
+ * directory changed since the given generation was taken
+ * Input:
+ *  - parent: inumber of the directory
+ *  - name: entry name
+ *  - inumber: inumber of the entry, -1 if there is none
+ *  - generation: value of dcache_generation before the lookup
+ */
+void dcache_insert(int parent, char const *name, int inumber,
+                   unsigned generation) {
+    dcache_bucket_t *bucket = dcache_bucket(parent, name);
+
+    dentry_t *dentry = malloc(sizeof(*dentry));
+    if (dentry == NULL) {
+        return; // caching is only an optimization
+    }
+    dentry->d_parent = parent;
+    dentry->d_inumber = inumber;
+    strncpy(dentry->d_name, name, MAX_FILE_NAME - 1);
+    dentry->d_name[MAX_FILE_NAME - 1] = 0;
+
+    mutex_lock(&bucket->b_lock);
+
+    if (atomic_load(&dir_generation[parent]) != generation) {
+        mutex_unlock(&bucket->b_lock);
+        free(dentry);
+        return;
+    }
+
+    /* Replace any previous entry for the name and keep the bucket short */
+    atomic_store_explicit(&dentry->d_next, atomic_load(&bucket->b_head),
+                          memory_order_relaxed);
+    atomic_store_explicit(&bucket->b_head, dentry, memory_order_release);
+
+    int depth = 1;
+    for (_Atomic(dentry_t *) *link = &dentry->d_next;
+         atomic_load(link) != NULL;) {
+        dentry_t *old = atomic_load(link);
+        if (dentry_matches(old, parent, name) ||
+            depth == DCACHE_BUCKET_DEPTH) {
+            atomic_store_explicit(link, atomic_load(&old->d_next),
+                                  memory_order_release);
+            epoch_retire(old, free);
+        } else {
+            link = &old->d_next;
+            depth++;
+        }
+    }
+
+    mutex_unlock(&bucket->b_lock);
+}
+
+/*
+ * Drops a name from the cache after the directory holding it changed.
+ * Must be called while the change is still serialized against other changes
+ * to the same directory.
+ */
+void dcache_invalidate(int parent, char const *name) {
+    dcache_bucket_t *bucket = dcache_bucket(parent, name);
+
+    atomic_fetch_add(&dir_generation[parent], 1);
+
+    mutex_lock(&bucket->b_lock);
+    for (_Atomic(dentry_t *) *link = &bucket->b_head; atomic_load(link) != NULL;
+         link = &atomic_load(link)->d_next) {
+        dentry_t *old = atomic_load(link);
+        if (dentry_matches(old, parent, name)) {
+            atomic_store_explicit(link, atomic_load(&old->d_next),
+                                  memory_order_release);
+            epoch_retire(old, free);
+            break;
+        }
+    }
+    mutex_unlock(&bucket->b_lock);
+}
@@ -0,0 +1,28 @@
+#ifndef DCACHE_H
+#define DCACHE_H
+
+/*
+ * Dentry cache: maps (parent directory inumber, entry name) to the inumber
+ * of the entry, or to -1 when the directory is known not to hold that name
+ * (negative entry). Path lookups use it to skip find_in_dir.
+ *
+ * Filling the cache races with changes to the directory, so lookups take a
+ * snapshot of the directory's generation (dcache_generation) before calling
+ * find_in_dir, and dcache_insert drops the result if the directory changed
+ * meanwhile. Changes to a directory call dcache_invalidate, which bumps the
+ * generation before dropping the cached name.
+ *
+ * Lookups take no lock (see epoch.h); inserts and invalidations serialize on
+ * the bucket's lock and retire the entries they drop.
+ */
+
+int dcache_init();
+void dcache_destroy();
+
+int dcache_lookup(int parent, char const *name, int *inumber);
+unsigned dcache_generation(int parent);
+void dcache_insert(int parent, char const *name, int inumber,
+                   unsigned generation);
+void dcache_invalidate(int parent, char const *name);
+
+#endif // DCACHE_H
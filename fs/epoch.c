@@ -0,0 +1,176 @@
+#include "epoch.h"
+#include "state.h"
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/* Epoch a thread read in when it entered its read section, 0 outside of it;
+ * each slot on a cache line of its own */
+typedef struct {
+    _Alignas(64) atomic_ulong es_epoch;
+    atomic_bool es_taken;
+} epoch_slot_t;
+
+static epoch_slot_t slots[EPOCH_SLOTS];
+static atomic_ulong global_epoch = 1;
+
+/* The slot of the calling thread, given back when the thread exits */
+static _Thread_local epoch_slot_t *my_slot;
+static _Thread_local unsigned my_depth;
+static pthread_key_t slot_key;
+static pthread_once_t slot_key_once = PTHREAD_ONCE_INIT;
+
+/* Retired nodes, newest first, so the epochs they were retired in never
+ * grow along the list */
+typedef struct retired {
+    struct retired *r_next;
+    void *r_node;
+    void (*r_destroy)(void *);
+    unsigned long r_epoch;
+} retired_t;
+
+static pthread_mutex_t retired_lock = PTHREAD_MUTEX_INITIALIZER;
+static retired_t *retired;
+static size_t retired_since_advance;
+
+static void slot_release(void *slot) {
+    atomic_store(&((epoch_slot_t *)slot)->es_epoch, 0);
+    atomic_store(&((epoch_slot_t *)slot)->es_taken, false);
+}
+
+static void slot_key_create() {
+    pthread_key_create(&slot_key, slot_release);
+}
+
+static epoch_slot_t *slot_get() {
+    if (my_slot != NULL) {
+        return my_slot;
+    }
+
+    pthread_once(&slot_key_once, slot_key_create);
+    for (size_t i = 0; i < EPOCH_SLOTS; i++) {
+        bool taken = false;
+        if (!atomic_load_explicit(&slots[i].es_taken, memory_order_relaxed) &&
+            atomic_compare_exchange_strong(&slots[i].es_taken, &taken, true)) {
+            if (pthread_setspecific(slot_key, &slots[i]) != 0) {
+                atomic_store(&slots[i].es_taken, false);
+                return NULL;
+            }
+            my_slot = &slots[i];
+            return my_slot;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Enters a read section; sections nest
+ * Returns: true if the thread may read without locks until epoch_exit,
+ * false if it must take the locks instead (and not call epoch_exit)
+ */
+bool epoch_enter() {
+    if (my_depth > 0) {
+        my_depth++;
+        return true;
+    }
+
+    epoch_slot_t *slot = slot_get();
+    if (slot == NULL) {
+        return false;
+    }
+
+    /* Sequentially consistent, so that reclaimers that do not see the slot
+     * set retired their nodes before any of the reads that follow */
+    atomic_store(&slot->es_epoch, atomic_load(&global_epoch));
+    my_depth = 1;
+    return true;
+}
+
+void epoch_exit() {
+    if (--my_depth == 0) {
+        atomic_store_explicit(&my_slot->es_epoch, 0, memory_order_release);
+    }
+}
+
+/*
+ * Moves the global epoch on if every thread in a read section has seen the
+ * current one, and destroys the nodes retired two epochs ago or earlier,
+ * which no reader can reach anymore. Must hold retired_lock.
+ */
+static void epoch_reclaim() {
+    unsigned long epoch = atomic_load(&global_epoch);
+    for (size_t i = 0; i < EPOCH_SLOTS; i++) {
+        unsigned long seen = atomic_load(&slots[i].es_epoch);
+        if (seen != 0 && seen != epoch) {
+            return;
+        }
+    }
+    atomic_store(&global_epoch, ++epoch);
+    retired_since_advance = 0;
+
+    retired_t **link = &retired;
+    while (*link != NULL && (*link)->r_epoch + 2 > epoch) {
+        link = &(*link)->r_next;
+    }
+    retired_t *old = *link;
+    *link = NULL;
+    while (old != NULL) {
+        retired_t *next = old->r_next;
+        old->r_destroy(old->r_node);
+        free(old);
+        old = next;
+    }
+}
+
+/*
+ * Hands a node that was unlinked from a shared structure over to be
+ * destroyed once no reader can hold it. The caller must not be in a read
+ * section.
+ * Input:
+ *  - node: the node, already unreachable for new readers
+ *  - destroy: frees it
+ */
+void epoch_retire(void *node, void (*destroy)(void *)) {
+    retired_t *entry = malloc(sizeof(*entry));
+
+    mutex_lock(&retired_lock);
+    if (entry == NULL) {
+        /* Wait for the readers instead */
+        mutex_unlock(&retired_lock);
+        unsigned long epoch = atomic_load(&global_epoch);
+        while (atomic_load(&global_epoch) < epoch + 2) {
+            mutex_lock(&retired_lock);
+            epoch_reclaim();
+            mutex_unlock(&retired_lock);
+        }
+        destroy(node);
+        return;
+    }
+
+    entry->r_node = node;
+    entry->r_destroy = destroy;
+    entry->r_epoch = atomic_load(&global_epoch);
+    entry->r_next = retired;
+    retired = entry;
+    if (++retired_since_advance >= EPOCH_RETIRE_BATCH) {
+        epoch_reclaim();
+    }
+    mutex_unlock(&retired_lock);
+}
+
+/*
+ * Destroys every retired node; no thread may be in a read section
+ */
+void epoch_destroy() {
+    mutex_lock(&retired_lock);
+    while (retired != NULL) {
+        retired_t *next = retired->r_next;
+        retired->r_destroy(retired->r_node);
+        free(retired);
+        retired = next;
+    }
+    retired_since_advance = 0;
+    mutex_unlock(&retired_lock);
+}
@@ -0,0 +1,27 @@
+#ifndef EPOCH_H
+#define EPOCH_H
+
+#include <stdbool.h>
+
+/*
+ * Epoch-based reclamation: lets readers walk shared linked structures (the
+ * directory indexes and the dentry cache) without taking their locks.
+ * Writers still serialize among themselves, publish new nodes with a
+ * release store and, instead of freeing the nodes they unlink, retire them;
+ * a retired node is only destroyed once every reader that could have seen
+ * it has left its read section.
+ *
+ * Each reading thread takes a slot of its own the first time it reads, and
+ * a read section only writes the current epoch to that slot and clears it
+ * afterwards. When every slot is taken, epoch_enter returns false and the
+ * caller must fall back to the structure's lock, which its writers hold
+ * while they unlink nodes.
+ */
+
+bool epoch_enter();
+void epoch_exit();
+
+void epoch_retire(void *node, void (*destroy)(void *));
+void epoch_destroy();
+
+#endif // EPOCH_H
@@ -0,0 +1,159 @@
+#include "latency.h"
+#include "config.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <time.h>
+
+static tfs_latency_t latency;
+
+/* Spin loop iterations each access kind costs under TFS_LATENCY_SPIN */
+static uint64_t spin_iterations[TFS_ACCESS_KINDS];
+static double spin_iterations_per_ns;
+static pthread_once_t spin_calibrated = PTHREAD_ONCE_INIT;
+
+/*
+ * Access counters, sharded so that threads charging accesses at once do not
+ * all bump the same cache line: each thread counts in its own shard, assigned
+ * round-robin on its first access, and the shards are only added up by
+ * latency_stats
+ */
+typedef struct {
+    _Alignas(64) atomic_uint_fast64_t lc_accesses[TFS_ACCESS_KINDS];
+} latency_counters_t;
+
+static latency_counters_t counters[LATENCY_COUNTER_SHARDS];
+static _Thread_local int counter_shard = -1;
+static atomic_uint counter_next_shard;
+
+static uint64_t const default_cost_ns[TFS_ACCESS_KINDS] = {
+    [TFS_ACCESS_INODE] = DEFAULT_INODE_ACCESS_NS,
+    [TFS_ACCESS_BITMAP] = DEFAULT_BITMAP_ACCESS_NS,
+    [TFS_ACCESS_BLOCK] = DEFAULT_BLOCK_ACCESS_NS,
+};
+
+/**
+ * We need to defeat the optimizer for the spin() function.
+ * Under optimization, the empty loop would be completely optimized away.
+ * This function tells the compiler that the assembly code being run (which is
+ * none) might potentially change *all memory in the process*.
+ *
+ * This prevents the optimizer from optimizing this code away, because it does
+ * not know what it does and it may have side effects.
+ *
+ * Reference with more information: https://youtu.be/nXaxk27zwlk?t=2775
+ *
+ * Exercise: try removing this function and look at the assembly generated to
+ * compare.
+ */
+static void touch_all_memory() { __asm volatile("" : : : "memory"); }
+
+static void spin(uint64_t iterations) {
+    for (uint64_t i = 0; i < iterations; i++) {
+        touch_all_memory();
+    }
+}
+
+/*
+ * Times the spin loop to find how many iterations take a nanosecond.
+ * Only done once per process, as it takes about a millisecond.
+ */
+static void spin_calibrate() {
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    spin(LATENCY_CALIBRATION_SPINS);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double ns = (double)(end.tv_sec - start.tv_sec) * 1e9 +
+                (double)(end.tv_nsec - start.tv_nsec);
+    if (ns < 1) {
+        ns = 1;
+    }
+    spin_iterations_per_ns = LATENCY_CALIBRATION_SPINS / ns;
+}
+
+/*
+ * Sets up the latency model and resets the access counters
+ * Input:
+ *  - settings: model settings, whose costs left at 0 are filled in
+ * Returns: 0 if successful, -1 if the model is not known
+ */
+int latency_init(tfs_latency_t *settings) {
+    switch (settings->model) {
+    case TFS_LATENCY_SPIN:
+        pthread_once(&spin_calibrated, spin_calibrate);
+        break;
+    case TFS_LATENCY_SLEEP:
+    case TFS_LATENCY_NONE:
+        break;
+    default:
+        return -1;
+    }
+
+    for (int kind = 0; kind < TFS_ACCESS_KINDS; kind++) {
+        if (settings->cost_ns[kind] == 0) {
+            settings->cost_ns[kind] = default_cost_ns[kind];
+        }
+        spin_iterations[kind] =
+            (uint64_t)((double)settings->cost_ns[kind] *
+                       spin_iterations_per_ns);
+        for (size_t i = 0; i < LATENCY_COUNTER_SHARDS; i++) {
+            atomic_store(&counters[i].lc_accesses[kind], 0);
+        }
+    }
+    latency = *settings;
+
+    return 0;
+}
+
+/*
+ * Counts an access to the persistent FS state and delays the caller by its
+ * cost under the current model
+ * Input:
+ *  - kind: what was accessed
+ */
+void latency_charge(tfs_access_kind_t kind) {
+    if (counter_shard == -1) {
+        counter_shard = (int)(atomic_fetch_add(&counter_next_shard, 1) %
+                              LATENCY_COUNTER_SHARDS);
+    }
+    atomic_fetch_add_explicit(&counters[counter_shard].lc_accesses[kind], 1,
+                              memory_order_relaxed);
+
+    switch (latency.model) {
+    case TFS_LATENCY_SPIN:
+        spin(spin_iterations[kind]);
+        break;
+    case TFS_LATENCY_SLEEP:
+        if (latency.cost_ns[kind] < LATENCY_SLEEP_MIN_NS) {
+            sched_yield();
+        } else {
+            struct timespec cost = {
+                .tv_sec = (time_t)(latency.cost_ns[kind] / 1000000000),
+                .tv_nsec = (long)(latency.cost_ns[kind] % 1000000000)};
+            nanosleep(&cost, NULL);
+        }
+        break;
+    case TFS_LATENCY_NONE:
+    default:
+        break;
+    }
+}
+
+/*
+ * Reads the access counters
+ * Input:
+ *  - stats: filled in with the number of accesses of each kind since the FS
+ *    was initialized
+ */
+void latency_stats(tfs_latency_stats_t *stats) {
+    for (int kind = 0; kind < TFS_ACCESS_KINDS; kind++) {
+        stats->accesses[kind] = 0;
+        for (size_t i = 0; i < LATENCY_COUNTER_SHARDS; i++) {
+            stats->accesses[kind] += atomic_load_explicit(
+                &counters[i].lc_accesses[kind], memory_order_relaxed);
+        }
+    }
+}
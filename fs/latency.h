@@ -0,0 +1,44 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdint.h>
+
+/*
+ * Storage latency model: every access to the persistent FS state (i-nodes,
+ * the free i-node and block bitmaps and the data blocks) is charged to it,
+ * emulating the latency it would have if that state really lived in
+ * secondary memory. Accesses are always counted, whatever the model.
+ */
+typedef enum {
+    TFS_LATENCY_SPIN,  /* busy loop, calibrated to the cost in nanoseconds */
+    TFS_LATENCY_SLEEP, /* sleep for the cost (yield if it is too short) */
+    TFS_LATENCY_NONE,  /* no delay at all */
+} tfs_latency_model_t;
+
+typedef enum {
+    TFS_ACCESS_INODE,  /* i-node read or written */
+    TFS_ACCESS_BITMAP, /* free i-node or free block bitmap */
+    TFS_ACCESS_BLOCK,  /* data block */
+    TFS_ACCESS_KINDS,
+} tfs_access_kind_t;
+
+/*
+ * Latency model settings (see tfs_init); costs left at 0 take their defaults.
+ * Settings left all at 0, as in a zero-initialized tfs_params_t, select
+ * TFS_LATENCY_SPIN with every access costing 1 us (DEFAULT_*_ACCESS_NS in
+ * config.h); ask for TFS_LATENCY_NONE to run without delays.
+ */
+typedef struct {
+    tfs_latency_model_t model;
+    uint64_t cost_ns[TFS_ACCESS_KINDS]; /* cost of one access of each kind */
+} tfs_latency_t;
+
+typedef struct {
+    uint64_t accesses[TFS_ACCESS_KINDS]; /* accesses of each kind so far */
+} tfs_latency_stats_t;
+
+int latency_init(tfs_latency_t *latency);
+void latency_charge(tfs_access_kind_t kind);
+void latency_stats(tfs_latency_stats_t *stats);
+
+#endif // LATENCY_H
@@ -1,15 +1,27 @@
 #include "operations.h"
+#include "dcache.h"
+#include "readahead.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
 
-int tfs_init() {
-    state_init();
+int tfs_init(tfs_params_t const *params) {
+    if (state_init(params) == -1) {
+        return -1;
+    }
 
-    /* create root inode */
-    int root = inode_create(T_DIRECTORY);
-    if (root != ROOT_DIR_INUM) {
+    /* create root inode, unless a volume image already has it */
+    if (!inode_exists(ROOT_DIR_INUM) &&
+        inode_create(T_DIRECTORY) != ROOT_DIR_INUM) {
         return -1;
     }
 
@@ -25,85 +37,217 @@ static bool valid_pathname(char const *name) {
     return name != NULL && strlen(name) > 1 && name[0] == '/';
 }
 
-int tfs_lookup(char const *name) {
-    if (!valid_pathname(name)) {
+/*
+    Looks up a name inside a directory, going through the dentry cache first
+    Returns the inumber of the entry, -1 if there is none
+*/
+static int lookup_in_dir(int parent, char const *name) {
+    int inumber;
+
+    if (dcache_lookup(parent, name, &inumber)) {
+        return inumber;
+    }
+
+    unsigned generation = dcache_generation(parent);
+    inumber = find_in_dir(parent, name);
+    dcache_insert(parent, name, inumber, generation);
+
+    return inumber;
+}
+
+/*
+    Walks an absolute path one component at a time, starting at the root
+    directory. Empty components (repeated or trailing '/') are skipped.
+    Inputs:
+        - path: absolute path name
+        - last: if not NULL, the walk stops at the directory that should hold
+          the last component, whose name is copied into last (which must
+          hold MAX_FILE_NAME characters)
+    Returns the inumber reached, -1 if some component does not exist
+*/
+static int walk_path(char const *path, char *last) {
+    char name[MAX_FILE_NAME];
+    int inumber = ROOT_DIR_INUM;
+
+    if (!valid_pathname(path)) {
         return -1;
     }
 
-    // skip the initial '/' character
-    name++;
+    for (char const *p = path;;) {
+        while (*p == '/') {
+            p++;
+        }
+
+        size_t len = strcspn(p, "/");
+        if (len == 0 || len >= MAX_FILE_NAME) {
+            return -1;
+        }
+        memcpy(name, p, len);
+        name[len] = '\0';
+
+        p += len;
+        while (*p == '/') {
+            p++;
+        }
+
+        if (*p == '\0' && last != NULL) {
+            memcpy(last, name, len + 1);
+            return inumber;
+        }
+
+        inumber = lookup_in_dir(inumber, name);
+        if (inumber == -1 || *p == '\0') {
+            return inumber;
+        }
+    }
+}
+
+int tfs_lookup(char const *name) { return walk_path(name, NULL); }
+
+int tfs_stat(char const *name, tfs_stat_t *st) {
+    inode_meta_t meta;
 
-    return find_in_dir(ROOT_DIR_INUM, name);
+    int inum = tfs_lookup(name);
+    if (inum == -1 || inode_meta_read(inum, &meta) == -1) {
+        return -1;
+    }
+
+    st->st_inumber = inum;
+    st->st_type = meta.im_type;
+    st->st_size = meta.im_size;
+    return 0;
 }
 
 int tfs_open(char const *name, int flags) {
-    int inum;
-    size_t offset;
+    char last[MAX_FILE_NAME];
+    int fhandle;
 
     /* Checks if the path name is valid */
     if (!valid_pathname(name)) {
         return -1;
     }
 
-    inum = tfs_lookup(name);
-    if (inum >= 0) {
-        /* The file already exists */
-        inode_t *inode = inode_get(inum);
-
-        if (inode == NULL) {
+    for (;;) {
+        int parent = walk_path(name, last);
+        if (parent == -1) {
             return -1;
         }
 
-        // TODO: Fixed in order to compile, check lock type
-        write_lock(&inode->i_lock);
+        int inum = lookup_in_dir(parent, last);
+        if (inum == -1) {
+            if (!(flags & TFS_O_CREAT)) {
+                return -1;
+            }
 
-        /* Trucate (if requested) */
-        if (flags & TFS_O_TRUNC) {
-            if (inode->i_size > 0) {
-                if (iterate_blocks(inode, 0,
-                                   (int)(inode->i_size / BLOCK_SIZE) + 1,
-                                   &data_block_free) == -1) {
-                    rw_unlock(&inode->i_lock);
+            /* The file doesn't exist; the flags specify that it should be
+             * created*/
+            inum = inode_create(T_FILE);
+            if (inum == -1) {
+                return -1;
+            }
+            /* Add entry in the parent directory */
+            if (add_dir_entry(parent, inum, last) == -1) {
+                inode_delete(inum);
+
+                /* Unless another thread created the same file meanwhile (in
+                 * which case it is opened on the next iteration), give up */
+                if (find_in_dir(parent, last) == -1) {
                     return -1;
                 }
-                inode->i_size = 0;
+                continue;
             }
         }
-        /* Determine initial offset */
-        if (flags & TFS_O_APPEND) {
-            offset = inode->i_size;
-        } else {
-            offset = 0;
+
+        inode_t *inode = inode_get(inum);
+        if (inode == NULL || inode->i_node_type != T_FILE) {
+            return -1;
         }
 
-        rw_unlock(&inode->i_lock);
+        /* Add entry to the open file table, which keeps the file from being
+         * deleted from then on. The name may have been unlinked before that
+         * (and its i-node reused), so it must still lead to the file. */
+        fhandle = add_to_open_file_table(inum, 0);
+        if (lookup_in_dir(parent, last) != inum) {
+            if (fhandle != -1) {
+                tfs_close(fhandle);
+            }
+            continue;
+        }
+        if (fhandle == -1) {
+            return -1;
+        }
 
-    } else if (flags & TFS_O_CREAT) {
-        /* The file doesn't exist; the flags specify that it should be
-         * created*/
-        /* Create inode */
-        inum = inode_create(T_FILE);
-        if (inum == -1) {
+        /* Trucate (if requested) */
+        if (flags & TFS_O_TRUNC) {
+            write_lock(&inode->i_lock);
+            int r = inode->i_size > 0 ? inode_truncate(inode) : 0;
+            rw_unlock(&inode->i_lock);
+            if (r == -1) {
+                tfs_close(fhandle);
+                return -1;
+            }
+        }
+        break;
+    }
+
+    /* Determine initial offset; plain opens do not touch the i-node, so
+     * they do not wait for its writers */
+    if (flags & TFS_O_APPEND) {
+        inode_meta_t meta;
+        open_file_entry_t *file = get_open_file_entry(fhandle);
+        if (file == NULL) {
             return -1;
         }
-        /* Add entry in the root directory */
-        if (add_dir_entry(ROOT_DIR_INUM, inum, name + 1) == -1) {
-            inode_delete(inum);
+        if (inode_meta_read(file->of_inumber, &meta) == -1) {
+            mutex_unlock(&file->of_lock);
+            tfs_close(fhandle);
             return -1;
         }
-        offset = 0;
-    } else
-        return -1;
+        file->of_offset = meta.im_size;
+        file->of_ra_next = meta.im_size;
+        mutex_unlock(&file->of_lock);
+    }
 
-    /* Finally, add entry to the open file table and
-     * return the corresponding handle */
-    return add_to_open_file_table(inum, offset);
+    return fhandle;
 
     /* Note: for simplification, if file was created with TFS_O_CREAT and
      * there is an error adding an entry to the open file table, the file is
      * not opened but it remains created */
 }
 
+int tfs_mkdir(char const *name) {
+    char last[MAX_FILE_NAME];
+
+    int parent = walk_path(name, last);
+    if (parent == -1) {
+        return -1;
+    }
+
+    int inum = inode_create(T_DIRECTORY);
+    if (inum == -1) {
+        return -1;
+    }
+
+    if (add_dir_entry(parent, inum, last) == -1) {
+        inode_delete(inum);
+        return -1;
+    }
+
+    return 0;
+}
+
+int tfs_unlink(char const *name) {
+    char last[MAX_FILE_NAME];
+
+    int parent = walk_path(name, last);
+    if (parent == -1) {
+        return -1;
+    }
+
+    /* Open (or mapped) files and non-empty directories stay */
+    return unlink_dir_entry(parent, last);
+}
+
 int tfs_close(int fhandle) { return remove_from_open_file_table(fhandle); }
 
 /*
@@ -114,274 +258,1018 @@ int abort_operation(int fhandle) {
     return -1;
 }
 
-ssize_t tfs_write(int fhandle, void const *buffer, size_t to_write) {
-    open_file_entry_t *file = get_open_file_entry(fhandle);
-    if (file == NULL) {
-        return -1;
+/*
+    Returns how many of the given blocks (at most count) are laid out one
+    after the other in fs_data, starting with the first one
+*/
+static int contiguous_run(int const *blocks, int count) {
+    int run = 1;
+    while (run < count && blocks[run] == blocks[0] + run) {
+        run++;
     }
+    return run;
+}
 
-    /* From the open file table entry, we get the inode */
-    inode_t *inode = inode_get(file->of_inumber);
-    if (inode == NULL) {
-        mutex_unlock(&file->of_lock);
+/*
+    Position inside an array of buffers, used to gather the data of a write
+    from (or scatter the data of a read into) several buffers in one pass
+*/
+typedef struct {
+    struct iovec const *ic_iov; /* current buffer */
+    size_t ic_offset;           /* offset inside the current buffer */
+} iov_cursor_t;
+
+/*
+    Copies n bytes between a memory area and the buffers at the cursor, and
+    moves the cursor past them
+    Inputs:
+        - cursor: position in the buffers (which must hold n more bytes)
+        - data: memory area (NULL, when scattering, to fill the buffers
+          with zeros)
+        - n: number of bytes
+        - gather: whether the bytes go from the buffers into data (a write),
+          rather than from data into the buffers (a read)
+*/
+static void iov_copy(iov_cursor_t *cursor, char *data, size_t n,
+                     bool gather) {
+    while (n > 0) {
+        struct iovec const *iov = cursor->ic_iov;
+        size_t chunk = iov->iov_len - cursor->ic_offset;
+        if (chunk > n) {
+            chunk = n;
+        }
+
+        /* Empty buffers may have a NULL base, so they are only stepped over */
+        if (chunk > 0) {
+            char *base = (char *)iov->iov_base + cursor->ic_offset;
+            if (gather) {
+                memcpy(data, base, chunk);
+                data += chunk;
+            } else if (data != NULL) {
+                memcpy(base, data, chunk);
+                data += chunk;
+            } else {
+                memset(base, 0, chunk);
+            }
+        }
+
+        n -= chunk;
+        cursor->ic_offset += chunk;
+        if (cursor->ic_offset == iov->iov_len) {
+            cursor->ic_iov++;
+            cursor->ic_offset = 0;
+        }
+    }
+}
+
+/*
+    Adds up the lengths of an array of buffers
+    Returns the total length, -1 if the array is invalid or the total does
+    not fit in a ssize_t
+*/
+static ssize_t iov_length(struct iovec const *iov, int iovcnt) {
+    size_t len = 0;
+
+    if (iovcnt < 0 || (iovcnt > 0 && iov == NULL)) {
         return -1;
     }
+    for (int i = 0; i < iovcnt; i++) {
+        if (iov[i].iov_len > (size_t)SSIZE_MAX - len) {
+            return -1;
+        }
+        len += iov[i].iov_len;
+    }
 
-    size_t to_write_remaining = to_write;
-    if (to_write > 0) {
-        write_lock(&inode->i_lock);
+    return (ssize_t)len;
+}
 
-        if (inode->i_size == 0) {
-            /* If empty file, allocate new blocks */
-            if (iterate_blocks(inode, 0, (int)(to_write / BLOCK_SIZE) + 1,
-                               &allocate_block_aux) == -1) {
-                rw_unlock(&inode->i_lock);
-                mutex_unlock(&file->of_lock);
-                
-                return -1;
-            }
+/*
+    Makes room for len bytes at the given offset of the inode, allocating
+    the blocks that are missing and growing the file to cover them; the
+    data itself is copied afterwards by inode_overwrite, which only needs
+    the inode's lock for reading. Writing past the end of the file clears
+    whatever lies between the end and the write in the blocks they share,
+    so that the gap reads as zeros, and so is whatever the write leaves
+    uncovered in the blocks it allocates, which may still hold the data of
+    a deleted file. The caller must hold the inode's write
+    lock, and a write range lock (see inode_range_lock) on the blocks, so
+    that no reader sees them before the data is copied.
+    Returns the number of bytes there is room for (can be lower than len if
+    the FS is full or the maximum file size is reached)
+*/
+static size_t inode_extend(inode_t *inode, size_t offset, size_t len) {
+    size_t size = inode->i_size;
+    int block;
+    char *data;
+
+    if (offset > size && size % BLOCK_SIZE != 0) {
+        if (inode_block_map(inode, (int)(size / BLOCK_SIZE), 1, &block) != -1 &&
+            (data = data_block_get(block)) != NULL) {
+            size_t end = size - size % BLOCK_SIZE + BLOCK_SIZE;
+            memset(data + size % BLOCK_SIZE, 0,
+                   (offset < end ? offset : end) - size);
         }
+    }
 
-        int current = ((int)file->of_offset / BLOCK_SIZE);
-        int end = current + ((int)to_write / BLOCK_SIZE) + 1;
-        int initial_offset = (int)file->of_offset % BLOCK_SIZE;
+    if (len == 0 || offset / BLOCK_SIZE >= (size_t)MAX_FILE_BLOCKS) {
+        return 0;
+    }
+    int first = (int)(offset / BLOCK_SIZE);
+    size_t blocks = (offset + len - 1) / BLOCK_SIZE - (size_t)first + 1;
+    int count = blocks > (size_t)(MAX_FILE_BLOCKS - first)
+                    ? MAX_FILE_BLOCKS - first
+                    : (int)blocks;
+
+    /* Only the first and last blocks can be partly left out of the write */
+    int first_old, last_old;
+    if (inode_block_map(inode, first, 1, &first_old) == -1 ||
+        inode_block_map(inode, first + count - 1, 1, &last_old) == -1) {
+        return 0;
+    }
 
-        while (current < 10 && current < end) {
-            if (inode->i_data_direct_blocks[current] == -1)
-                if ((inode->i_data_direct_blocks[current] =
-                         data_block_alloc()) == -1) {
-                    rw_unlock(&inode->i_lock);
-                    mutex_unlock(&file->of_lock);
+    int mapped = inode_block_alloc(inode, first, count, NULL);
+    if (mapped == 0) {
+        return 0;
+    }
 
-                    return -1;
-                }
+    /* A new block, or one that starts past the end of the file, reads as
+     * zeros before the write */
+    size_t block_offset = offset % BLOCK_SIZE;
+    if (block_offset > 0 &&
+        (first_old == -1 || offset - block_offset >= size)) {
+        if (inode_block_map(inode, first, 1, &block) == -1 ||
+            (data = data_block_get(block)) == NULL) {
+            return 0;
+        }
+        memset(data, 0, block_offset);
+    }
 
-            void *block = data_block_get(inode->i_data_direct_blocks[current]);
-            if (block == NULL) {
-                rw_unlock(&inode->i_lock);
-                mutex_unlock(&file->of_lock);
+    size_t done = (size_t)mapped * BLOCK_SIZE - block_offset;
+    if (done > len) {
+        done = len;
+    }
 
-                return -1;
+    /* And a new block reads as zeros after it (a block only partly mapped
+     * means the write stops at a block boundary) */
+    size_t tail = (offset + done) % BLOCK_SIZE;
+    if (mapped == count && last_old == -1 && tail != 0) {
+        if (inode_block_map(inode, first + count - 1, 1, &block) == -1 ||
+            (data = data_block_get(block)) == NULL) {
+            return 0;
+        }
+        memset(data + tail, 0, BLOCK_SIZE - tail);
+    }
+    if (offset + done > inode->i_size) {
+        inode_size_set(inode, offset + done);
+    }
+
+    return done;
+}
+
+/*
+    Makes room for len bytes at the given offset of a file like
+    inode_extend, but keeps data appended past the file's last block in its
+    delayed allocation buffer instead of allocating blocks for it: they are
+    allocated together when the buffer is flushed (by the last tfs_close of
+    the file, or when the buffer is full). A write that leaves a gap past the
+    end of the file, or that the buffer can not take, flushes it and goes to
+    the blocks.
+    The caller must hold the inode's write lock, and a write range lock on
+    the blocks.
+    Returns the number of bytes there is room for
+*/
+static size_t inode_extend_delayed(inode_t *inode, size_t offset,
+                                   size_t len) {
+    delalloc_t const *da = inode_delalloc(inode);
+    size_t size = inode->i_size;
+    size_t start = da->da_data != NULL
+                       ? da->da_start
+                       : (size + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE;
+
+    if (inode->i_node_type != T_FILE || len == 0 ||
+        (offset < start && len <= start - offset)) {
+        return inode_extend(inode, offset, len);
+    }
+    if (offset > size ||
+        (offset + len - 1) / BLOCK_SIZE >= (size_t)MAX_FILE_BLOCKS ||
+        inode_delalloc_grow(inode, start, offset + len) == NULL) {
+        if (inode_delalloc_flush(inode) == -1) {
+            return 0;
+        }
+        return inode_extend(inode, offset, len);
+    }
+
+    /* The part that falls in the file's last block goes there */
+    if (offset < start) {
+        size_t done = inode_extend(inode, offset, start - offset);
+        if (done < start - offset) {
+            return done;
+        }
+    }
+
+    if (offset + len > inode->i_size) {
+        inode_size_set(inode, offset + len);
+    }
+
+    return len;
+}
+
+/*
+    Copies len bytes, gathered from the buffers at the cursor, over the bytes
+    of a file from the given offset on, stopping at the first hole or at the
+    end of the file. Bytes in blocks are written there, each run of
+    contiguous blocks in a single pass over the buffers, and the ones past
+    the last block into the delayed allocation buffer. Neither the block map
+    nor the size change, so the caller only needs the inode's lock for
+    reading, plus a write range lock (see inode_range_lock) on the blocks
+    written.
+    Returns the number of bytes written (the rest needs inode_extend_delayed
+    first)
+*/
+static size_t inode_overwrite(inode_t *inode, size_t offset, iov_cursor_t *src,
+                              size_t len) {
+    int blocks[BLOCK_MAP_BATCH];
+    size_t done = 0;
+
+    delalloc_t const *da = inode_delalloc(inode);
+    size_t size = inode->i_size;
+    if (inode->i_node_type != T_FILE || offset >= size) {
+        return 0;
+    }
+    if (len > size - offset) {
+        len = size - offset;
+    }
+
+    size_t end = da->da_data != NULL ? da->da_start : size;
+    size_t in_blocks = offset >= end ? 0 : end - offset;
+    if (in_blocks > len) {
+        in_blocks = len;
+    }
+
+    while (done < in_blocks) {
+        size_t pos = offset + done;
+        int first = (int)(pos / BLOCK_SIZE);
+        int count =
+            (int)((pos + (in_blocks - done) - 1) / BLOCK_SIZE) - first + 1;
+        if (count > BLOCK_MAP_BATCH) {
+            count = BLOCK_MAP_BATCH;
+        }
+
+        if (inode_block_map(inode, first, count, blocks) == -1) {
+            return done;
+        }
+
+        size_t block_offset = pos % BLOCK_SIZE;
+        for (int i = 0; i < count && done < in_blocks;) {
+            if (blocks[i] == -1) {
+                return done;
+            }
+            int run = contiguous_run(blocks + i, count - i);
+            char *data = data_blocks_get(blocks[i], run);
+            if (data == NULL) {
+                return done;
             }
 
-            if (write_to_block(&file->of_offset, initial_offset,
-                               &to_write_remaining, block, buffer,
-                               to_write - to_write_remaining, inode) == -1) {
-                rw_unlock(&inode->i_lock);
-                mutex_unlock(&file->of_lock);
-                
-                return -1;
+            size_t n = (size_t)run * BLOCK_SIZE - block_offset;
+            if (n > in_blocks - done) {
+                n = in_blocks - done;
             }
+            iov_copy(src, data + block_offset, n, true);
 
-            initial_offset = 0;
-            current++;
+            done += n;
+            block_offset = 0;
+            i += run;
         }
+    }
+
+    /* Writers of disjoint ranges copy into the buffer at once: it only
+     * moves or goes away under the inode's write lock */
+    if (done < len) {
+        iov_copy(src, da->da_data + (offset + done - da->da_start),
+                 len - done, true);
+        done = len;
+    }
 
-        // iterate throw direct block on indirect block
-        // Get indirect block data to access direct block
+    return done;
+}
 
-        // Check if the inode has an indirect block allocated
-        if (inode->i_data_indirect_block == -1)
-            if ((inode->i_data_indirect_block = data_block_alloc()) == -1) {
-                rw_unlock(&inode->i_lock);
-                mutex_unlock(&file->of_lock);
+/*
+    Writes len bytes to a file at the given offset, holding a write range
+    lock on the blocks it touches. The inode's write lock is only taken to
+    allocate the blocks (or room in the delayed allocation buffer) a write
+    past the existing ones needs and to grow the file; the data is always
+    copied under the lock for reading, so writers of disjoint ranges copy in
+    parallel, and readers of other ranges never wait for them.
+    Returns the number of bytes written
+*/
+static size_t file_write(int inumber, inode_t *inode, size_t offset,
+                         iov_cursor_t *src, size_t len) {
+    inode_range_t range;
+    inode_range_lock(inumber, offset, len, true, &range);
 
-                return -1;
-            }
+    read_lock(&inode->i_lock);
+    size_t done = inode_overwrite(inode, offset, src, len);
+    rw_unlock(&inode->i_lock);
 
-        int *indirect_block =
-            (int *)data_block_get(inode->i_data_indirect_block);
-        if (indirect_block == NULL) {
+    if (done < len) {
+        write_lock(&inode->i_lock);
+        size_t room = inode_extend_delayed(inode, offset + done, len - done);
+        rw_unlock(&inode->i_lock);
+
+        if (room > 0) {
+            read_lock(&inode->i_lock);
+            done += inode_overwrite(inode, offset + done, src, room);
             rw_unlock(&inode->i_lock);
-            mutex_unlock(&file->of_lock);
-            return -1;
         }
-        while (current < end) {
-            int indirection_block_index = *(((int *)indirect_block));
+    }
 
-            void *block = data_block_get(indirection_block_index);
-            if (block == NULL) {
-                rw_unlock(&inode->i_lock);mutex_unlock(&file->of_lock);
-                mutex_unlock(&file->of_lock);
-                return -1;
-            }
+    inode_range_unlock(inumber, &range);
+
+    return done;
+}
+
+/*
+    Reads up to len bytes at the given offset of the inode (never past its
+    size), scattering them into the buffers at the cursor. Each run of
+    contiguous blocks is copied in a single pass over the buffers. Blocks
+    never written (left behind by a positional write past the end of the
+    file) read as zeros. The caller must hold the inode's lock.
+    Returns the number of bytes read
+*/
+static size_t inode_read(inode_t *inode, size_t offset, iov_cursor_t *dst,
+                         size_t len) {
+    int blocks[BLOCK_MAP_BATCH];
+    size_t done = 0;
 
-            if (write_to_block(&file->of_offset, initial_offset,
-                               &to_write_remaining, block, buffer,
-                               to_write - to_write_remaining, inode) == -1) {
-                rw_unlock(&inode->i_lock);
-                mutex_unlock(&file->of_lock);
-                return -1; // Hol up, wait a minute, something aint right.
+    if (offset >= inode->i_size) {
+        return 0;
+    }
+    if (len > inode->i_size - offset) {
+        len = inode->i_size - offset;
+    }
+
+    /* The part in the delayed allocation buffer is read from there */
+    delalloc_t const *da = inode_delalloc(inode);
+    size_t buffered = 0;
+    if (da->da_data != NULL && offset + len > da->da_start) {
+        buffered =
+            offset + len - (offset > da->da_start ? offset : da->da_start);
+        len -= buffered;
+    }
+
+    while (done < len) {
+        size_t pos = offset + done;
+        int first = (int)(pos / BLOCK_SIZE);
+        int count = (int)((pos + (len - done) - 1) / BLOCK_SIZE) - first + 1;
+        if (count > BLOCK_MAP_BATCH) {
+            count = BLOCK_MAP_BATCH;
+        }
+
+        if (inode_block_map(inode, first, count, blocks) == -1) {
+            return done;
+        }
+
+        size_t block_offset = pos % BLOCK_SIZE;
+        for (int i = 0; i < count && done < len;) {
+            int run = 1;
+            char *data = NULL;
+            if (blocks[i] != -1) {
+                run = contiguous_run(blocks + i, count - i);
+                data = data_blocks_get(blocks[i], run);
+                if (data == NULL) {
+                    return done;
+                }
             }
 
-            indirect_block += sizeof(int);
+            size_t n = (size_t)run * BLOCK_SIZE - block_offset;
+            if (n > len - done) {
+                n = len - done;
+            }
+            iov_copy(dst, data == NULL ? NULL : data + block_offset, n, false);
 
-            initial_offset = 0;
-            current++;
+            done += n;
+            block_offset = 0;
+            i += run;
         }
-        mutex_unlock(&file->of_lock);
-        rw_unlock(&inode->i_lock);
     }
 
-    // Increment i_size only of to_write plus offset is bigger then i_size
-    // if (to_write > (inode->i_size - inittial_offset))
-    //    inode->i_size = to_write - (inode->i_size - inittial_offset);
+    if (buffered > 0) {
+        iov_copy(dst, da->da_data + (offset + done - da->da_start), buffered,
+                 false);
+        done += buffered;
+    }
 
-    return (ssize_t)to_write;
+    return done;
 }
 
-ssize_t tfs_read(int fhandle, void *buffer, size_t len) {
+ssize_t tfs_writev(int fhandle, struct iovec const *iov, int iovcnt) {
+    ssize_t to_write = iov_length(iov, iovcnt);
+    if (to_write == -1) {
+        return -1;
+    }
+
     open_file_entry_t *file = get_open_file_entry(fhandle);
     if (file == NULL) {
+        return -1;
+    }
+
+    /* From the open file table entry, we get the inode */
+    inode_t *inode = inode_get(file->of_inumber);
+    if (inode == NULL) {
         mutex_unlock(&file->of_lock);
         return -1;
     }
 
+    size_t written = 0;
+    if (to_write > 0) {
+        iov_cursor_t src = {.ic_iov = iov, .ic_offset = 0};
+
+        written = file_write(file->of_inumber, inode, file->of_offset, &src,
+                             (size_t)to_write);
+
+        if (written == 0) {
+            /* Not a single block could be allocated */
+            mutex_unlock(&file->of_lock);
+            return -1;
+        }
+
+        /* The offset associated with the file handle is
+         * incremented accordingly */
+        file->of_offset += written;
+    }
+
+    mutex_unlock(&file->of_lock);
+
+    return (ssize_t)written;
+}
+
+ssize_t tfs_write(int fhandle, void const *buffer, size_t to_write) {
+    struct iovec iov = {.iov_base = (void *)buffer, .iov_len = to_write};
+    return tfs_writev(fhandle, &iov, 1);
+}
+
+/*
+    Detects sequential reads through an open file and queues the blocks that
+    follow them to be read ahead. The window starts at READAHEAD_MIN_BLOCKS
+    and doubles on every read that starts where the previous one ended, up
+    to READAHEAD_MAX_BLOCKS or a quarter of the block cache; any other read
+    closes it, so random readers only pay for the check.
+    Must hold the entry's lock and the i-node's lock.
+*/
+static void file_readahead(open_file_entry_t *file, inode_t *inode,
+                           size_t offset, size_t read) {
+    int blocks[READAHEAD_MAX_BLOCKS];
+
+    /* Blocks read ahead must not push each other out of the cache before
+     * they are read */
+    int max_window = READAHEAD_MAX_BLOCKS;
+    if ((size_t)max_window > fs_params.block_cache_blocks / 4) {
+        max_window = (int)(fs_params.block_cache_blocks / 4);
+    }
+
+    if (offset != file->of_ra_next) {
+        file->of_ra_window = 0;
+        file->of_ra_end = 0;
+    } else if (file->of_ra_window == 0) {
+        file->of_ra_window = READAHEAD_MIN_BLOCKS;
+    } else {
+        file->of_ra_window *= 2;
+    }
+    if (file->of_ra_window > max_window) {
+        file->of_ra_window = max_window;
+    }
+    file->of_ra_next = offset + read;
+    if (file->of_ra_window == 0) {
+        return;
+    }
+
+    size_t next = (offset + read + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    size_t end = next + (size_t)file->of_ra_window;
+    size_t file_blocks = (inode->i_size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    if (end > file_blocks) {
+        end = file_blocks;
+    }
+    size_t first = next;
+    if (first < (size_t)file->of_ra_end) {
+        first = (size_t)file->of_ra_end;
+    }
+    if (first >= end) {
+        return;
+    }
+
+    int count = (int)(end - first);
+    if (inode_block_map(inode, (int)first, count, blocks) != -1) {
+        readahead_request(blocks, count);
+        file->of_ra_end = (int)end;
+    }
+}
+
+ssize_t tfs_readv(int fhandle, struct iovec const *iov, int iovcnt) {
+    ssize_t len = iov_length(iov, iovcnt);
+    if (len == -1) {
+        return -1;
+    }
+
+    open_file_entry_t *file = get_open_file_entry(fhandle);
+    if (file == NULL) {
+        return -1;
+    }
+
     /* From the open file table entry, we get the inode */
     inode_t *inode = inode_get(file->of_inumber);
     if (inode == NULL) {
         mutex_unlock(&file->of_lock);
         return -1;
     }
+
+    iov_cursor_t dst = {.ic_iov = iov, .ic_offset = 0};
+
+    inode_range_t range;
+    inode_range_lock(file->of_inumber, file->of_offset, (size_t)len, false,
+                     &range);
     read_lock(&inode->i_lock);
+    size_t read = inode_read(inode, file->of_offset, &dst, (size_t)len);
+    file_readahead(file, inode, file->of_offset, read);
+    rw_unlock(&inode->i_lock);
+    inode_range_unlock(file->of_inumber, &range);
 
-    /* Determine how many bytes to read */
-    size_t to_read = inode->i_size - file->of_offset;
-    if (to_read > len) {
-        to_read = len;
+    file->of_offset += read;
+    mutex_unlock(&file->of_lock);
+
+    return (ssize_t)read;
+}
+
+ssize_t tfs_read(int fhandle, void *buffer, size_t len) {
+    struct iovec iov = {.iov_base = buffer, .iov_len = len};
+    return tfs_readv(fhandle, &iov, 1);
+}
+
+/*
+    Takes an inode's lock for reading once its delayed allocation buffer is
+    flushed, for operations that go straight to its blocks. The write lock is
+    only taken, and dropped again, when there is a buffer to flush.
+    Returns 0 if successful (holding the read lock), -1 if the flush failed
+    (holding no lock)
+*/
+static int read_lock_flushed(inode_t *inode) {
+    read_lock(&inode->i_lock);
+    while (inode_delalloc(inode)->da_data != NULL) {
+        rw_unlock(&inode->i_lock);
+
+        write_lock(&inode->i_lock);
+        int r = inode_delalloc_flush(inode);
+        rw_unlock(&inode->i_lock);
+        if (r == -1) {
+            return -1;
+        }
+
+        /* Data may be buffered again while no lock is held */
+        read_lock(&inode->i_lock);
     }
 
-    size_t to_read_remaining = to_read;
-    if (to_read > 0) {
+    return 0;
+}
+
+/*
+    Adds a range of memory to a read mapping
+    Inputs:
+        - map: the mapping
+        - data, len: the range
+        - merge: whether the range may extend the last one, if it follows it
+    Returns 0 if successful, -1 if there is no memory for it
+*/
+static int read_map_add(tfs_read_map_t *map, char *data, size_t len,
+                        bool merge) {
+    if (merge && map->rm_iovcnt > 0) {
+        struct iovec *last = &map->rm_iov[map->rm_iovcnt - 1];
+        if ((char *)last->iov_base + last->iov_len == data) {
+            last->iov_len += len;
+            return 0;
+        }
+    }
 
-        int current = ((int)file->of_offset / BLOCK_SIZE);
-        int end = current + ((int)to_read / BLOCK_SIZE) + 1;
-        int initial_offset = (int)file->of_offset % BLOCK_SIZE;
+    if (map->rm_iovcnt == map->rm_capacity) {
+        int capacity = map->rm_capacity == 0 ? 8 : 2 * map->rm_capacity;
+        struct iovec *iov =
+            realloc(map->rm_iov, (size_t)capacity * sizeof(*iov));
+        if (iov == NULL) {
+            return -1;
+        }
+        map->rm_iov = iov;
+        map->rm_capacity = capacity;
+    }
 
-        while (current < 10 && current < end) {
-            if (inode->i_data_direct_blocks[current] == -1) {
-                if ((inode->i_data_direct_blocks[current] =
-                         data_block_alloc()) == -1) {
-                    rw_unlock(&inode->i_lock);
-                    mutex_unlock(&file->of_lock);
-                    return -1;
+    map->rm_iov[map->rm_iovcnt].iov_base = data;
+    map->rm_iov[map->rm_iovcnt].iov_len = len;
+    map->rm_iovcnt++;
+
+    return 0;
+}
+
+/*
+    Maps up to len bytes at the given offset of the inode (never past its
+    size) into ranges of fs_data. Blocks never written are mapped to a block
+    of zeros owned by the mapping. The caller must hold the inode's lock.
+    Returns the number of bytes mapped, -1 if there is no memory for the
+    ranges
+*/
+static ssize_t inode_read_map(inode_t *inode, size_t offset, size_t len,
+                              tfs_read_map_t *map) {
+    int blocks[BLOCK_MAP_BATCH];
+    size_t done = 0;
+    bool last_zeros = true; /* only ranges of fs_data are merged */
+
+    if (offset >= inode->i_size) {
+        return 0;
+    }
+    if (len > inode->i_size - offset) {
+        len = inode->i_size - offset;
+    }
+
+    /* The part in the delayed allocation buffer is read from there */
+    delalloc_t const *da = inode_delalloc(inode);
+    size_t buffered = 0;
+    if (da->da_data != NULL && offset + len > da->da_start) {
+        buffered =
+            offset + len - (offset > da->da_start ? offset : da->da_start);
+        len -= buffered;
+    }
+
+    while (done < len) {
+        size_t pos = offset + done;
+        int first = (int)(pos / BLOCK_SIZE);
+        int count = (int)((pos + (len - done) - 1) / BLOCK_SIZE) - first + 1;
+        if (count > BLOCK_MAP_BATCH) {
+            count = BLOCK_MAP_BATCH;
+        }
+
+        if (inode_block_map(inode, first, count, blocks) == -1) {
+            return -1;
+        }
+
+        size_t block_offset = pos % BLOCK_SIZE;
+        for (int i = 0; i < count && done < len;) {
+            int run = 1;
+            char *data;
+            if (blocks[i] != -1) {
+                run = contiguous_run(blocks + i, count - i);
+                data = data_blocks_get(blocks[i], run);
+            } else {
+                if (map->rm_zeros == NULL) {
+                    map->rm_zeros = calloc(1, BLOCK_SIZE);
                 }
+                data = map->rm_zeros;
             }
-
-            void *block = data_block_get(inode->i_data_direct_blocks[current]);
-            if (block == NULL) {
-                rw_unlock(&inode->i_lock);
-                mutex_unlock(&file->of_lock);
+            if (data == NULL) {
                 return -1;
             }
 
-            if (read_from_block(initial_offset, &to_read_remaining, block,
-                                buffer, to_read - to_read_remaining) == -1) {
-                rw_unlock(&inode->i_lock);
-                mutex_unlock(&file->of_lock);
+            size_t n = (size_t)run * BLOCK_SIZE - block_offset;
+            if (n > len - done) {
+                n = len - done;
+            }
+            bool zeros = blocks[i] == -1;
+            if (read_map_add(map, data + block_offset, n,
+                             !zeros && !last_zeros) == -1) {
                 return -1;
             }
+            last_zeros = zeros;
 
-            initial_offset = 0;
-            current++;
+            done += n;
+            block_offset = 0;
+            i += run;
         }
+    }
 
-        // iterate throw direct block on indirect block
-        // Get indirect block data to access direct block
+    return (ssize_t)done;
+}
 
-        // Check if the inode has an indirect block allocated
-        if (inode->i_data_indirect_block == -1)
-            if ((inode->i_data_indirect_block = data_block_alloc()) == -1) {
-                rw_unlock(&inode->i_lock);
-                mutex_unlock(&file->of_lock);
-                return -1;
+ssize_t tfs_read_map(int fhandle, size_t len, tfs_read_map_t *map) {
+    if (map == NULL) {
+        return -1;
+    }
+    *map = (tfs_read_map_t){.rm_inumber = -1};
+
+    open_file_entry_t *file = get_open_file_entry(fhandle);
+    if (file == NULL) {
+        return -1;
+    }
+
+    /* From the open file table entry, we get the inode */
+    inode_t *inode = inode_get(file->of_inumber);
+    if (inode == NULL) {
+        mutex_unlock(&file->of_lock);
+        return -1;
+    }
+
+    /* Buffered data has no blocks to map until it is flushed */
+    inode_range_t range;
+    inode_range_lock(file->of_inumber, file->of_offset, len, false, &range);
+    ssize_t mapped = -1;
+    if (read_lock_flushed(inode) != -1) {
+        mapped = inode_read_map(inode, file->of_offset, len, map);
+        if (mapped > 0) {
+            /* Pinned before the lock is dropped, so no truncate gets
+             * between */
+            inode_pin(file->of_inumber);
+            map->rm_inumber = file->of_inumber;
+        }
+        rw_unlock(&inode->i_lock);
+    }
+    inode_range_unlock(file->of_inumber, &range);
+
+    if (mapped == -1) {
+        tfs_read_unmap(map);
+    } else {
+        file->of_offset += (size_t)mapped;
+    }
+    mutex_unlock(&file->of_lock);
+
+    return mapped;
+}
+
+int tfs_read_unmap(tfs_read_map_t *map) {
+    if (map == NULL) {
+        return -1;
+    }
+
+    if (map->rm_inumber != -1) {
+        inode_unpin(map->rm_inumber);
+    }
+    free(map->rm_iov);
+    free(map->rm_zeros);
+    *map = (tfs_read_map_t){.rm_inumber = -1};
+
+    return 0;
+}
+
+ssize_t tfs_pwrite(int fhandle, void const *buffer, size_t len,
+                   size_t offset) {
+    int inumber = open_file_inumber(fhandle);
+    inode_t *inode = inode_get(inumber);
+    if (inode == NULL || len > SSIZE_MAX || offset > SIZE_MAX - len) {
+        return -1;
+    }
+    if (len == 0) {
+        return 0;
+    }
+
+    struct iovec iov = {.iov_base = (void *)buffer, .iov_len = len};
+    iov_cursor_t src = {.ic_iov = &iov, .ic_offset = 0};
+
+    size_t written = file_write(inumber, inode, offset, &src, len);
+
+    /* Not a single block could be allocated */
+    return written == 0 ? -1 : (ssize_t)written;
+}
+
+ssize_t tfs_pread(int fhandle, void *buffer, size_t len, size_t offset) {
+    int inumber = open_file_inumber(fhandle);
+    inode_t *inode = inode_get(inumber);
+    if (inode == NULL || len > SSIZE_MAX) {
+        return -1;
+    }
+
+    struct iovec iov = {.iov_base = buffer, .iov_len = len};
+    iov_cursor_t dst = {.ic_iov = &iov, .ic_offset = 0};
+
+    inode_range_t range;
+    inode_range_lock(inumber, offset, len, false, &range);
+    read_lock(&inode->i_lock);
+    size_t read = inode_read(inode, offset, &dst, len);
+    rw_unlock(&inode->i_lock);
+    inode_range_unlock(inumber, &range);
+
+    return (ssize_t)read;
+}
+
+/*
+    Writes every buffer of the array to a file descriptor, going on after
+    partial writes
+    Returns 0 if successful, -1 otherwise
+*/
+static int write_all(int fd, struct iovec *iov, int iovcnt) {
+    while (iovcnt > 0) {
+        ssize_t written = writev(fd, iov, iovcnt);
+        if (written == -1) {
+            if (errno == EINTR) {
+                continue;
             }
+            return -1;
+        }
 
-        int *indirect_block =
-            (int *)data_block_get(inode->i_data_indirect_block);
-        if (indirect_block == NULL) {
-            rw_unlock(&inode->i_lock);
-            mutex_unlock(&file->of_lock);
+        /* Skip what was written */
+        size_t left = (size_t)written;
+        while (iovcnt > 0 && left >= iov->iov_len) {
+            left -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char *)iov->iov_base + left;
+            iov->iov_len -= left;
+        }
+    }
+
+    return 0;
+}
+
+/*
+    Streams the contents of an inode to a file descriptor straight from the
+    data blocks, with no intermediate copy: runs of contiguous blocks are
+    gathered into an array of up to EXPORT_IOV_BATCH buffers that is handed
+    to writev whenever it fills up. Blocks never written are skipped over
+    (leaving a hole in the destination). The caller must hold the inode's
+    lock.
+    Returns 0 if successful, -1 otherwise
+*/
+static int inode_export(inode_t *inode, int fd) {
+    struct iovec iov[EXPORT_IOV_BATCH];
+    int iovcnt = 0;
+    int blocks[BLOCK_MAP_BATCH];
+    size_t size = inode->i_size;
+    int file_blocks = (int)((size + BLOCK_SIZE - 1) / BLOCK_SIZE);
+
+    for (int first = 0; first < file_blocks; first += BLOCK_MAP_BATCH) {
+        int count = file_blocks - first < BLOCK_MAP_BATCH ? file_blocks - first
+                                                          : BLOCK_MAP_BATCH;
+        if (inode_block_map(inode, first, count, blocks) == -1) {
             return -1;
         }
 
-        while (current < end) {
-            int indirection_block_index = *(((int *)indirect_block));
+        for (int i = 0; i < count;) {
+            size_t pos = (size_t)(first + i) * BLOCK_SIZE;
 
-            void *block = data_block_get(indirection_block_index);
-            if (block == NULL) {
-                rw_unlock(&inode->i_lock);
-                mutex_unlock(&file->of_lock);
-                return -1;
+            if (blocks[i] == -1) {
+                /* Flush what is gathered, then step over the hole */
+                if (write_all(fd, iov, iovcnt) == -1 ||
+                    lseek(fd, (off_t)BLOCK_SIZE, SEEK_CUR) == -1) {
+                    return -1;
+                }
+                iovcnt = 0;
+                i++;
+                continue;
             }
 
-            if (read_from_block(initial_offset, &to_read_remaining, block,
-                                buffer, to_read - to_read_remaining) == -1) {
-                rw_unlock(&inode->i_lock);
-                mutex_unlock(&file->of_lock);
-                return -1; // Hol up, wait a minute, something aint right.
+            int run = contiguous_run(blocks + i, count - i);
+            char *data = data_blocks_get(blocks[i], run);
+            if (data == NULL) {
+                return -1;
+            }
+            size_t len = (size_t)run * BLOCK_SIZE;
+            if (len > size - pos) {
+                len = size - pos;
+            }
+            i += run;
+
+            /* Runs that follow each other in fs_data share a buffer */
+            if (iovcnt > 0 &&
+                (char *)iov[iovcnt - 1].iov_base + iov[iovcnt - 1].iov_len ==
+                    data) {
+                iov[iovcnt - 1].iov_len += len;
+                continue;
             }
 
-            indirect_block += sizeof(int);
-
-            initial_offset = 0;
-            current++;
+            if (iovcnt == EXPORT_IOV_BATCH) {
+                if (write_all(fd, iov, iovcnt) == -1) {
+                    return -1;
+                }
+                iovcnt = 0;
+            }
+            iov[iovcnt].iov_base = data;
+            iov[iovcnt].iov_len = len;
+            iovcnt++;
         }
     }
 
-    mutex_unlock(&file->of_lock);
-    rw_unlock(&inode->i_lock);
+    if (write_all(fd, iov, iovcnt) == -1) {
+        return -1;
+    }
 
-    return (ssize_t)to_read;
+    /* A hole at the end must still count towards the size */
+    return ftruncate(fd, (off_t)size);
 }
 
 int tfs_copy_to_external_fs(char const *source_path, char const *dest_path) {
-    // Check if source file exists
-    int inumber;
-    int fhandle;
-
     // Open the file for reading
-    if ((fhandle = tfs_open(source_path, TFS_O_START)) == -1)
+    int fhandle = tfs_open(source_path, TFS_O_START);
+    if (fhandle == -1)
         return -1;
 
-    if ((inumber = tfs_lookup(source_path)) == -1)
-        return abort_operation(fhandle);
-
     /* From the open file table entry, we get the inode */
+    int inumber = open_file_inumber(fhandle);
     inode_t *inode = inode_get(inumber);
     if (inode == NULL) {
         return abort_operation(fhandle);
     }
 
-    FILE *dest_file = fopen(dest_path, "w");
-    if (dest_file == NULL)
+    int dest_fd = open(dest_path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (dest_fd == -1)
         return abort_operation(fhandle);
 
-    // Write in dest_file
-    char *buffer;
-    buffer = malloc(inode->i_size);
-    if (buffer == NULL) {
-        fclose(dest_file);
-        return abort_operation(fhandle);
+    /* Exported straight from the blocks, so buffered data is flushed first;
+     * writers wait for the export, which sees every write as a whole */
+    inode_range_t range;
+    inode_range_lock(inumber, 0, SIZE_MAX, false, &range);
+    int r = -1;
+    if (read_lock_flushed(inode) != -1) {
+        r = inode_export(inode, dest_fd);
+        rw_unlock(&inode->i_lock);
     }
+    inode_range_unlock(inumber, &range);
 
-    ssize_t r;
+    if (close(dest_fd) == -1) {
+        r = -1;
+    }
+    tfs_close(fhandle);
 
-    r = tfs_read(fhandle, buffer, inode->i_size);
-    if (r == -1) {
-        fclose(dest_file);
-        return abort_operation(fhandle);
+    return r;
+}
+
+/*
+    Fills an empty inode with the contents of a memory area. Every block the
+    contents need is allocated first, in a single pass (so they are laid out
+    in as few extents as possible), and the contents are then copied straight
+    into them. The caller must hold the inode's write lock.
+    Returns 0 if successful, -1 if the FS has no room for the contents (the
+    inode is then left empty)
+*/
+static int inode_import(inode_t *inode, void *contents, size_t size) {
+    if (size == 0) {
+        return 0;
     }
 
-    if (fputs(buffer, dest_file) == -1) {
-        free(buffer);
-        fclose(dest_file);
-        return abort_operation(fhandle);
+    size_t file_blocks = (size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    if (file_blocks > (size_t)MAX_FILE_BLOCKS ||
+        inode_block_alloc(inode, 0, (int)file_blocks, NULL) !=
+            (int)file_blocks) {
+        inode_truncate(inode);
+        return -1;
     }
 
-    free(buffer);
-    fclose(dest_file);
-    tfs_close(fhandle);
+    struct iovec iov = {.iov_base = contents, .iov_len = size};
+    iov_cursor_t src = {.ic_iov = &iov, .ic_offset = 0};
+    if (inode_extend(inode, 0, size) != size ||
+        inode_overwrite(inode, 0, &src, size) != size) {
+        inode_truncate(inode);
+        return -1;
+    }
 
     return 0;
-}
\ No newline at end of file
+}
+
+int tfs_copy_from_external_fs(char const *source_path,
+                              char const *dest_path) {
+    struct stat st;
+    void *contents = NULL;
+
+    int source_fd = open(source_path, O_RDONLY);
+    if (source_fd == -1) {
+        return -1;
+    }
+    if (fstat(source_fd, &st) == -1 || !S_ISREG(st.st_mode)) {
+        close(source_fd);
+        return -1;
+    }
+
+    size_t size = (size_t)st.st_size;
+    if (size > 0) {
+        contents = mmap(NULL, size, PROT_READ, MAP_PRIVATE, source_fd, 0);
+    }
+    /* The mapping stays valid after the file is closed */
+    close(source_fd);
+    if (contents == MAP_FAILED) {
+        return -1;
+    }
+    if (contents != NULL) {
+        posix_madvise(contents, size, POSIX_MADV_SEQUENTIAL);
+    }
+
+    int r = -1;
+    int fhandle = tfs_open(dest_path, TFS_O_CREAT);
+    inode_t *inode = inode_get(open_file_inumber(fhandle));
+    if (inode != NULL) {
+        /* Truncated under the same lock as the copy, so that the file never
+         * mixes old and new contents */
+        write_lock(&inode->i_lock);
+        if (inode_truncate(inode) != -1) {
+            r = inode_import(inode, contents, size);
+        }
+        rw_unlock(&inode->i_lock);
+    }
+
+    if (fhandle != -1) {
+        tfs_close(fhandle);
+    }
+    if (contents != NULL) {
+        munmap(contents, size);
+    }
+
+    return r;
+}
+
+void tfs_latency_stats(tfs_latency_stats_t *stats) { latency_stats(stats); }
+
+void tfs_block_cache_stats(tfs_block_cache_stats_t *stats) {
+    bcache_stats(stats);
+}
@@ -1,9 +1,11 @@
 #ifndef OPERATIONS_H
 #define OPERATIONS_H
 
+#include "bcache.h"
 #include "config.h"
 #include "state.h"
 #include <sys/types.h>
+#include <sys/uio.h>
 
 enum {
     TFS_O_START = 0b000,
@@ -12,14 +14,32 @@ enum {
     TFS_O_APPEND = 0b100,
 };
 
+/*
+ * Attributes of a file or directory (see tfs_stat)
+ */
+typedef struct {
+    int st_inumber;
+    inode_type st_type;
+    size_t st_size;
+} tfs_stat_t;
+
 /*
  * Initializes tecnicofs
+ * Input:
+ *  - params: geometry of the FS (block size, number of data blocks, i-nodes,
+ *    open files and block cache frames); NULL, or any field left at 0,
+ *    selects the defaults from config.h. If params->image_path is set, the
+ *    FS lives in that volume image file: a missing or empty file is
+ *    formatted, and an existing image is mounted with its contents and its
+ *    own geometry (fields set in params must then match it).
+ *    params->latency picks how accesses to the FS state are delayed (see
+ *    latency.h): spinning by default, with the costs in config.h
  * Returns 0 if successful, -1 otherwise.
  */
-int tfs_init();
+int tfs_init(tfs_params_t const *params);
 
 /*
- * Destroy tecnicofs
+ * Destroy tecnicofs (a volume image is written back to its file)
  * Returns 0 if successful, -1 otherwise.
  */
 int tfs_destroy();
@@ -31,14 +51,40 @@ int tfs_destroy();
 int tfs_destroy_after_all_closed();
 
 /*
- * Looks for a file
- * Note: as a simplification, only a plain directory space (root directory only)
- * is supported Input:
- *  - name: absolute path name
+ * Looks for a file or directory
+ * Input:
+ *  - name: absolute path name (e.g. "/dir/subdir/file")
  * Returns the inumber of the file, -1 if unsuccessful
  */
 int tfs_lookup(char const *name);
 
+/*
+ * Looks for a file or directory and reads its attributes, from a snapshot
+ * of its i-node taken without locking it, so that frequent checks do not
+ * contend with each other or with the file's readers
+ * Input:
+ *  - name: absolute path name
+ *  - st: filled in with the inumber, the type and the size
+ * Returns 0 if successful, -1 otherwise
+ */
+int tfs_stat(char const *name, tfs_stat_t *st);
+
+/*
+ * Creates a directory
+ * Input:
+ *  - name: absolute path name of the new directory, whose parent must exist
+ * Returns 0 if successful, -1 otherwise (also if the name is taken)
+ */
+int tfs_mkdir(char const *name);
+
+/*
+ * Removes a file or an empty directory
+ * Input:
+ *  - name: absolute path name
+ * Returns 0 if successful, -1 otherwise (also if the file is open)
+ */
+int tfs_unlink(char const *name);
+
 /*
  * Opens a file
  * Input:
@@ -46,14 +92,18 @@ int tfs_lookup(char const *name);
  *  - flags: can be a combination (with bitwise or) of the following flags:
  *    - append mode (TFS_O_APPEND)
  *    - truncate file contents (TFS_O_TRUNC)
- *    - create file if it does not exist (TFS_O_CREAT)
+ *    - create file if it does not exist (TFS_O_CREAT), in which case its
+ *      parent directory must exist
+ * Directories can not be opened.
  */
 int tfs_open(char const *name, int flags);
 
-/* Closes a file
+/* Closes a file. Closing the last handle to a file allocates blocks for the
+ * data appended to it that was still buffered (see tfs_write).
  * Input:
  * 	- file handle (obtained from a previous call to tfs_open)
- * Returns 0 if successful, -1 otherwise.
+ * Returns 0 if successful, -1 otherwise (the handle is closed anyway if
+ * the FS ran out of blocks for the buffered data, which is then lost)
  */
 int tfs_close(int fhandle);
 
@@ -64,6 +114,9 @@ int tfs_close(int fhandle);
  * 	- length of the contents (in bytes)
  * 	Returns the number of bytes that were written (can be lower than
  * 	'len' if the maximum file size is exceeded), or -1 in case of error
+ * Data appended past the last block of the file is buffered, with blocks
+ * reserved for it, and only gets them, all at once, when the file is last
+ * closed or the buffer fills up (delayed allocation).
  */
 ssize_t tfs_write(int fhandle, void const *buffer, size_t len);
 
@@ -75,9 +128,102 @@ ssize_t tfs_write(int fhandle, void const *buffer, size_t len);
  * 	Returns the number of bytes that were copied from the file to the buffer
  * 	(can be lower than 'len' if the file size was reached), or -1 in case of
  * error
+ * Reads through a handle that start where the previous one ended have the
+ * blocks after them read ahead in the background.
  */
 ssize_t tfs_read(int fhandle, void *buffer, size_t len);
 
+/* Writes the contents of several buffers, one after the other, to an open
+ * file, starting at the current offset. The file is locked and its block map
+ * walked once for the whole write.
+ * Input:
+ * 	- file handle (obtained from a previous call to tfs_open)
+ * 	- array of buffers (as for writev)
+ * 	- number of buffers in the array
+ * 	Returns the number of bytes that were written (can be lower than the
+ * 	total length if the maximum file size is exceeded), or -1 in case of
+ * 	error
+ */
+ssize_t tfs_writev(int fhandle, struct iovec const *iov, int iovcnt);
+
+/* Reads from an open file, starting at the current offset, into several
+ * buffers, filling each one before the next. The file is locked and its
+ * block map walked once for the whole read.
+ * Input:
+ * 	- file handle (obtained from a previous call to tfs_open)
+ * 	- array of buffers (as for readv)
+ * 	- number of buffers in the array
+ * 	Returns the number of bytes that were copied from the file to the
+ * 	buffers (can be lower than the total length if the file size was
+ * 	reached), or -1 in case of error
+ */
+ssize_t tfs_readv(int fhandle, struct iovec const *iov, int iovcnt);
+
+/* Writes to an open file at the given offset, leaving the offset of the file
+ * handle as it is. Writing past the end of the file leaves a gap that reads
+ * as zeros. Writes to disjoint block ranges of a file that do not grow it
+ * run in parallel. The handle must stay open for the whole call.
+ * Input:
+ * 	- file handle (obtained from a previous call to tfs_open)
+ * 	- buffer containing the contents to write
+ * 	- length of the contents (in bytes)
+ * 	- offset in the file to write at
+ * 	Returns the number of bytes that were written (can be lower than
+ * 	'len' if the maximum file size is exceeded), or -1 in case of error
+ */
+ssize_t tfs_pwrite(int fhandle, void const *buffer, size_t len,
+                   size_t offset);
+
+/* Reads from an open file at the given offset, leaving the offset of the
+ * file handle as it is. Positional reads on the same handle do not wait for
+ * each other, nor for writes to other block ranges of the file. The handle
+ * must stay open for the whole call.
+ * Input:
+ * 	- file handle (obtained from a previous call to tfs_open)
+ * 	- destination buffer
+ * 	- length of the buffer
+ * 	- offset in the file to read from
+ * 	Returns the number of bytes that were copied from the file to the buffer
+ * 	(can be lower than 'len' if the file size was reached), or -1 in case of
+ * error
+ */
+ssize_t tfs_pread(int fhandle, void *buffer, size_t len, size_t offset);
+
+/*
+ * Read mapping: the contents of a part of a file, as ranges of memory that
+ * point straight into the FS data blocks (see tfs_read_map). Only rm_iov and
+ * rm_iovcnt are meant to be used by the caller.
+ */
+typedef struct {
+    struct iovec *rm_iov; /* ranges, in file order */
+    int rm_iovcnt;        /* number of ranges */
+    int rm_capacity;
+    int rm_inumber; /* i-node whose blocks are pinned, -1 if none */
+    char *rm_zeros; /* block of zeros standing in for blocks never written */
+} tfs_read_map_t;
+
+/* Maps the contents of an open file, starting at the current offset, without
+ * copying them: the mapping lists where the bytes lie in the FS data blocks,
+ * and the offset moves past them as with tfs_read. Until the mapping is
+ * released with tfs_read_unmap, the file can not be truncated or deleted (so
+ * the ranges stay valid), although writes to the file show through them.
+ * Input:
+ * 	- file handle (obtained from a previous call to tfs_open)
+ * 	- number of bytes to map
+ * 	- mapping to fill in (which must be released with tfs_read_unmap,
+ * 	  whatever the result)
+ * 	Returns the number of bytes mapped (can be lower than 'len' if the file
+ * 	size was reached), or -1 in case of error
+ */
+ssize_t tfs_read_map(int fhandle, size_t len, tfs_read_map_t *map);
+
+/* Releases a mapping made by tfs_read_map
+ * Input:
+ * 	- the mapping
+ * 	Returns 0 if successful, -1 otherwise
+ */
+int tfs_read_unmap(tfs_read_map_t *map);
+
 /* Copies the contents of a file that exists in TecnicoFS to the contents
  * of another file in the OS' file system tree (outside TecnicoFS).
  * Devolve 0 em caso de sucesso, -1 em caso de erro.
@@ -89,4 +235,35 @@ ssize_t tfs_read(int fhandle, void *buffer, size_t len);
  */
 int tfs_copy_to_external_fs(char const *source_path, char const *dest_path);
 
+/* Copies the contents of a file in the OS' file system tree (outside
+ * TecnicoFS) into a file in TecnicoFS. The source file is mapped into memory
+ * and copied straight into the destination's blocks, all of which are
+ * allocated up front.
+ * Input:
+ *      - path name of the source file (in the main file system)
+ *      - path name of the destination file (in TecnicoFS), which is created
+ *        if needed, and overwritten if it already exists (it is left empty
+ *        if TecnicoFS has no room for the contents)
+ *      Returns 0 if successful, -1 otherwise.
+ */
+int tfs_copy_from_external_fs(char const *source_path,
+                              char const *dest_path);
+
+/*
+ * Reads how many times the FS state was accessed since tfs_init
+ * Input:
+ *  - stats: filled in with the number of i-node, bitmap and data block
+ *    accesses
+ */
+void tfs_latency_stats(tfs_latency_stats_t *stats);
+
+/*
+ * Reads the block cache counters
+ * Input:
+ *  - stats: filled in with the data blocks accessed since tfs_init that hit
+ *    and missed the cache, the blocks it evicted, and the blocks readahead
+ *    prefetched and how many of those were read (its hit rate)
+ */
+void tfs_block_cache_stats(tfs_block_cache_stats_t *stats);
+
 #endif // OPERATIONS_H
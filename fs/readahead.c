@@ -0,0 +1,120 @@
+#include "readahead.h"
+#include "bcache.h"
+#include "state.h"
+
+#include <stdbool.h>
+
+typedef struct {
+    int rr_first;
+    int rr_count;
+} readahead_run_t;
+
+static readahead_run_t queue[READAHEAD_QUEUE_DEPTH];
+static size_t queue_head;
+static size_t queue_length;
+static bool stopping;
+static pthread_mutex_t queue_lock;
+static pthread_cond_t queue_cond;
+
+static pthread_t workers[READAHEAD_WORKERS];
+
+static void *readahead_worker(void *arg) {
+    (void)arg;
+
+    mutex_lock(&queue_lock);
+    for (;;) {
+        while (queue_length == 0 && !stopping) {
+            pthread_cond_wait(&queue_cond, &queue_lock);
+        }
+        if (stopping) {
+            break;
+        }
+
+        readahead_run_t run = queue[queue_head];
+        queue_head = (queue_head + 1) % READAHEAD_QUEUE_DEPTH;
+        queue_length--;
+
+        mutex_unlock(&queue_lock);
+        bcache_prefetch(run.rr_first, run.rr_count);
+        mutex_lock(&queue_lock);
+    }
+    mutex_unlock(&queue_lock);
+
+    return NULL;
+}
+
+/*
+ * Starts the readahead workers
+ * Returns: 0 if successful, -1 otherwise
+ */
+int readahead_init() {
+    queue_head = 0;
+    queue_length = 0;
+    stopping = false;
+    init_mlock(&queue_lock);
+    pthread_cond_init(&queue_cond, NULL);
+
+    for (size_t i = 0; i < READAHEAD_WORKERS; i++) {
+        if (pthread_create(&workers[i], NULL, readahead_worker, NULL) != 0) {
+            mutex_lock(&queue_lock);
+            stopping = true;
+            pthread_cond_broadcast(&queue_cond);
+            mutex_unlock(&queue_lock);
+            while (i > 0) {
+                pthread_join(workers[--i], NULL);
+            }
+            destroy_mlock(&queue_lock);
+            pthread_cond_destroy(&queue_cond);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Stops the readahead workers, dropping the requests still queued
+ */
+void readahead_destroy() {
+    mutex_lock(&queue_lock);
+    stopping = true;
+    pthread_cond_broadcast(&queue_cond);
+    mutex_unlock(&queue_lock);
+
+    for (size_t i = 0; i < READAHEAD_WORKERS; i++) {
+        pthread_join(workers[i], NULL);
+    }
+
+    destroy_mlock(&queue_lock);
+    pthread_cond_destroy(&queue_cond);
+}
+
+/*
+ * Queues the data blocks of a file range to be read ahead, as runs of
+ * consecutive blocks
+ * Input:
+ *  - blocks: the block numbers, -1 for holes
+ *  - count: number of blocks
+ */
+void readahead_request(int const *blocks, int count) {
+    mutex_lock(&queue_lock);
+    for (int i = 0; i < count;) {
+        if (blocks[i] == -1) {
+            i++;
+            continue;
+        }
+
+        int run = 1;
+        while (i + run < count && blocks[i + run] == blocks[i] + run) {
+            run++;
+        }
+        if (queue_length < READAHEAD_QUEUE_DEPTH) {
+            queue[(queue_head + queue_length) % READAHEAD_QUEUE_DEPTH] =
+                (readahead_run_t){.rr_first = blocks[i], .rr_count = run};
+            queue_length++;
+            pthread_cond_signal(&queue_cond);
+        }
+        i += run;
+    }
+    mutex_unlock(&queue_lock);
+}
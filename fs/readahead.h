@@ -0,0 +1,20 @@
+#ifndef READAHEAD_H
+#define READAHEAD_H
+
+/*
+ * Readahead: runs of data blocks queued by sequential readers (see
+ * tfs_readv) are made resident in the block cache by background workers,
+ * so that the reader finds them there when it gets to them.
+ *
+ * Requests carry block numbers rather than file offsets, so the workers
+ * never touch i-nodes. A request for blocks that were freed meanwhile only
+ * warms the cache in vain. When the queue is full, new requests are dropped
+ * rather than making the reader wait.
+ */
+
+int readahead_init();
+void readahead_destroy();
+
+void readahead_request(int const *blocks, int count);
+
+#endif // READAHEAD_H
@@ -1,31 +1,238 @@
 #include "state.h"
-
+#include "bcache.h"
+#include "dcache.h"
+#include "epoch.h"
+#include "readahead.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 /* Persistent FS state  (in reality, it should be maintained in secondary
- * memory; for simplicity, this project maintains it in primary memory) */
+ * memory; for simplicity, this project maintains it in primary memory,
+ * optionally backed by a volume image file) */
+
+/* Geometry of the running FS */
+tfs_params_t fs_params;
+int fs_max_file_blocks;
+
+/*
+ * Volume: all the persistent state lives in one region, laid out as
+ *   superblock | free block bitmap | freeinode_ts | freeinode_next |
+ *   i-node table | data blocks
+ * with every part starting on a VOLUME_ALIGN boundary. The region is either
+ * allocated in memory or mapped (shared) from a volume image file, so that a
+ * later tfs_init on the same image finds the FS exactly as it was left.
+ * Images hold i-nodes as laid out by this build; VOLUME_VERSION must change
+ * whenever the layout of inode_t or of the volume does.
+ */
+#define VOLUME_MAGIC UINT64_C(0x314c4f565f534654) // "TFS_VOL1"
+#define VOLUME_VERSION (4)
+#define VOLUME_ALIGN ((size_t)4096)
+
+typedef struct {
+    uint64_t sb_magic;
+    uint64_t sb_version;
+    uint64_t sb_block_size;
+    uint64_t sb_data_blocks;
+    uint64_t sb_inode_table_size;
+    uint64_t sb_inode_size; /* sizeof(inode_t) of the build that made it */
+    uint64_t sb_volume_size;
+    uint64_t sb_clean; /* 1 if left by state_destroy, 0 while mounted */
+    _Atomic uint64_t sb_freeinode_head; /* see freeinode_head */
+} superblock_t;
+
+/* Offset of each part of the volume, and its total size */
+typedef struct {
+    size_t vl_bitmap;
+    size_t vl_inode_ts;
+    size_t vl_inode_next;
+    size_t vl_inode_table;
+    size_t vl_data;
+    size_t vl_size;
+} volume_layout_t;
+
+static char *volume;
+static volume_layout_t volume_layout;
+static bool volume_mapped; /* mapped from an image, rather than allocated */
+static superblock_t *superblock;
 
 /* I-node table */
-static inode_t inode_table[INODE_TABLE_SIZE];
-static char freeinode_ts[INODE_TABLE_SIZE];
+static inode_t *inode_table;
+static atomic_char *freeinode_ts;
+
+/*
+ * Free i-node stack: a lock-free (Treiber) stack of the free inumbers, linked
+ * through freeinode_next. The head packs the inumber on top (low 32 bits, -1
+ * when empty) with a counter bumped on every pop (high 32 bits), so that a
+ * pop can not be fooled by an entry popped and pushed back meanwhile (ABA).
+ * The head is kept in the superblock, so the stack survives a remount.
+ */
+static atomic_int *freeinode_next;
+static _Atomic uint64_t *freeinode_head;
+
+#define FREEINODE_TOP(head) ((int)(uint32_t)(head))
+#define FREEINODE_TAG(head) ((head) & ~(uint64_t)UINT32_MAX)
 
 /* Data blocks */
-static char fs_data[BLOCK_SIZE * DATA_BLOCKS];
-static char free_blocks[DATA_BLOCKS];
+static char *fs_data;
+
+/* Free block bitmap: one bit per data block, set while the block is FREE, so
+ * that a free block can be found in a whole word at once with
+ * count-trailing-zeros */
+#define BITMAP_WORD_BITS (64)
+#define BITMAP_WORDS ((DATA_BLOCKS + BITMAP_WORD_BITS - 1) / BITMAP_WORD_BITS)
+#define BITMAP_WORDS_PER_BLOCK (BLOCK_SIZE / sizeof(uint64_t))
+static uint64_t *free_blocks;
+
+/* Every word below the hint is known to be full (no free blocks) */
+static size_t free_blocks_hint;
+
+/*
+ * Free block pool: a small cache of block numbers taken from the bitmap in
+ * bulk, so that most allocations and frees only touch the pool of the calling
+ * thread instead of going through free_blocks_lock. Blocks held by a pool are
+ * still marked as taken in the bitmap, and go back to it in state_destroy; an
+ * image left by a process that stopped without it has its bitmap rebuilt when
+ * mounted (see volume_recover).
+ */
+#define BLOCK_POOL_CAPACITY (2 * BLOCK_POOL_BATCH)
+
+typedef struct {
+    _Alignas(64) pthread_mutex_t bp_lock;
+    int bp_count;
+    int bp_blocks[BLOCK_POOL_CAPACITY];
+} block_pool_t;
+
+static block_pool_t block_pools[BLOCK_POOL_SHARDS];
+
+/* Pool used by each thread, assigned round-robin on its first allocation */
+static _Thread_local int block_pool_shard = -1;
+static atomic_uint block_pool_next_shard;
 
-/* file_entries Lock */
-static pthread_mutex_t free_open_file_entries_lock = PTHREAD_MUTEX_INITIALIZER;
-static pthread_mutex_t freeinode_ts_lock = PTHREAD_MUTEX_INITIALIZER;
 static pthread_mutex_t free_blocks_lock = PTHREAD_MUTEX_INITIALIZER;
 
 /* Volatile FS state */
 
-static open_file_entry_t open_file_table[MAX_OPEN_FILES];
-static char free_open_file_entries[MAX_OPEN_FILES];
+/*
+ * Open file table: handles are split in chunks of OPEN_FILE_CHUNK entries,
+ * each allocated the first time one of its entries is needed, so that the
+ * table takes memory for the handles in use rather than for MAX_OPEN_FILES.
+ * Chunks are only freed along with the FS, so finding a handle's entry takes
+ * no lock.
+ * Each chunk has a bitmap of its entries with a bit set while the entry is
+ * FREE, so that an entry is claimed with a single compare-and-swap.
+ */
+#define OPEN_FILE_CHUNK_WORDS (OPEN_FILE_CHUNK / BITMAP_WORD_BITS)
+#define OPEN_FILE_CHUNKS                                                       \
+    ((MAX_OPEN_FILES + OPEN_FILE_CHUNK - 1) / OPEN_FILE_CHUNK)
+
+typedef struct {
+    _Atomic uint64_t fc_free[OPEN_FILE_CHUNK_WORDS];
+    open_file_entry_t fc_entries[OPEN_FILE_CHUNK];
+} open_file_chunk_t;
+
+static open_file_chunk_t *_Atomic *open_file_chunks;
+
+/* Every chunk below the hint is known to be full (no free entries) */
+static atomic_size_t open_file_hint;
+
+static void open_file_chunk_free(open_file_chunk_t *chunk) {
+    if (chunk == NULL) {
+        return;
+    }
+    for (size_t i = 0; i < OPEN_FILE_CHUNK; i++) {
+        destroy_mlock(&chunk->fc_entries[i].of_lock);
+    }
+    free(chunk);
+}
+
+/* Number of open file table entries referring to each i-node, or
+ * OPEN_COUNT_DELETING while the i-node is being deleted */
+static atomic_int *inode_open_count;
+#define OPEN_COUNT_DELETING (INT_MIN)
+
+/* Number of read mappings (see tfs_read_map) holding each i-node's blocks */
+static atomic_int *inode_pin_count;
+
+/* Whether each directory has a name in its parent (the root always does):
+ * entries are only added to directories that have one, so that an add that
+ * looked up a directory which was deleted meanwhile never puts an entry in a
+ * new, not yet linked directory that got the same inumber */
+static atomic_bool *dir_linked;
+
+/*
+ * Directory index: an in-memory hash table from entry name to inumber, kept
+ * for each directory i-node so that lookups do not scan the directory's
+ * entries. It is built from the entries the first time the directory is
+ * used and kept up to date by add_dir_entry and clear_dir_entry, which also
+ * take its lock to serialize changes to the directory.
+ * Lookups take no lock (see epoch.h): entries are published whole, with a
+ * release store of the link to them, and entries that are unlinked, tables
+ * that are replaced by a larger copy and tables of deleted directories are
+ * retired rather than freed. Threads that get no read section take the
+ * index's lock for reading instead, which is safe as indexes themselves are
+ * only freed along with the FS.
+ */
+typedef struct dir_index_entry {
+    _Atomic(struct dir_index_entry *) de_next;
+    int de_inumber;
+    int de_slot; /* position of the entry in the directory's data */
+    char de_name[MAX_FILE_NAME];
+} dir_index_entry_t;
+
+typedef struct {
+    size_t dt_buckets; /* always a power of two */
+    _Atomic(dir_index_entry_t *) dt_heads[];
+} dir_table_t;
+
+typedef struct {
+    pthread_rwlock_t di_lock;
+    size_t di_count;
+    _Atomic(dir_table_t *) di_table;
+    int di_free_hint; /* every slot below the hint is in use */
+} dir_index_t;
+
+static _Atomic(dir_index_t *) *dir_indexes;
+static pthread_mutex_t dir_indexes_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Ranges of each i-node's blocks locked by readers and writers (see
+ * inode_range_lock) */
+typedef struct {
+    pthread_mutex_t rl_lock;
+    pthread_cond_t rl_released;
+    inode_range_t *rl_held;
+    atomic_int rl_writers; /* writers holding or waiting for a range */
+    atomic_int rl_readers; /* readers holding a range without rl_lock */
+    atomic_int rl_waiters; /* threads waiting for rl_released */
+} range_lock_t;
+
+static range_lock_t *range_locks;
+
+/* Delayed allocation buffer of each i-node, and the bytes they take up */
+static delalloc_t *delallocs;
+static atomic_size_t delalloc_bytes;
+
+/* Free data blocks, and how many of them are reserved by delayed allocation
+ * buffers (see data_block_reserve) */
+static atomic_int free_block_count;
+static atomic_int reserved_block_count;
+
+/* Reserved blocks the allocations of the calling thread may take, while it
+ * flushes a delayed allocation buffer (see inode_delalloc_flush) */
+static _Thread_local int reserved_credit;
+
+static void dir_index_destroy(dir_index_t *index);
+static void delalloc_discard(delalloc_t *da);
+static void dir_index_free(int inumber);
 
 static inline bool valid_inumber(int inumber) {
     return inumber >= 0 && inumber < INODE_TABLE_SIZE;
@@ -39,391 +246,2084 @@ static inline bool valid_file_handle(int file_handle) {
     return file_handle >= 0 && file_handle < MAX_OPEN_FILES;
 }
 
-/**
- * We need to defeat the optimizer for the insert_delay() function.
- * Under optimization, the empty loop would be completely optimized away.
- * This function tells the compiler that the assembly code being run (which is
- * none) might potentially change *all memory in the process*.
- *
- * This prevents the optimizer from optimizing this code away, because it does
- * not know what it does and it may have side effects.
- *
- * Reference with more information: https://youtu.be/nXaxk27zwlk?t=2775
- *
- * Exercise: try removing this function and look at the assembly generated to
- * compare.
+/*
+ * Fills in the fields of the given geometry left at 0 with their defaults
+ * and checks that the result makes sense
+ * Returns: 0 if successful, -1 otherwise
  */
-static void touch_all_memory() { __asm volatile("" : : : "memory"); }
+static int params_resolve(tfs_params_t *params) {
+    if (params->block_size == 0) {
+        params->block_size = DEFAULT_BLOCK_SIZE;
+    }
+    if (params->data_blocks == 0) {
+        params->data_blocks = DEFAULT_DATA_BLOCKS;
+    }
+    if (params->inode_table_size == 0) {
+        params->inode_table_size = DEFAULT_INODE_TABLE_SIZE;
+    }
+    if (params->max_open_files == 0) {
+        params->max_open_files = DEFAULT_MAX_OPEN_FILES;
+    }
+    if (params->block_cache_blocks == 0) {
+        params->block_cache_blocks = DEFAULT_BLOCK_CACHE_BLOCKS;
+    }
+
+    /* A block must hold at least one directory entry, and block numbers,
+     * inumbers and file handles are ints */
+    if (params->block_size < sizeof(dir_entry_t) ||
+        params->block_size % sizeof(uint64_t) != 0 ||
+        params->block_size > INT_MAX ||
+        params->data_blocks > INT_MAX ||
+        params->block_size > SIZE_MAX / params->data_blocks ||
+        params->inode_table_size > INT_MAX ||
+        params->max_open_files > INT_MAX) {
+        return -1;
+    }
+    if (params->block_cache_blocks > params->data_blocks) {
+        params->block_cache_blocks = params->data_blocks;
+    }
+
+    return 0;
+}
 
 /*
- * Auxiliary function to insert a delay.
- * Used in accesses to persistent FS state as a way of emulating access
- * latencies as if such data structures were really stored in secondary memory.
+ * Counts the blocks a file can have: the direct ones plus entries^l for each
+ * level l of indirection, capped at INT_MAX
  */
-static void insert_delay() {
-    for (int i = 0; i < DELAY; i++) {
-        touch_all_memory();
+static int max_file_blocks(tfs_params_t const *params) {
+    int64_t entries = (int64_t)(params->block_size / sizeof(int));
+    int64_t blocks = INODE_DIRECT_BLOCKS;
+    int64_t level_blocks = 1;
+
+    for (int l = 0; l < INODE_INDIRECT_LEVELS && blocks < INT_MAX; l++) {
+        level_blocks *= entries;
+        blocks += level_blocks;
     }
+
+    return blocks < INT_MAX ? (int)blocks : INT_MAX;
+}
+
+static size_t volume_align(size_t offset) {
+    return (offset + VOLUME_ALIGN - 1) & ~(VOLUME_ALIGN - 1);
 }
 
 /*
- * Initializes FS state
+ * Computes where each part of the volume goes for the given geometry
+ * Returns: 0 if successful, -1 if the volume would not fit in a size_t
  */
-void state_init() {
-    for (size_t i = 0; i < INODE_TABLE_SIZE; i++) {
-        freeinode_ts[i] = FREE;
+static int volume_layout_compute(tfs_params_t const *params,
+                                 volume_layout_t *layout) {
+    size_t bitmap_words =
+        (params->data_blocks + BITMAP_WORD_BITS - 1) / BITMAP_WORD_BITS;
+    size_t data_size = params->block_size * params->data_blocks;
+
+    layout->vl_bitmap = volume_align(sizeof(superblock_t));
+    layout->vl_inode_ts =
+        volume_align(layout->vl_bitmap + bitmap_words * sizeof(uint64_t));
+    layout->vl_inode_next = volume_align(
+        layout->vl_inode_ts + params->inode_table_size * sizeof(atomic_char));
+    layout->vl_inode_table = volume_align(
+        layout->vl_inode_next + params->inode_table_size * sizeof(atomic_int));
+    layout->vl_data = volume_align(layout->vl_inode_table +
+                                   params->inode_table_size * sizeof(inode_t));
+    if (layout->vl_data > SIZE_MAX - data_size) {
+        return -1;
     }
+    layout->vl_size = layout->vl_data + data_size;
 
-    for (size_t i = 0; i < DATA_BLOCKS; i++) {
-        free_blocks[i] = FREE;
-    }
+    return 0;
+}
 
-    for (size_t i = 0; i < MAX_OPEN_FILES; i++) {
-        free_open_file_entries[i] = FREE;
-        init_mlock(&open_file_table[i].of_lock);
+/*
+ * Takes a geometry field from the superblock of an existing image
+ * Returns: 0 if successful, -1 if the field was set to something else
+ */
+static int params_from_image(size_t *field, uint64_t value) {
+    if (*field != 0 && *field != value) {
+        return -1;
     }
+    *field = (size_t)value;
+    return 0;
 }
 
-void state_destroy() { /* nothing to do */
-    for (size_t i = 0; i < MAX_OPEN_FILES; i++) {
-        destroy_mlock(&open_file_table[i].of_lock);
+/*
+ * Checks the superblock of a non-empty image file and takes its geometry
+ * Input:
+ *  - fd: the open image file
+ *  - params: FS geometry, whose fields left at 0 are filled in
+ * Returns: 0 if the image is a volume matching params, -1 otherwise
+ */
+static int volume_check_image(int fd, tfs_params_t *params) {
+    superblock_t sb;
+
+    if (pread(fd, &sb, sizeof(sb), 0) != sizeof(sb) ||
+        sb.sb_magic != VOLUME_MAGIC || sb.sb_version != VOLUME_VERSION ||
+        sb.sb_inode_size != sizeof(inode_t) ||
+        params_from_image(&params->block_size, sb.sb_block_size) == -1 ||
+        params_from_image(&params->data_blocks, sb.sb_data_blocks) == -1 ||
+        params_from_image(&params->inode_table_size,
+                          sb.sb_inode_table_size) == -1) {
+        return -1;
     }
 
-    destroy_mlock(&free_open_file_entries_lock);
-    destroy_mlock(&freeinode_ts_lock);
+    return 0;
 }
 
 /*
- * Creates a new i-node in the i-node table.
+ * Maps the volume image file, creating it if it does not exist (or is empty)
+ * with the size the geometry in params asks for. An existing image keeps its
+ * own geometry.
  * Input:
- *  - n_type: the type of the node (file or directory)
- * Returns:
- *  new i-node's number if successfully created, -1 otherwise
+ *  - params: FS geometry, completed with the image's and the defaults
+ *  - fresh: set to whether the volume is new and must be formatted
+ * Returns: the mapped volume if successful, NULL otherwise
  */
-// TODO: add mutex
-int inode_create(inode_type n_type) {
-    // lock access to freeinode_ts
-    mutex_lock(&freeinode_ts_lock);
-
-    for (int inumber = 0; inumber < INODE_TABLE_SIZE; inumber++) {
-        if ((inumber * (int)sizeof(allocation_state_t) % BLOCK_SIZE) == 0) {
-            insert_delay(); // simulate storage access delay (to freeinode_ts)
-        }
+static char *volume_map(tfs_params_t *params, bool *fresh) {
+    struct stat st;
 
-        /* Finds first free entry in i-node table */
-        if (freeinode_ts[inumber] == FREE) {
-            /* Found a free entry, so takes it for the new i-node*/
-            freeinode_ts[inumber] = TAKEN;
-            mutex_unlock(&freeinode_ts_lock);
-
-            insert_delay(); // simulate storage access delay (to i-node)
-            inode_table[inumber].i_node_type = n_type;
-
-            if (n_type == T_DIRECTORY) {
-                /* Initializes directory (filling its block with empty
-                 * entries, labeled with inumber==-1) */
-                int b = data_block_alloc();
-                if (b == -1) {
-                    freeinode_ts[inumber] = FREE;
-                    return -1;
-                }
+    int fd = open(params->image_path, O_RDWR | O_CREAT, 0644);
+    if (fd == -1) {
+        return NULL;
+    }
 
-                inode_table[inumber].i_size = BLOCK_SIZE;
-                inode_table[inumber].i_data_direct_blocks[0] = b;
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        return NULL;
+    }
+    *fresh = st.st_size == 0;
+
+    if ((!*fresh && volume_check_image(fd, params) == -1) ||
+        params_resolve(params) == -1 ||
+        volume_layout_compute(params, &volume_layout) == -1 ||
+        (*fresh ? ftruncate(fd, (off_t)volume_layout.vl_size) == -1
+                : (size_t)st.st_size != volume_layout.vl_size)) {
+        close(fd);
+        return NULL;
+    }
 
-                dir_entry_t *dir_entry = (dir_entry_t *)data_block_get(b);
-                if (dir_entry == NULL) {
-                    freeinode_ts[inumber] = FREE;
-                    return -1;
-                }
+    void *map = mmap(NULL, volume_layout.vl_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED, fd, 0);
+    /* The mapping stays valid after the file is closed */
+    close(fd);
 
-                for (size_t i = 0; i < MAX_DIR_ENTRIES; i++) {
-                    dir_entry[i].d_inumber = -1;
-                }
-            } else {
-                /* In case of a new file, simply sets its size to 0 */
-                inode_table[inumber].i_size = 0;
-                for (size_t i = 0; i < 10; i++) {
-                    inode_table[inumber].i_data_direct_blocks[i] = -1;
-                }
-                inode_table[inumber].i_data_indirect_block = -1;
-            }
+    return map == MAP_FAILED ? NULL : map;
+}
 
-            init_rwlock(&inode_table[inumber].i_lock);
-            return inumber;
-        }
+/*
+ * Marks every data block as free in the bitmap
+ */
+static void free_blocks_reset() {
+    for (size_t i = 0; i < BITMAP_WORDS; i++) {
+        free_blocks[i] = UINT64_MAX;
+    }
+    /* The bits past the last data block never represent free blocks */
+    if (DATA_BLOCKS % BITMAP_WORD_BITS != 0) {
+        free_blocks[BITMAP_WORDS - 1] =
+            (UINT64_C(1) << (DATA_BLOCKS % BITMAP_WORD_BITS)) - 1;
     }
-        
-    mutex_unlock(&freeinode_ts_lock);
-    return -1;
 }
 
 /*
- * Deletes the i-node.
+ * Marks every block of the block map tree under an i-node slot as taken
  * Input:
- *  - inumber: i-node's number
- * Returns: 0 if successful, -1 if failed
+ *  - block: block number in the slot (-1 if unused)
+ *  - level: number of levels of indirect blocks under the slot (0 for a
+ *    direct block)
  */
-int inode_delete(int inumber) {
-    // simulate storage access delay (to i-node and freeinode_ts)
-    insert_delay();
-    insert_delay();
-
-    if (!valid_inumber(inumber) || freeinode_ts[inumber] == FREE) {
-        return -1;
+static void volume_mark_taken(int block, int level) {
+    if (!valid_block_number(block)) {
+        return;
     }
+    free_blocks[block / BITMAP_WORD_BITS] &=
+        ~(UINT64_C(1) << (block % BITMAP_WORD_BITS));
 
-    freeinode_ts[inumber] = FREE;
-
-    write_lock(&inode_table[inumber].i_lock);
+    if (level > 0) {
+        int const *entries = (int const *)&fs_data[(size_t)block * BLOCK_SIZE];
+        for (size_t i = 0; i < INODE_INDIRECT_ENTRIES; i++) {
+            volume_mark_taken(entries[i], level - 1);
+        }
+    }
+}
 
-    int r = iterate_blocks(&inode_table[inumber], 0,
-                           (int)(inode_table[inumber].i_size / BLOCK_SIZE) + 1,
-                           &data_block_free);
+/*
+ * Rebuilds the free block bitmap of a mounted image from the block maps of
+ * its i-nodes, so that blocks that were cached by the free block pools (or
+ * freed halfway) when the process that wrote the image stopped are free again
+ */
+static void volume_rebuild_bitmap() {
+    free_blocks_reset();
 
-    rw_unlock(&inode_table[inumber].i_lock);
+    for (size_t i = 0; i < INODE_TABLE_SIZE; i++) {
+        if (freeinode_ts[i] != TAKEN) {
+            continue;
+        }
+        for (int b = 0; b < INODE_DIRECT_BLOCKS; b++) {
+            volume_mark_taken(inode_table[i].i_data_direct_blocks[b], 0);
+        }
+        for (int l = 0; l < INODE_INDIRECT_LEVELS; l++) {
+            volume_mark_taken(inode_table[i].i_data_indirect_blocks[l], l + 1);
+        }
+    }
+}
 
-    destroy_rwlock(&inode_table[inumber].i_lock);
+/*
+ * Rebuilds the free i-node stack of a mounted image from the state of its
+ * i-nodes, so that an i-node that was popped but not yet taken (or pushed
+ * halfway) when the process that wrote the image stopped is free again
+ */
+static void volume_rebuild_inode_stack() {
+    int top = -1;
+
+    /* Lowest inumber on top, as in a new volume */
+    for (size_t i = INODE_TABLE_SIZE; i-- > 0;) {
+        if (freeinode_ts[i] != TAKEN) {
+            freeinode_ts[i] = FREE;
+            freeinode_next[i] = top;
+            top = (int)i;
+        }
+    }
+    *freeinode_head = (uint32_t)top;
+}
 
-    return r;
+/*
+ * Brings a mounted image back to a consistent state, unless the process that
+ * wrote it left it with state_destroy: the free block bitmap and the free
+ * i-node stack are rebuilt from the i-nodes, which are only ever changed in
+ * place
+ */
+static void volume_recover() {
+    if (superblock->sb_clean != 1) {
+        volume_rebuild_bitmap();
+        volume_rebuild_inode_stack();
+    }
 }
 
 /*
- * Returns a pointer to an existing i-node.
- * Input:
- *  - inumber: identifier of the i-node
- * Returns: pointer if successful, NULL if failed
+ * Formats a new volume: every i-node and data block is free
  */
-inode_t *inode_get(int inumber) {
-    if (!valid_inumber(inumber)) {
-        return NULL;
+static void volume_format() {
+    superblock->sb_magic = VOLUME_MAGIC;
+    superblock->sb_version = VOLUME_VERSION;
+    superblock->sb_block_size = BLOCK_SIZE;
+    superblock->sb_data_blocks = DATA_BLOCKS;
+    superblock->sb_inode_table_size = INODE_TABLE_SIZE;
+    superblock->sb_inode_size = sizeof(inode_t);
+    superblock->sb_volume_size = volume_layout.vl_size;
+
+    /* Every i-node starts in the free stack, lowest inumber on top */
+    for (size_t i = 0; i < INODE_TABLE_SIZE; i++) {
+        freeinode_ts[i] = FREE;
+        freeinode_next[i] = i + 1 < INODE_TABLE_SIZE ? (int)i + 1 : -1;
     }
+    *freeinode_head = 0;
 
-    insert_delay(); // simulate storage access delay to i-node
-    return &inode_table[inumber];
+    free_blocks_reset();
+}
+
+static void volume_release() {
+    if (volume_mapped) {
+        msync(volume, volume_layout.vl_size, MS_SYNC);
+        munmap(volume, volume_layout.vl_size);
+    } else {
+        free(volume);
+    }
+    volume = NULL;
+}
+
+static void state_free() {
+    if (volume != NULL) {
+        volume_release();
+    }
+    if (open_file_chunks != NULL) {
+        for (size_t c = 0; c < OPEN_FILE_CHUNKS; c++) {
+            open_file_chunk_free(atomic_load(&open_file_chunks[c]));
+        }
+    }
+    free(open_file_chunks);
+    free(inode_open_count);
+    free(inode_pin_count);
+    free(dir_linked);
+    free(dir_indexes);
+    free(delallocs);
+    free(range_locks);
+
+    superblock = NULL;
+    inode_table = NULL;
+    freeinode_ts = NULL;
+    freeinode_next = NULL;
+    freeinode_head = NULL;
+    fs_data = NULL;
+    free_blocks = NULL;
+    open_file_chunks = NULL;
+    inode_open_count = NULL;
+    inode_pin_count = NULL;
+    dir_linked = NULL;
+    dir_indexes = NULL;
+    delallocs = NULL;
+    range_locks = NULL;
 }
 
 /*
- * Adds an entry to the i-node directory data.
+ * Initializes FS state
  * Input:
- *  - inumber: identifier of the i-node
- *  - sub_inumber: identifier of the sub i-node entry
- *  - sub_name: name of the sub i-node entry
- * Returns: SUCCESS or FAIL
+ *  - params: FS geometry (NULL for the defaults); when it names an image
+ *    file, the volume is kept in that file and an existing image is mounted
+ *    as it was left
+ * Returns: 0 if successful, -1 otherwise
  */
-int add_dir_entry(int inumber, int sub_inumber, char const *sub_name) {
-    if (!valid_inumber(inumber) || !valid_inumber(sub_inumber)) {
-        return -1;
+int state_init(tfs_params_t const *params) {
+    tfs_params_t resolved = {0};
+    bool fresh = true;
+
+    if (params != NULL) {
+        resolved = *params;
     }
 
-    insert_delay(); // simulate storage access delay to i-node with inumber
-    if (inode_table[inumber].i_node_type != T_DIRECTORY) {
+    if (latency_init(&resolved.latency) == -1) {
         return -1;
     }
 
-    if (strlen(sub_name) == 0) {
+    volume_mapped = resolved.image_path != NULL;
+    if (volume_mapped) {
+        volume = volume_map(&resolved, &fresh);
+    } else if (params_resolve(&resolved) == 0 &&
+               volume_layout_compute(&resolved, &volume_layout) == 0) {
+        volume = calloc(1, volume_layout.vl_size);
+    }
+    if (volume == NULL) {
         return -1;
     }
-
-    /* Locates the block containing the directory's entries */
-    dir_entry_t *dir_entry = (dir_entry_t *)data_block_get(
-        inode_table[inumber].i_data_direct_blocks[0]);
-    if (dir_entry == NULL) {
+    fs_params = resolved;
+    fs_max_file_blocks = max_file_blocks(&fs_params);
+
+    superblock = (superblock_t *)volume;
+    free_blocks = (uint64_t *)(volume + volume_layout.vl_bitmap);
+    freeinode_ts = (atomic_char *)(volume + volume_layout.vl_inode_ts);
+    freeinode_next = (atomic_int *)(volume + volume_layout.vl_inode_next);
+    freeinode_head = &superblock->sb_freeinode_head;
+    inode_table = (inode_t *)(volume + volume_layout.vl_inode_table);
+    fs_data = volume + volume_layout.vl_data;
+
+    open_file_chunks = calloc(OPEN_FILE_CHUNKS, sizeof(*open_file_chunks));
+    inode_open_count = calloc(INODE_TABLE_SIZE, sizeof(*inode_open_count));
+    inode_pin_count = calloc(INODE_TABLE_SIZE, sizeof(*inode_pin_count));
+    dir_linked = calloc(INODE_TABLE_SIZE, sizeof(*dir_linked));
+    dir_indexes = calloc(INODE_TABLE_SIZE, sizeof(*dir_indexes));
+    delallocs = calloc(INODE_TABLE_SIZE, sizeof(*delallocs));
+    range_locks = calloc(INODE_TABLE_SIZE, sizeof(*range_locks));
+    if (open_file_chunks == NULL ||
+        inode_open_count == NULL || inode_pin_count == NULL ||
+        dir_linked == NULL ||
+        dir_indexes == NULL || delallocs == NULL || range_locks == NULL ||
+        dcache_init() == -1) {
+        state_free();
+        return -1;
+    }
+    if (bcache_init() == -1) {
+        dcache_destroy();
+        state_free();
+        return -1;
+    }
+    if (readahead_init() == -1) {
+        bcache_destroy();
+        dcache_destroy();
+        state_free();
         return -1;
     }
 
-    /* Finds and fills the first empty entry */
-    for (size_t i = 0; i < MAX_DIR_ENTRIES; i++) {
-        if (dir_entry[i].d_inumber == -1) {
-            dir_entry[i].d_inumber = sub_inumber;
-            strncpy(dir_entry[i].d_name, sub_name, MAX_FILE_NAME - 1);
-            dir_entry[i].d_name[MAX_FILE_NAME - 1] = 0;
-            return 0;
-        }
+    if (fresh) {
+        volume_format();
+    } else {
+        volume_recover();
+    }
+    /* Until state_destroy, the image may be left halfway through a change */
+    superblock->sb_clean = 0;
+    /* Every i-node's lock and sequence counter is set up here, free or not,
+     * and kept until the FS is destroyed, so that a lookup racing with
+     * inode_create or inode_delete never finds them half made. The ones in
+     * an image belong to the process that wrote it, which may have stopped
+     * in the middle of a metadata update. */
+    for (size_t i = 0; i < INODE_TABLE_SIZE; i++) {
+        atomic_store(&inode_table[i].i_seq, 0);
+        init_rwlock(&inode_table[i].i_lock);
+        /* Every directory in an image has its name */
+        atomic_store(&dir_linked[i],
+                     i == ROOT_DIR_INUM || (freeinode_ts[i] == TAKEN &&
+                                            inode_table[i].i_node_type ==
+                                                T_DIRECTORY));
+    }
+    free_blocks_hint = 0;
+
+    for (size_t i = 0; i < BLOCK_POOL_SHARDS; i++) {
+        block_pools[i].bp_count = 0;
+        init_mlock(&block_pools[i].bp_lock);
+    }
+
+    atomic_store(&open_file_hint, 0);
+
+    for (size_t i = 0; i < INODE_TABLE_SIZE; i++) {
+        init_mlock(&range_locks[i].rl_lock);
+        pthread_cond_init(&range_locks[i].rl_released, NULL);
     }
 
-    return -1;
+    atomic_store(&free_block_count, data_block_free_count());
+    atomic_store(&reserved_block_count, 0);
+    atomic_store(&delalloc_bytes, 0);
+
+    return 0;
 }
 
-/* Looks for a given name inside a directory
- * Input:
- * 	- parent directory's i-node number
- * 	- name to search
- * 	Returns i-number linked to the target name, -1 if not found
+/*
+ * Destroys FS state; delayed allocation buffers are flushed and blocks held
+ * by the free block pools go back to the bitmap first, so that an image is
+ * left consistent, and marked as such
  */
-int find_in_dir(int inumber, char const *sub_name) {
-    insert_delay(); // simulate storage access delay to i-node with inumber
-    if (!valid_inumber(inumber) ||
-        inode_table[inumber].i_node_type != T_DIRECTORY) {
-        return -1;
+void state_destroy() {
+    for (size_t i = 0; i < INODE_TABLE_SIZE; i++) {
+        if (freeinode_ts[i] == TAKEN) {
+            inode_delalloc_flush(&inode_table[i]);
+        }
     }
+    block_pools_drain();
 
-    /* Locates the block containing the directory's entries */
-    dir_entry_t *dir_entry = (dir_entry_t *)data_block_get(
-        inode_table[inumber].i_data_direct_blocks[0]);
-    if (dir_entry == NULL) {
-        return -1;
+    for (int i = 0; i < INODE_TABLE_SIZE; i++) {
+        dir_index_free(i);
     }
-
-    /* Iterates over the directory entries looking for one that has the target
-     * name */
-    for (int i = 0; i < MAX_DIR_ENTRIES; i++)
-        if ((dir_entry[i].d_inumber != -1) &&
-            (strncmp(dir_entry[i].d_name, sub_name, MAX_FILE_NAME) == 0)) {
-            return dir_entry[i].d_inumber;
+    dcache_destroy();
+    epoch_destroy();
+    for (size_t i = 0; i < INODE_TABLE_SIZE; i++) {
+        dir_index_t *index = atomic_load(&dir_indexes[i]);
+        if (index != NULL) {
+            dir_index_destroy(index);
         }
+    }
+    readahead_destroy();
+    bcache_destroy();
+
+    for (size_t i = 0; i < BLOCK_POOL_SHARDS; i++) {
+        destroy_mlock(&block_pools[i].bp_lock);
+    }
 
-    return -1;
+    for (size_t i = 0; i < INODE_TABLE_SIZE; i++) {
+        destroy_rwlock(&inode_table[i].i_lock);
+        destroy_mlock(&range_locks[i].rl_lock);
+        pthread_cond_destroy(&range_locks[i].rl_released);
+    }
+
+    /* The next mount can take the image as it is */
+    superblock->sb_clean = 1;
+    state_free();
 }
 
 /*
- * Allocated a new data block
- * Returns: block index if successful, -1 otherwise
+ * Tells whether an i-node is in use
+ * Input:
+ *  - inumber: identifier of the i-node
+ * Returns: true if the i-node exists, false otherwise
  */
-int data_block_alloc() {
-    mutex_lock(&free_blocks_lock);
+bool inode_exists(int inumber) {
+    return valid_inumber(inumber) && freeinode_ts[inumber] == TAKEN;
+}
 
-    for (int i = 0; i < DATA_BLOCKS; i++) {
-        if (i * (int)sizeof(allocation_state_t) % BLOCK_SIZE == 0) {
-            insert_delay(); // simulate storage access delay to free_blocks
-        }
+/*
+ * Takes the inumber on top of the free i-node stack
+ * Returns: the inumber, -1 if every i-node is taken
+ */
+static int freeinode_pop() {
+    uint64_t head = atomic_load(freeinode_head);
+    uint64_t next;
 
-        if (free_blocks[i] == FREE) {
-            free_blocks[i] = TAKEN;
-            mutex_unlock(&free_blocks_lock); 
-            return i;
+    do {
+        if (FREEINODE_TOP(head) == -1) {
+            return -1;
         }
-    }
+        next = (FREEINODE_TAG(head) + (UINT64_C(1) << 32)) |
+               (uint32_t)atomic_load(&freeinode_next[FREEINODE_TOP(head)]);
+    } while (!atomic_compare_exchange_weak(freeinode_head, &head, next));
 
-    mutex_unlock(&free_blocks_lock);
-    return -1;
+    return FREEINODE_TOP(head);
 }
 
-/* Frees a data block
- * Input
- * 	- the block index
- * Returns: 0 if success, -1 otherwise
+/*
+ * Puts an inumber back on top of the free i-node stack
  */
-int data_block_free(int *block_number) {
-    if (!valid_block_number(*block_number)) {
-        return -1;
-    }
-
-    insert_delay(); // simulate storage access delay to free_blocks
-    
-    mutex_lock(&free_blocks_lock);
-    free_blocks[*block_number] = FREE;
-    mutex_unlock(&free_blocks_lock);
-    
-    return 0;
+static void freeinode_push(int inumber) {
+    uint64_t head = atomic_load(freeinode_head);
+    uint64_t next;
+
+    do {
+        atomic_store(&freeinode_next[inumber], FREEINODE_TOP(head));
+        next = FREEINODE_TAG(head) | (uint32_t)inumber;
+    } while (!atomic_compare_exchange_weak(freeinode_head, &head, next));
 }
 
-/* Returns a pointer to the contents of a given block
- * Input:
- * 	- Block's index
- * Returns: pointer to the first byte of the block, NULL otherwise
+/*
+ * Brackets a change to an i-node's metadata, making its sequence counter odd
+ * for the duration, so that inode_meta_read retries snapshots that overlap
+ * it. Writers are serialized by the i-node's write lock (or, for a new
+ * i-node, by owning it).
  */
-void *data_block_get(int block_number) {
-    if (!valid_block_number(block_number)) {
-        return NULL;
-    }
+static void inode_meta_write_begin(inode_t *inode) {
+    unsigned seq = atomic_load_explicit(&inode->i_seq, memory_order_relaxed);
+    atomic_store_explicit(&inode->i_seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
 
-    insert_delay(); // simulate storage access delay to block
-    return &fs_data[block_number * BLOCK_SIZE];
+static void inode_meta_write_end(inode_t *inode) {
+    unsigned seq = atomic_load_explicit(&inode->i_seq, memory_order_relaxed);
+    atomic_store_explicit(&inode->i_seq, seq + 1, memory_order_release);
 }
 
-/* Add new entry to the open file table
- * Inputs:
- * 	- I-node number of the file to open
- * 	- Initial offset
- * Returns: file handle if successful, -1 otherwise
+/*
+ * Creates a new i-node in the i-node table.
+ * Input:
+ *  - n_type: the type of the node (file or directory)
+ * Returns:
+ *  new i-node's number if successfully created, -1 otherwise
  */
-int add_to_open_file_table(int inumber, size_t offset) {
-    inode_t *inode = inode_get(inumber);
+int inode_create(inode_type n_type) {
+    latency_charge(TFS_ACCESS_BITMAP); // access to freeinode_ts
 
-    if (inode == NULL) {
+    /* Takes a free entry for the new i-node */
+    int inumber = freeinode_pop();
+    if (inumber == -1) {
         return -1;
     }
 
-    // Lock it so that no 2 threads can take the same open_file_entry
-    mutex_lock(&free_open_file_entries_lock);
-
-    // TODO: Check lock type (Fixed to compile)
-    write_lock(&inode->i_lock);
+    latency_charge(TFS_ACCESS_INODE); // access to the i-node
+    inode_meta_write_begin(&inode_table[inumber]);
+    inode_table[inumber].i_node_type = n_type;
+    for (size_t i = 0; i < INODE_DIRECT_BLOCKS; i++) {
+        inode_table[inumber].i_data_direct_blocks[i] = -1;
+    }
+    for (size_t i = 0; i < INODE_INDIRECT_LEVELS; i++) {
+        inode_table[inumber].i_data_indirect_blocks[i] = -1;
+    }
 
-    for (int i = 0; i < MAX_OPEN_FILES; i++) {
-        if (free_open_file_entries[i] == FREE) {
-            free_open_file_entries[i] = TAKEN;
+    if (n_type == T_DIRECTORY) {
+        /* Initializes directory (filling its block with empty
+         * entries, labeled with inumber==-1) */
+        int b = data_block_alloc();
+        dir_entry_t *dir_entry = (dir_entry_t *)data_block_get(b);
+        if (dir_entry == NULL) {
+            inode_meta_write_end(&inode_table[inumber]);
+            freeinode_push(inumber);
+            return -1;
+        }
 
-            // As soon as the file entry changes to TAKEN the lock can be freed
-            mutex_unlock(&free_open_file_entries_lock);
+        inode_table[inumber].i_size = BLOCK_SIZE;
+        inode_table[inumber].i_data_direct_blocks[0] = b;
 
-            open_file_table[i].of_inumber = inumber;
-            open_file_table[i].of_offset = offset;
-            
-            rw_unlock(&inode->i_lock);
-            return i;
+        for (size_t i = 0; i < DIR_ENTRIES_PER_BLOCK; i++) {
+            dir_entry[i].d_inumber = -1;
         }
+    } else {
+        /* In case of a new file, simply sets its size to 0 */
+        inode_table[inumber].i_size = 0;
     }
+    inode_meta_write_end(&inode_table[inumber]);
 
-    mutex_unlock(&free_open_file_entries_lock);
-
-    rw_unlock(&inode->i_lock);
-    return -1;
+    /* Published once the i-node is complete */
+    freeinode_ts[inumber] = TAKEN;
+    return inumber;
 }
 
-/* Frees an entry from the open file table
- * Inputs:
- * 	- file handle to free/close
- * Returns 0 is success, -1 otherwise
+/*
+ * Claims an i-node to delete it: its open count is set to
+ * OPEN_COUNT_DELETING, which add_to_open_file_table refuses, so that no
+ * handle to it can be opened from then on
+ * Returns: 0 if successful, -1 if the i-node is open or its blocks are
+ * pinned (see inode_pin)
  */
-int remove_from_open_file_table(int fhandle) {
-    mutex_lock(&free_open_file_entries_lock);
-
-    open_file_entry_t *file = get_open_file_entry(fhandle);
-    if (file == NULL) {
+static int inode_delete_claim(int inumber) {
+    int open = 0;
+    if (!atomic_compare_exchange_strong(&inode_open_count[inumber], &open,
+                                        OPEN_COUNT_DELETING)) {
         return -1;
     }
 
-    inode_t *inode = inode_get(file->of_inumber);
-    if (inode == NULL) {
+    /* Blocks are only pinned through an open handle, so no new pin can
+     * show up once the claim is made */
+    if (inode_is_pinned(inumber)) {
+        atomic_store(&inode_open_count[inumber], 0);
         return -1;
     }
 
+    return 0;
+}
+
+/*
+ * Frees the blocks of an i-node claimed by inode_delete_claim and already
+ * marked FREE, and hands its inumber out again
+ * Returns: 0 if successful, -1 if its blocks could not be freed, in which
+ * case the i-node stays, along with its blocks
+ */
+static int inode_free(int inumber) {
+    write_lock(&inode_table[inumber].i_lock);
+    if (inode_truncate(&inode_table[inumber]) == -1) {
+        freeinode_ts[inumber] = TAKEN;
+        rw_unlock(&inode_table[inumber].i_lock);
+        atomic_store(&inode_open_count[inumber], 0);
+        return -1;
+    }
+    rw_unlock(&inode_table[inumber].i_lock);
+
+    dir_index_free(inumber);
+
+    /* Only now can the i-node be opened and handed out again */
+    atomic_store(&dir_linked[inumber], inumber == ROOT_DIR_INUM);
+    atomic_store(&inode_open_count[inumber], 0);
+    freeinode_push(inumber);
+
+    return 0;
+}
+
+/*
+ * Deletes the i-node.
+ * Input:
+ *  - inumber: i-node's number
+ * Returns: 0 if successful, -1 if failed (also if the i-node is open or
+ * its blocks are pinned)
+ */
+int inode_delete(int inumber) {
+    // access to the i-node and to freeinode_ts
+    latency_charge(TFS_ACCESS_INODE);
+    latency_charge(TFS_ACCESS_BITMAP);
+
+    if (!valid_inumber(inumber) || inode_delete_claim(inumber) == -1) {
+        return -1;
+    }
+    if (atomic_exchange(&freeinode_ts[inumber], FREE) != TAKEN) {
+        atomic_store(&inode_open_count[inumber], 0);
+        return -1;
+    }
+
+    return inode_free(inumber);
+}
+
+/*
+ * Takes a consistent snapshot of an i-node's metadata (its type, size and
+ * block map root) without taking its lock. Writers of the metadata make the
+ * i-node's sequence counter odd while they change it (see
+ * inode_meta_write_begin), and the snapshot is retried if the counter was
+ * odd or moved while it was copied; after INODE_META_RETRIES tries it is
+ * taken under the i-node's lock instead, waiting for the writer. Like a
+ * dentry cache hit, it is served from memory and not charged as a storage
+ * access.
+ * Input:
+ *  - inumber: identifier of the i-node
+ *  - meta: where the snapshot is copied to
+ * Returns: 0 if successful, -1 if there is no such i-node
+ */
+int inode_meta_read(int inumber, inode_meta_t *meta) {
+    if (!valid_inumber(inumber) || freeinode_ts[inumber] != TAKEN) {
+        return -1;
+    }
+    inode_t *inode = &inode_table[inumber];
+
+    for (int i = 0; i < INODE_META_RETRIES; i++) {
+        unsigned seq =
+            atomic_load_explicit(&inode->i_seq, memory_order_acquire);
+        if (seq % 2 != 0) {
+            continue;
+        }
+
+        meta->im_type = inode->i_node_type;
+        meta->im_size = inode->i_size;
+        memcpy(meta->im_direct_blocks, inode->i_data_direct_blocks,
+               sizeof(meta->im_direct_blocks));
+        memcpy(meta->im_indirect_blocks, inode->i_data_indirect_blocks,
+               sizeof(meta->im_indirect_blocks));
+
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&inode->i_seq, memory_order_relaxed) == seq) {
+            return 0;
+        }
+    }
+
+    read_lock(&inode->i_lock);
+    meta->im_type = inode->i_node_type;
+    meta->im_size = inode->i_size;
+    memcpy(meta->im_direct_blocks, inode->i_data_direct_blocks,
+           sizeof(meta->im_direct_blocks));
+    memcpy(meta->im_indirect_blocks, inode->i_data_indirect_blocks,
+           sizeof(meta->im_indirect_blocks));
+    rw_unlock(&inode->i_lock);
+
+    return 0;
+}
+
+/*
+ * Sets the size of an i-node, publishing it to inode_meta_read. The caller
+ * must hold the i-node's write lock.
+ */
+void inode_size_set(inode_t *inode, size_t size) {
+    inode_meta_write_begin(inode);
+    inode->i_size = size;
+    inode_meta_write_end(inode);
+}
+
+/*
+ * Returns a pointer to an existing i-node.
+ * Input:
+ *  - inumber: identifier of the i-node
+ * Returns: pointer if successful, NULL if failed
+ */
+inode_t *inode_get(int inumber) {
+    if (!valid_inumber(inumber)) {
+        return NULL;
+    }
+
+    latency_charge(TFS_ACCESS_INODE); // access to the i-node
+    return &inode_table[inumber];
+}
+
+/*
+ * Hashes a directory entry name (FNV-1a), looking at no more characters than
+ * a directory entry can hold
+ */
+static size_t dir_name_hash(char const *name) {
+    size_t hash = 2166136261u;
+    for (size_t i = 0; i < MAX_FILE_NAME - 1 && name[i] != '\0'; i++) {
+        hash = (hash ^ (unsigned char)name[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static dir_table_t *dir_table_alloc(size_t buckets) {
+    dir_table_t *table =
+        calloc(1, sizeof(*table) + buckets * sizeof(table->dt_heads[0]));
+    if (table != NULL) {
+        table->dt_buckets = buckets;
+    }
+    return table;
+}
+
+static void dir_table_destroy(void *table) {
+    dir_table_t *t = table;
+    for (size_t b = 0; b < t->dt_buckets; b++) {
+        dir_index_entry_t *entry = atomic_load(&t->dt_heads[b]);
+        while (entry != NULL) {
+            dir_index_entry_t *next = atomic_load(&entry->de_next);
+            free(entry);
+            entry = next;
+        }
+    }
+    free(t);
+}
+
+static dir_index_entry_t *dir_entry_alloc(char const *name, int inumber,
+                                          int slot) {
+    dir_index_entry_t *entry = malloc(sizeof(*entry));
+    if (entry != NULL) {
+        entry->de_inumber = inumber;
+        entry->de_slot = slot;
+        strncpy(entry->de_name, name, MAX_FILE_NAME - 1);
+        entry->de_name[MAX_FILE_NAME - 1] = 0;
+    }
+    return entry;
+}
+
+/* Links a new entry at the head of its bucket, publishing it whole */
+static void dir_table_link(dir_table_t *table, dir_index_entry_t *entry) {
+    _Atomic(dir_index_entry_t *) *head =
+        &table->dt_heads[dir_name_hash(entry->de_name) &
+                         (table->dt_buckets - 1)];
+    atomic_store_explicit(&entry->de_next,
+                          atomic_load_explicit(head, memory_order_relaxed),
+                          memory_order_relaxed);
+    atomic_store_explicit(head, entry, memory_order_release);
+}
+
+/*
+ * Adds an entry to a directory index, replacing its table by one twice as
+ * large (holding copies of the entries, as lookups may be walking the old
+ * one) when it gets full.
+ * Must be called with the index's write lock held, and the index's table
+ * built.
+ * Returns: 0 if successful, -1 otherwise
+ */
+static int dir_index_insert(dir_index_t *index, char const *name, int inumber,
+                            int slot) {
+    dir_table_t *table = atomic_load(&index->di_table);
+
+    if (index->di_count == table->dt_buckets) {
+        dir_table_t *larger = dir_table_alloc(table->dt_buckets * 2);
+        if (larger == NULL) {
+            return -1;
+        }
+
+        for (size_t b = 0; b < table->dt_buckets; b++) {
+            for (dir_index_entry_t *entry = atomic_load(&table->dt_heads[b]);
+                 entry != NULL; entry = atomic_load(&entry->de_next)) {
+                dir_index_entry_t *copy = dir_entry_alloc(
+                    entry->de_name, entry->de_inumber, entry->de_slot);
+                if (copy == NULL) {
+                    dir_table_destroy(larger);
+                    return -1;
+                }
+                dir_table_link(larger, copy);
+            }
+        }
+
+        atomic_store_explicit(&index->di_table, larger, memory_order_release);
+        epoch_retire(table, dir_table_destroy);
+        table = larger;
+    }
+
+    dir_index_entry_t *entry = dir_entry_alloc(name, inumber, slot);
+    if (entry == NULL) {
+        return -1;
+    }
+    dir_table_link(table, entry);
+    index->di_count++;
+
+    return 0;
+}
+
+/*
+ * Looks for a name in a table of a directory index. Must be called with the
+ * index's lock held, or in a read section (see epoch_enter).
+ * Returns: the entry, NULL if not found
+ */
+static dir_index_entry_t *dir_table_find(dir_table_t *table,
+                                         char const *name) {
+    dir_index_entry_t *entry = atomic_load_explicit(
+        &table->dt_heads[dir_name_hash(name) & (table->dt_buckets - 1)],
+        memory_order_acquire);
+
+    while (entry != NULL) {
+        if (strncmp(entry->de_name, name, MAX_FILE_NAME) == 0) {
+            return entry;
+        }
+        entry = atomic_load_explicit(&entry->de_next, memory_order_acquire);
+    }
+
+    return NULL;
+}
+
+/*
+ * Returns the entries held by one of the blocks of a directory
+ * Input:
+ *  - inumber: identifier of the directory's i-node
+ *  - block_index: index of the block within the directory
+ * Returns: pointer to the block's first entry, NULL if there is no such block
+ */
+static dir_entry_t *dir_entries_get(int inumber, int block_index) {
+    int block;
+
+    if (inode_block_map(&inode_table[inumber], block_index, 1, &block) ==
+        -1) {
+        return NULL;
+    }
+
+    return (dir_entry_t *)data_block_get(block);
+}
+
+/*
+ * Builds the table of a directory's index from the directory's entries, and
+ * publishes it once it is complete. Must be called with the index's write
+ * lock held.
+ * Returns: 0 if successful, -1 if out of memory
+ */
+static int dir_index_build(int inumber, dir_index_t *index) {
+    /* Room for every slot of the directory, so that the table is never
+     * replaced while it is built */
+    int blocks = (int)(inode_table[inumber].i_size / BLOCK_SIZE);
+    size_t buckets = DIR_INDEX_MIN_BUCKETS;
+    while (buckets < (size_t)blocks * (size_t)DIR_ENTRIES_PER_BLOCK) {
+        buckets *= 2;
+    }
+
+    dir_table_t *table = dir_table_alloc(buckets);
+    if (table == NULL) {
+        return -1;
+    }
+
+    size_t count = 0;
+    int free_hint = -1;
+    for (int b = 0; b < blocks; b++) {
+        dir_entry_t *dir_entry = dir_entries_get(inumber, b);
+        for (int i = 0; dir_entry != NULL && i < DIR_ENTRIES_PER_BLOCK; i++) {
+            int slot = b * DIR_ENTRIES_PER_BLOCK + i;
+            if (dir_entry[i].d_inumber == -1) {
+                if (free_hint == -1) {
+                    free_hint = slot;
+                }
+                continue;
+            }
+
+            dir_index_entry_t *entry = dir_entry_alloc(
+                dir_entry[i].d_name, dir_entry[i].d_inumber, slot);
+            if (entry == NULL) {
+                dir_table_destroy(table);
+                return -1;
+            }
+            dir_table_link(table, entry);
+            count++;
+        }
+    }
+
+    index->di_count = count;
+    index->di_free_hint =
+        free_hint == -1 ? blocks * DIR_ENTRIES_PER_BLOCK : free_hint;
+    atomic_store_explicit(&index->di_table, table, memory_order_release);
+
+    return 0;
+}
+
+/*
+ * Returns the index of a directory, building its table if it has none yet.
+ * The index of an inumber is made the first time it is needed and kept,
+ * for every directory that later gets the same inumber, until the FS is
+ * destroyed, so that its lock can always be taken; only its table is
+ * dropped when the directory is deleted (see dir_index_free), and stays
+ * NULL while the inumber is not a directory.
+ * Returns: pointer to the index, NULL if out of memory
+ */
+static dir_index_t *dir_index_get(int inumber) {
+    dir_index_t *index = atomic_load(&dir_indexes[inumber]);
+    if (index == NULL) {
+        mutex_lock(&dir_indexes_lock);
+        index = atomic_load(&dir_indexes[inumber]);
+        if (index == NULL && (index = malloc(sizeof(*index))) != NULL) {
+            init_rwlock(&index->di_lock);
+            index->di_count = 0;
+            atomic_init(&index->di_table, NULL);
+            index->di_free_hint = 0;
+            atomic_store(&dir_indexes[inumber], index);
+        }
+        mutex_unlock(&dir_indexes_lock);
+        if (index == NULL) {
+            return NULL;
+        }
+    }
+
+    if (atomic_load_explicit(&index->di_table, memory_order_acquire) == NULL) {
+        write_lock(&index->di_lock);
+        if (atomic_load(&index->di_table) == NULL && inode_exists(inumber) &&
+            inode_table[inumber].i_node_type == T_DIRECTORY &&
+            atomic_load(&dir_linked[inumber])) {
+            dir_index_build(inumber, index);
+        }
+        rw_unlock(&index->di_lock);
+    }
+
+    return index;
+}
+
+static void dir_index_destroy(dir_index_t *index) {
+    destroy_rwlock(&index->di_lock);
+    free(index);
+}
+
+/*
+ * Drops the table of a deleted directory's index (if it has one), once
+ * lookups that may be walking it are done
+ */
+static void dir_index_free(int inumber) {
+    dir_index_t *index = atomic_load(&dir_indexes[inumber]);
+    if (index == NULL) {
+        return;
+    }
+
+    write_lock(&index->di_lock);
+    dir_table_t *table = atomic_exchange(&index->di_table, NULL);
+    rw_unlock(&index->di_lock);
+
+    if (table != NULL) {
+        epoch_retire(table, dir_table_destroy);
+    }
+}
+
+/*
+ * Finds a free entry in a directory, starting at its free slot hint, and
+ * grows the directory by one block when every entry is in use.
+ * Must be called with the index's write lock held.
+ * Returns: the slot of the free entry, -1 if the directory can not grow
+ */
+static int dir_free_slot(int inumber, dir_index_t *index) {
+    inode_t *inode = &inode_table[inumber];
+    int blocks = (int)(inode->i_size / BLOCK_SIZE);
+
+    for (int b = index->di_free_hint / DIR_ENTRIES_PER_BLOCK; b < blocks;
+         b++) {
+        dir_entry_t *dir_entry = dir_entries_get(inumber, b);
+        if (dir_entry == NULL) {
+            return -1;
+        }
+
+        int i = b == index->di_free_hint / DIR_ENTRIES_PER_BLOCK
+                    ? index->di_free_hint % DIR_ENTRIES_PER_BLOCK
+                    : 0;
+        for (; i < DIR_ENTRIES_PER_BLOCK; i++) {
+            if (dir_entry[i].d_inumber == -1) {
+                return b * DIR_ENTRIES_PER_BLOCK + i;
+            }
+        }
+    }
+
+    /* Every entry is in use: add a block of empty entries. The block map
+     * and the size change under the i-node's write lock, like a file's, so
+     * that readers of its metadata (see inode_meta_read) wait for them; the
+     * index lock is always taken first. */
+    int block;
     write_lock(&inode->i_lock);
+    if (inode_block_alloc(inode, blocks, 1, &block) != 1) {
+        rw_unlock(&inode->i_lock);
+        return -1;
+    }
+
+    dir_entry_t *dir_entry = (dir_entry_t *)data_block_get(block);
+    for (int i = 0; i < DIR_ENTRIES_PER_BLOCK; i++) {
+        dir_entry[i].d_inumber = -1;
+    }
+    inode_size_set(inode, inode->i_size + BLOCK_SIZE);
+    rw_unlock(&inode->i_lock);
+
+    return blocks * DIR_ENTRIES_PER_BLOCK;
+}
+
+/*
+ * Adds an entry to the i-node directory data.
+ * Input:
+ *  - inumber: identifier of the i-node
+ *  - sub_inumber: identifier of the sub i-node entry
+ *  - sub_name: name of the sub i-node entry
+ * Returns: SUCCESS or FAIL (also if the name is already taken)
+ */
+int add_dir_entry(int inumber, int sub_inumber, char const *sub_name) {
+    if (!valid_inumber(inumber) || !valid_inumber(sub_inumber)) {
+        return -1;
+    }
+
+    latency_charge(TFS_ACCESS_INODE); // access to i-node with inumber
+    if (inode_table[inumber].i_node_type != T_DIRECTORY) {
+        return -1;
+    }
+
+    if (strlen(sub_name) == 0) {
+        return -1;
+    }
+
+    dir_index_t *index = dir_index_get(inumber);
+    if (index == NULL) {
+        return -1;
+    }
+
+    write_lock(&index->di_lock);
+
+    /* A directory deleted meanwhile has no table left */
+    dir_table_t *table = atomic_load(&index->di_table);
+    if (table == NULL || dir_table_find(table, sub_name) != NULL) {
+        rw_unlock(&index->di_lock);
+        return -1;
+    }
+
+    /* A directory can have entries from the moment it has a name */
+    if (inode_table[sub_inumber].i_node_type == T_DIRECTORY) {
+        atomic_store(&dir_linked[sub_inumber], true);
+    }
+
+    int slot = dir_free_slot(inumber, index);
+    if (slot == -1 ||
+        dir_index_insert(index, sub_name, sub_inumber, slot) == -1) {
+        rw_unlock(&index->di_lock);
+        return -1;
+    }
+
+    dir_entry_t *dir_entry =
+        dir_entries_get(inumber, slot / DIR_ENTRIES_PER_BLOCK) +
+        slot % DIR_ENTRIES_PER_BLOCK;
+    dir_entry->d_inumber = sub_inumber;
+    strncpy(dir_entry->d_name, sub_name, MAX_FILE_NAME - 1);
+    dir_entry->d_name[MAX_FILE_NAME - 1] = 0;
+    index->di_free_hint = slot + 1;
+    dcache_invalidate(inumber, sub_name);
+
+    rw_unlock(&index->di_lock);
+    return 0;
+}
+
+/*
+ * Finds the link to the entry of a name in a directory index's table. Must be
+ * called with the index's write lock held.
+ * Returns: the link, NULL if the name is not in the table
+ */
+static _Atomic(dir_index_entry_t *) *dir_table_link_of(dir_table_t *table,
+                                                       char const *name) {
+    for (_Atomic(dir_index_entry_t *) *link =
+             &table->dt_heads[dir_name_hash(name) & (table->dt_buckets - 1)];
+         atomic_load(link) != NULL; link = &atomic_load(link)->de_next) {
+        if (strncmp(atomic_load(link)->de_name, name, MAX_FILE_NAME) == 0) {
+            return link;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Removes an entry from a directory and from its index. Must be called with
+ * the index's write lock held.
+ * Input:
+ *  - inumber: identifier of the directory's i-node
+ *  - index: the directory's index
+ *  - link: link to the entry in the index's table
+ * Returns: 0 if successful, -1 otherwise
+ */
+static int dir_index_remove(int inumber, dir_index_t *index,
+                            _Atomic(dir_index_entry_t *) *link) {
+    dir_index_entry_t *entry = atomic_load(link);
+
+    dir_entry_t *dir_entry =
+        dir_entries_get(inumber, entry->de_slot / DIR_ENTRIES_PER_BLOCK);
+    if (dir_entry == NULL) {
+        return -1;
+    }
+    dir_entry[entry->de_slot % DIR_ENTRIES_PER_BLOCK].d_inumber = -1;
+
+    if (entry->de_slot < index->di_free_hint) {
+        index->di_free_hint = entry->de_slot;
+    }
+    atomic_store_explicit(link, atomic_load(&entry->de_next),
+                          memory_order_release);
+    index->di_count--;
+    /* Only once the entry is unlinked, so that a lookup that found it can
+     * not cache it afterwards */
+    dcache_invalidate(inumber, entry->de_name);
+    epoch_retire(entry, free);
+
+    return 0;
+}
+
+/*
+ * Removes the entry of a given i-node from a directory, going straight to the
+ * bucket of its name
+ * Input:
+ *  - inumber: identifier of the directory's i-node
+ *  - sub_inumber: identifier of the i-node whose entry is removed
+ *  - sub_name: name of the entry
+ * Returns: 0 if successful, -1 if there is no such entry
+ */
+int clear_dir_entry(int inumber, int sub_inumber, char const *sub_name) {
+    if (!valid_inumber(inumber) || !valid_inumber(sub_inumber)) {
+        return -1;
+    }
+
+    latency_charge(TFS_ACCESS_INODE); // access to i-node with inumber
+    if (inode_table[inumber].i_node_type != T_DIRECTORY) {
+        return -1;
+    }
+
+    dir_index_t *index = dir_index_get(inumber);
+    if (index == NULL) {
+        return -1;
+    }
+
+    write_lock(&index->di_lock);
+
+    dir_table_t *table = atomic_load(&index->di_table);
+    _Atomic(dir_index_entry_t *) *link =
+        table == NULL ? NULL : dir_table_link_of(table, sub_name);
+    int r = -1;
+    if (link != NULL && atomic_load(link)->de_inumber == sub_inumber) {
+        r = dir_index_remove(inumber, index, link);
+    }
+
+    rw_unlock(&index->di_lock);
+    return r;
+}
+
+/*
+ * Removes a name from a directory and deletes the i-node it refers to,
+ * unless that i-node is open, has pinned blocks or is a directory with
+ * entries. The checks and the removal of the name are done under the
+ * directory's index write lock, with the i-node claimed for deletion (see
+ * inode_delete_claim) so that no handle to it is opened meanwhile, and, for
+ * a directory, also under its own index's write lock, whose table is
+ * dropped along with the name so that nothing is added to it afterwards.
+ * Input:
+ *  - inumber: identifier of the directory's i-node
+ *  - sub_name: name to remove
+ * Returns: 0 if successful, -1 otherwise
+ */
+int unlink_dir_entry(int inumber, char const *sub_name) {
+    if (!valid_inumber(inumber)) {
+        return -1;
+    }
+
+    latency_charge(TFS_ACCESS_INODE); // access to i-node with inumber
+    if (inode_table[inumber].i_node_type != T_DIRECTORY) {
+        return -1;
+    }
+
+    dir_index_t *index = dir_index_get(inumber);
+    if (index == NULL) {
+        return -1;
+    }
+
+    write_lock(&index->di_lock);
+
+    dir_table_t *table = atomic_load(&index->di_table);
+    _Atomic(dir_index_entry_t *) *link =
+        table == NULL ? NULL : dir_table_link_of(table, sub_name);
+    int sub_inumber = link == NULL ? -1 : atomic_load(link)->de_inumber;
+    if (!valid_inumber(sub_inumber) ||
+        inode_delete_claim(sub_inumber) == -1) {
+        rw_unlock(&index->di_lock);
+        return -1;
+    }
+
+    latency_charge(TFS_ACCESS_INODE); // access to i-node with sub_inumber
+    dir_index_t *sub_index = NULL;
+    dir_table_t *sub_table = NULL;
+    if (inode_table[sub_inumber].i_node_type == T_DIRECTORY) {
+        sub_index = dir_index_get(sub_inumber);
+        if (sub_index != NULL) {
+            write_lock(&sub_index->di_lock);
+            sub_table = atomic_load(&sub_index->di_table);
+        }
+        if (sub_table == NULL || sub_index->di_count != 0) {
+            if (sub_index != NULL) {
+                rw_unlock(&sub_index->di_lock);
+            }
+            atomic_store(&inode_open_count[sub_inumber], 0);
+            rw_unlock(&index->di_lock);
+            return -1;
+        }
+    }
+
+    if (dir_index_remove(inumber, index, link) == -1) {
+        if (sub_index != NULL) {
+            rw_unlock(&sub_index->di_lock);
+        }
+        atomic_store(&inode_open_count[sub_inumber], 0);
+        rw_unlock(&index->di_lock);
+        return -1;
+    }
+
+    latency_charge(TFS_ACCESS_BITMAP); // access to freeinode_ts
+    freeinode_ts[sub_inumber] = FREE;
+    if (sub_index != NULL) {
+        atomic_store(&dir_linked[sub_inumber], false);
+        atomic_store(&sub_index->di_table, NULL);
+        rw_unlock(&sub_index->di_lock);
+        epoch_retire(sub_table, dir_table_destroy);
+    }
+
+    rw_unlock(&index->di_lock);
+
+    return inode_free(sub_inumber);
+}
+
+/*
+ * Counts the entries of a directory
+ * Input:
+ *  - inumber: identifier of the directory's i-node
+ * Returns: number of entries, -1 if inumber is not a directory
+ */
+int dir_entry_count(int inumber) {
+    if (!valid_inumber(inumber) ||
+        inode_table[inumber].i_node_type != T_DIRECTORY) {
+        return -1;
+    }
+
+    dir_index_t *index = dir_index_get(inumber);
+    if (index == NULL) {
+        return -1;
+    }
+
+    read_lock(&index->di_lock);
+    int count =
+        atomic_load(&index->di_table) == NULL ? -1 : (int)index->di_count;
+    rw_unlock(&index->di_lock);
+
+    return count;
+}
+
+/* Looks for a given name inside a directory
+ * Input:
+ * 	- parent directory's i-node number
+ * 	- name to search
+ * 	Returns i-number linked to the target name, -1 if not found
+ */
+int find_in_dir(int inumber, char const *sub_name) {
+    latency_charge(TFS_ACCESS_INODE); // access to i-node with inumber
+    if (!valid_inumber(inumber) ||
+        inode_table[inumber].i_node_type != T_DIRECTORY) {
+        return -1;
+    }
+
+    dir_index_t *index = dir_index_get(inumber);
+    if (index == NULL) {
+        return -1;
+    }
+
+    /* The index is walked without its lock, unless this thread can not
+     * have a read section */
+    bool locked = !epoch_enter();
+    if (locked) {
+        read_lock(&index->di_lock);
+    }
+    dir_table_t *table =
+        atomic_load_explicit(&index->di_table, memory_order_acquire);
+    dir_index_entry_t *entry =
+        table == NULL ? NULL : dir_table_find(table, sub_name);
+    int sub_inumber = entry == NULL ? -1 : entry->de_inumber;
+    if (locked) {
+        rw_unlock(&index->di_lock);
+    } else {
+        epoch_exit();
+    }
+
+    return sub_inumber;
+}
+
+/*
+ * Takes up to count free blocks straight from the bitmap
+ * Returns: number of blocks taken
+ */
+static int free_blocks_take(int *blocks, int count) {
+    int allocated = 0;
+
+    mutex_lock(&free_blocks_lock);
+
+    for (size_t w = free_blocks_hint; w < BITMAP_WORDS && allocated < count;
+         w++) {
+        if (w == free_blocks_hint || w % BITMAP_WORDS_PER_BLOCK == 0) {
+            latency_charge(TFS_ACCESS_BITMAP); // access to free_blocks
+        }
+
+        while (free_blocks[w] != 0 && allocated < count) {
+            int bit = __builtin_ctzll(free_blocks[w]);
+            free_blocks[w] &= free_blocks[w] - 1; // clears the lowest set bit
+            blocks[allocated++] = (int)w * BITMAP_WORD_BITS + bit;
+        }
+
+        free_blocks_hint = w;
+    }
+
+    mutex_unlock(&free_blocks_lock);
+    return allocated;
+}
+
+/*
+ * Marks the given blocks as free in the bitmap
+ */
+static void free_blocks_release(int const *blocks, int count) {
+    latency_charge(TFS_ACCESS_BITMAP); // access to free_blocks
+
+    mutex_lock(&free_blocks_lock);
+    for (int i = 0; i < count; i++) {
+        size_t w = (size_t)blocks[i] / BITMAP_WORD_BITS;
+        free_blocks[w] |= UINT64_C(1) << (blocks[i] % BITMAP_WORD_BITS);
+        if (w < free_blocks_hint) {
+            free_blocks_hint = w;
+        }
+    }
+    mutex_unlock(&free_blocks_lock);
+}
+
+/*
+ * Finds the first run of free blocks starting at or after block `from`
+ * Input:
+ *  - from: first block to consider
+ *  - start: where the first block of the run is stored
+ * Returns: length of the run, 0 if there is no free block past `from`
+ * Must be called with free_blocks_lock held.
+ */
+static int free_blocks_next_run(size_t from, size_t *start) {
+    size_t w = from / BITMAP_WORD_BITS;
+    if (w >= BITMAP_WORDS) {
+        return 0;
+    }
+
+    /* Skip taken blocks */
+    uint64_t word = free_blocks[w] & (UINT64_MAX << (from % BITMAP_WORD_BITS));
+    while (word == 0) {
+        if (++w == BITMAP_WORDS) {
+            return 0;
+        }
+        if (w % BITMAP_WORDS_PER_BLOCK == 0) {
+            latency_charge(TFS_ACCESS_BITMAP); // access to free_blocks
+        }
+        word = free_blocks[w];
+    }
+    *start = w * BITMAP_WORD_BITS + (size_t)__builtin_ctzll(word);
+
+    /* Then find where the free blocks end (bits past DATA_BLOCKS are never
+     * free, so the run always stops inside the bitmap) */
+    word = ~free_blocks[w] & (UINT64_MAX << (*start % BITMAP_WORD_BITS));
+    while (word == 0) {
+        if (++w == BITMAP_WORDS) {
+            return (int)(DATA_BLOCKS - *start);
+        }
+        word = ~free_blocks[w];
+    }
+
+    return (int)(w * BITMAP_WORD_BITS + (size_t)__builtin_ctzll(word) -
+                 *start);
+}
+
+/*
+ * Takes up to count blocks off the free block count before they are
+ * allocated. Blocks reserved by delayed allocation buffers are never taken,
+ * except by the thread flushing one of them, which takes its own reserved
+ * blocks (see reserved_credit) first.
+ * Returns: number of blocks taken, which the allocation must not exceed
+ */
+static int data_block_claim(int count) {
+    int claimed = count < reserved_credit ? count : reserved_credit;
+    if (claimed > 0) {
+        /* Free blocks drop first, so that other claims never see the
+         * blocks as both unreserved and free */
+        atomic_fetch_sub(&free_block_count, claimed);
+        atomic_fetch_sub(&reserved_block_count, claimed);
+        reserved_credit -= claimed;
+    }
+
+    int free = atomic_load(&free_block_count);
+    int wanted;
+    do {
+        int unreserved = free - atomic_load(&reserved_block_count);
+        wanted = count - claimed < unreserved ? count - claimed : unreserved;
+        if (wanted <= 0) {
+            return claimed;
+        }
+    } while (!atomic_compare_exchange_weak(&free_block_count, &free,
+                                           free - wanted));
+
+    return claimed + wanted;
+}
+
+/*
+ * Gives back the blocks taken by data_block_claim that were not allocated
+ */
+static void data_block_unclaim(int count) {
+    if (count > 0) {
+        atomic_fetch_add(&free_block_count, count);
+    }
+}
+
+/*
+ * Allocates a run of contiguous data blocks (an extent)
+ * Input:
+ *  - count: number of blocks wanted
+ *  - start: where the first block of the extent is stored
+ * Returns: length of the extent, which is lower than count when there is no
+ * free run long enough (the longest one found is used), 0 if the FS is full
+ * (or its free blocks are reserved, see data_block_claim)
+ */
+int data_block_alloc_extent(int count, int *start) {
+    size_t best_start = 0;
+    int best_len = 0;
+
+    count = data_block_claim(count);
+
+    for (int attempt = 0; attempt < 2 && count > 0 && best_len == 0;
+         attempt++) {
+        if (attempt == 1) {
+            /* The bitmap is empty, but the pools may still hold free blocks */
+            block_pools_drain();
+        }
+
+        mutex_lock(&free_blocks_lock);
+        latency_charge(TFS_ACCESS_BITMAP); // access to free_blocks
+
+        size_t from = free_blocks_hint * BITMAP_WORD_BITS;
+        size_t run_start;
+        int run_len;
+        while (best_len < count &&
+               (run_len = free_blocks_next_run(from, &run_start)) > 0) {
+            if (run_len > best_len) {
+                best_start = run_start;
+                best_len = run_len < count ? run_len : count;
+            }
+            from = run_start + (size_t)run_len;
+        }
+
+        for (size_t b = best_start; b < best_start + (size_t)best_len; b++) {
+            free_blocks[b / BITMAP_WORD_BITS] &=
+                ~(UINT64_C(1) << (b % BITMAP_WORD_BITS));
+        }
+
+        mutex_unlock(&free_blocks_lock);
+    }
+
+    data_block_unclaim(count - best_len);
+    *start = (int)best_start;
+    return best_len;
+}
+
+static block_pool_t *block_pool_get() {
+    if (block_pool_shard == -1) {
+        block_pool_shard =
+            (int)(atomic_fetch_add(&block_pool_next_shard, 1) %
+                  BLOCK_POOL_SHARDS);
+    }
+
+    return &block_pools[block_pool_shard];
+}
+
+/*
+ * Returns every block cached in the pools to the bitmap.
+ * Used when the bitmap runs dry, so that blocks sitting in the pools of other
+ * threads are never reported as missing.
+ */
+void block_pools_drain() {
+    for (size_t i = 0; i < BLOCK_POOL_SHARDS; i++) {
+        mutex_lock(&block_pools[i].bp_lock);
+        if (block_pools[i].bp_count > 0) {
+            free_blocks_release(block_pools[i].bp_blocks,
+                                block_pools[i].bp_count);
+            block_pools[i].bp_count = 0;
+        }
+        mutex_unlock(&block_pools[i].bp_lock);
+    }
+}
+
+/*
+ * Allocated a new data block
+ * Returns: block index if successful, -1 otherwise
+ */
+int data_block_alloc() {
+    int block;
+
+    if (data_block_alloc_many(&block, 1) != 1) {
+        return -1;
+    }
+
+    return block;
+}
+
+/*
+ * Allocates up to count data blocks. Blocks come from the pool of the calling
+ * thread, which is refilled from the bitmap BLOCK_POOL_BATCH blocks at a time.
+ * Input:
+ *  - blocks: array where the allocated block indexes are stored
+ *  - count: number of blocks wanted
+ * Returns: number of blocks allocated (lower than count if the FS is full, or
+ * its free blocks are reserved, see data_block_claim)
+ */
+int data_block_alloc_many(int *blocks, int count) {
+    block_pool_t *pool = block_pool_get();
+    int allocated = 0;
+
+    count = data_block_claim(count);
+    if (count == 0) {
+        return 0;
+    }
+
+    mutex_lock(&pool->bp_lock);
+
+    while (allocated < count && pool->bp_count > 0) {
+        blocks[allocated++] = pool->bp_blocks[--pool->bp_count];
+    }
+
+    if (allocated < count && count - allocated < BLOCK_POOL_BATCH) {
+        /* Refill the (now empty) pool and serve the request from it */
+        pool->bp_count = free_blocks_take(pool->bp_blocks, BLOCK_POOL_BATCH);
+        while (allocated < count && pool->bp_count > 0) {
+            blocks[allocated++] = pool->bp_blocks[--pool->bp_count];
+        }
+    } else if (allocated < count) {
+        /* Large requests go straight to the bitmap */
+        allocated += free_blocks_take(blocks + allocated, count - allocated);
+    }
+
+    mutex_unlock(&pool->bp_lock);
+
+    if (allocated < count) {
+        /* The bitmap is empty, but other pools may still hold free blocks */
+        block_pools_drain();
+        allocated += free_blocks_take(blocks + allocated, count - allocated);
+    }
+
+    data_block_unclaim(count - allocated);
+    return allocated;
+}
+
+/* Frees a data block
+ * Input
+ * 	- the block index
+ * Returns: 0 if success, -1 otherwise
+ */
+int data_block_free(int *block_number) {
+    if (!valid_block_number(*block_number)) {
+        return -1;
+    }
+
+    block_pool_t *pool = block_pool_get();
+
+    mutex_lock(&pool->bp_lock);
+
+    if (pool->bp_count == BLOCK_POOL_CAPACITY) {
+        /* Pool is full, give the oldest batch back to the bitmap */
+        free_blocks_release(pool->bp_blocks, BLOCK_POOL_BATCH);
+        pool->bp_count -= BLOCK_POOL_BATCH;
+        memmove(pool->bp_blocks, pool->bp_blocks + BLOCK_POOL_BATCH,
+                (size_t)pool->bp_count * sizeof(int));
+    }
+    pool->bp_blocks[pool->bp_count++] = *block_number;
+
+    mutex_unlock(&pool->bp_lock);
+
+    atomic_fetch_add(&free_block_count, 1);
+    return 0;
+}
+
+/*
+ * Reserves free blocks for data that only gets its blocks later (see
+ * inode_delalloc_grow), so that they are not promised twice. Reserved blocks
+ * are still free, but no allocation other than the flush of the buffer they
+ * were reserved for takes them (see data_block_claim).
+ * Returns: 0 if successful, -1 if there are not enough unreserved free blocks
+ */
+static int data_block_reserve(int count) {
+    int reserved = atomic_load(&reserved_block_count);
+
+    do {
+        if (count > atomic_load(&free_block_count) - reserved) {
+            return -1;
+        }
+    } while (!atomic_compare_exchange_weak(&reserved_block_count, &reserved,
+                                           reserved + count));
+
+    return 0;
+}
+
+static void data_block_unreserve(int count) {
+    atomic_fetch_sub(&reserved_block_count, count);
+}
+
+/*
+ * Counts the free data blocks, both in the bitmap and cached in the pools.
+ * The count is exact as long as no allocation runs concurrently.
+ */
+int data_block_free_count() {
+    int count = 0;
+
+    for (size_t i = 0; i < BLOCK_POOL_SHARDS; i++) {
+        mutex_lock(&block_pools[i].bp_lock);
+        count += block_pools[i].bp_count;
+        mutex_unlock(&block_pools[i].bp_lock);
+    }
+
+    mutex_lock(&free_blocks_lock);
+    for (size_t w = 0; w < BITMAP_WORDS; w++) {
+        count += __builtin_popcountll(free_blocks[w]);
+    }
+    mutex_unlock(&free_blocks_lock);
+
+    return count;
+}
+
+/* Returns a pointer to the contents of a given block
+ * Input:
+ * 	- Block's index
+ * Returns: pointer to the first byte of the block, NULL otherwise
+ */
+void *data_block_get(int block_number) {
+    if (!valid_block_number(block_number)) {
+        return NULL;
+    }
+
+    bcache_access(block_number, 1);
+    return &fs_data[(size_t)block_number * BLOCK_SIZE];
+}
+
+/* Returns a pointer to the contents of a run of consecutive blocks, which
+ * are accessed as a whole (a single trip to storage for the ones that are not
+ * cached)
+ * Input:
+ * 	- first block's index and the number of blocks in the run
+ * Returns: pointer to the first byte of the run, NULL otherwise
+ */
+void *data_blocks_get(int first, int count) {
+    if (!valid_block_number(first) || count < 1 ||
+        count > (int)DATA_BLOCKS - first) {
+        return NULL;
+    }
+
+    bcache_access(first, count);
+    return &fs_data[(size_t)first * BLOCK_SIZE];
+}
+
+/*
+ * Returns the chunk of the open file table a handle belongs to, allocating
+ * it if it was never needed before
+ * Returns: the chunk if successful, NULL if there is no memory for it
+ */
+static open_file_chunk_t *open_file_chunk_get(size_t c) {
+    open_file_chunk_t *chunk = atomic_load(&open_file_chunks[c]);
+    if (chunk != NULL) {
+        return chunk;
+    }
+
+    chunk = malloc(sizeof(*chunk));
+    if (chunk == NULL) {
+        return NULL;
+    }
+    /* The last chunk may stop short of OPEN_FILE_CHUNK entries */
+    size_t entries = MAX_OPEN_FILES - c * OPEN_FILE_CHUNK;
+    for (size_t w = 0; w < OPEN_FILE_CHUNK_WORDS; w++) {
+        size_t first = w * BITMAP_WORD_BITS;
+        uint64_t word = 0;
+        if (first < entries) {
+            word = entries - first >= BITMAP_WORD_BITS
+                       ? UINT64_MAX
+                       : ((uint64_t)1 << (entries - first)) - 1;
+        }
+        atomic_init(&chunk->fc_free[w], word);
+    }
+    for (size_t i = 0; i < OPEN_FILE_CHUNK; i++) {
+        init_mlock(&chunk->fc_entries[i].of_lock);
+    }
+
+    /* Another thread may have allocated it meanwhile */
+    open_file_chunk_t *current = NULL;
+    if (!atomic_compare_exchange_strong(&open_file_chunks[c], &current,
+                                        chunk)) {
+        open_file_chunk_free(chunk);
+        return current;
+    }
+    return chunk;
+}
+
+/* Returns the entry of an open file handle, NULL if it was never taken */
+static open_file_entry_t *open_file_entry(int fhandle,
+                                          open_file_chunk_t **chunk) {
+    if (!valid_file_handle(fhandle)) {
+        return NULL;
+    }
+    *chunk = atomic_load(&open_file_chunks[(size_t)fhandle / OPEN_FILE_CHUNK]);
+    if (*chunk == NULL) {
+        return NULL;
+    }
+    return &(*chunk)->fc_entries[(size_t)fhandle % OPEN_FILE_CHUNK];
+}
+
+/* Tells whether an entry of the open file table is taken */
+static bool open_file_taken(open_file_chunk_t *chunk, int fhandle) {
+    size_t i = (size_t)fhandle % OPEN_FILE_CHUNK;
+    return !(atomic_load(&chunk->fc_free[i / BITMAP_WORD_BITS]) &
+             (uint64_t)1 << i % BITMAP_WORD_BITS);
+}
+
+/*
+ * Claims a free entry of the open file table, in the first chunk from the
+ * given one on that has any, moving the hint past the full chunks if asked
+ * Returns: the entry if successful (and its handle in fhandle), NULL if the
+ * table is full
+ */
+static open_file_entry_t *open_file_claim(size_t first, bool move_hint,
+                                          int *fhandle) {
+    for (size_t c = first; c < OPEN_FILE_CHUNKS; c++) {
+        open_file_chunk_t *chunk = open_file_chunk_get(c);
+        if (chunk == NULL) {
+            return NULL;
+        }
+
+        for (size_t w = 0; w < OPEN_FILE_CHUNK_WORDS; w++) {
+            uint64_t word = atomic_load(&chunk->fc_free[w]);
+            while (word != 0) {
+                uint64_t bit = (uint64_t)1 << __builtin_ctzll(word);
+                if (atomic_compare_exchange_weak(&chunk->fc_free[w], &word,
+                                                 word & ~bit)) {
+                    size_t i = w * BITMAP_WORD_BITS +
+                               (size_t)__builtin_ctzll(bit);
+                    *fhandle = (int)(c * OPEN_FILE_CHUNK + i);
+                    return &chunk->fc_entries[i];
+                }
+            }
+        }
 
-    if (!valid_file_handle(fhandle) ||
-        free_open_file_entries[fhandle] != TAKEN) {
-        rw_unlock(&inode->i_lock);
+        size_t full = c;
+        if (move_hint) {
+            atomic_compare_exchange_strong(&open_file_hint, &full, c + 1);
+        }
+    }
+
+    return NULL;
+}
+
+/* Add new entry to the open file table
+ * Inputs:
+ * 	- I-node number of the file to open
+ * 	- Initial offset
+ * Returns: file handle if successful, -1 otherwise
+ */
+int add_to_open_file_table(int inumber, size_t offset) {
+    if (inode_get(inumber) == NULL) {
+        return -1;
+    }
+
+    /* Counted before the i-node is checked, so that an unlink either sees
+     * the handle or has already claimed the i-node (see
+     * inode_delete_claim) */
+    int open = atomic_load(&inode_open_count[inumber]);
+    do {
+        if (open == OPEN_COUNT_DELETING) {
+            return -1;
+        }
+    } while (!atomic_compare_exchange_weak(&inode_open_count[inumber], &open,
+                                           open + 1));
+    if (freeinode_ts[inumber] != TAKEN) {
+        atomic_fetch_sub(&inode_open_count[inumber], 1);
+        return -1;
+    }
+
+    int fhandle;
+    size_t hint = atomic_load(&open_file_hint);
+    open_file_entry_t *file = open_file_claim(hint, true, &fhandle);
+    /* An entry freed while the hint moved past its chunk is only found by
+     * going through the whole table */
+    if (file == NULL && hint > 0) {
+        file = open_file_claim(0, false, &fhandle);
+    }
+    if (file == NULL) {
+        atomic_fetch_sub(&inode_open_count[inumber], 1);
+        return -1;
+    }
+
+    /* The entry is ours; nobody else touches it until it is returned by
+     * tfs_open */
+    file->of_inumber = inumber;
+    file->of_offset = offset;
+    file->of_ra_next = offset;
+    file->of_ra_window = 0;
+    file->of_ra_end = 0;
+
+    return fhandle;
+}
+
+/* Frees an entry from the open file table
+ * Inputs:
+ * 	- file handle to free/close
+ * Returns 0 is success, -1 otherwise (the entry is still freed if the only
+ * failure was flushing the file's delayed allocation buffer)
+ */
+int remove_from_open_file_table(int fhandle) {
+    /* Waits for the operations in progress on the handle */
+    open_file_entry_t *file = get_open_file_entry(fhandle);
+    if (file == NULL) {
         return -1;
     }
-    free_open_file_entries[fhandle] = FREE;
 
-    mutex_unlock(&free_open_file_entries_lock);
+    /* The last handle to a file flushes its delayed allocation buffer, and
+     * only stops counting once the buffer is flushed, under the i-node's
+     * write lock, so that neither a write nor an unlink (see
+     * inode_delete_claim) gets in between */
+    int inumber = file->of_inumber;
+    int r = 0;
+    int open = atomic_load(&inode_open_count[inumber]);
+    while (open > 1 && !atomic_compare_exchange_weak(
+                           &inode_open_count[inumber], &open, open - 1)) {
+    }
+    if (open <= 1) {
+        inode_t *inode = inode_get(inumber);
+        write_lock(&inode->i_lock);
+        r = inode_delalloc_flush(inode);
+        atomic_fetch_sub(&inode_open_count[inumber], 1);
+        rw_unlock(&inode->i_lock);
+    }
 
+    /* Freed before the lock is released, so that an operation waiting for
+     * it finds the handle closed */
+    size_t c = (size_t)fhandle / OPEN_FILE_CHUNK;
+    size_t i = (size_t)fhandle % OPEN_FILE_CHUNK;
+    open_file_chunk_t *chunk = atomic_load(&open_file_chunks[c]);
+    atomic_fetch_or(&chunk->fc_free[i / BITMAP_WORD_BITS],
+                    (uint64_t)1 << i % BITMAP_WORD_BITS);
     mutex_unlock(&file->of_lock);
-    rw_unlock(&inode->i_lock);
 
-    return 0;
+    size_t hint = atomic_load(&open_file_hint);
+    while (c < hint &&
+           !atomic_compare_exchange_weak(&open_file_hint, &hint, c)) {
+    }
+
+    return r;
+}
+
+static bool range_conflicts(range_lock_t const *lock,
+                            inode_range_t const *range) {
+    for (inode_range_t const *held = lock->rl_held; held != NULL;
+         held = held->ir_next) {
+        if ((held->ir_write || range->ir_write) &&
+            held->ir_first <= range->ir_last &&
+            range->ir_first <= held->ir_last) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Wakes up the threads waiting for ranges of a file, if there are any
+ * Must be called with rl_lock held.
+ */
+static void range_wake(range_lock_t *lock) {
+    if (atomic_load(&lock->rl_waiters) > 0) {
+        pthread_cond_broadcast(&lock->rl_released);
+    }
+}
+
+/*
+ * Releases a range held by a reader without rl_lock; the last one wakes up
+ * the writers waiting for such readers to leave
+ */
+static void range_fast_release(range_lock_t *lock) {
+    if (atomic_fetch_sub(&lock->rl_readers, 1) == 1 &&
+        atomic_load(&lock->rl_waiters) > 0) {
+        mutex_lock(&lock->rl_lock);
+        pthread_cond_broadcast(&lock->rl_released);
+        mutex_unlock(&lock->rl_lock);
+    }
+}
+
+/*
+ * Locks the blocks of a file that a read or write touches, waiting for
+ * the overlapping ranges held by writers (or, to write, by anyone) to be
+ * released. Writers and readers of disjoint ranges do not wait for each
+ * other. While no writer holds or waits for a range of the file, readers
+ * only count themselves in rl_readers, without taking rl_lock; a writer
+ * waits for all of them to leave.
+ * Input:
+ *  - inumber: the file's i-node
+ *  - offset, len: the bytes read or written
+ *  - write: whether the range is locked for writing
+ *  - range: kept by the caller until inode_range_unlock
+ */
+void inode_range_lock(int inumber, size_t offset, size_t len, bool write,
+                      inode_range_t *range) {
+    range_lock_t *lock = &range_locks[inumber];
+    size_t last = len == 0                       ? offset
+                  : len - 1 > SIZE_MAX - offset ? SIZE_MAX
+                                                : offset + len - 1;
+
+    range->ir_first = offset / BLOCK_SIZE;
+    range->ir_last = last / BLOCK_SIZE;
+    range->ir_write = write;
+
+    if (!write) {
+        /* Counted before writers are checked, and writers count themselves
+         * before checking readers, so that one of them always sees the
+         * other */
+        atomic_fetch_add(&lock->rl_readers, 1);
+        if (atomic_load(&lock->rl_writers) == 0) {
+            range->ir_fast = true;
+            return;
+        }
+        range_fast_release(lock);
+    }
+    range->ir_fast = false;
+
+    mutex_lock(&lock->rl_lock);
+    if (write) {
+        atomic_fetch_add(&lock->rl_writers, 1);
+    }
+    atomic_fetch_add(&lock->rl_waiters, 1);
+    while (range_conflicts(lock, range) ||
+           (write && atomic_load(&lock->rl_readers) > 0)) {
+        pthread_cond_wait(&lock->rl_released, &lock->rl_lock);
+    }
+    atomic_fetch_sub(&lock->rl_waiters, 1);
+    range->ir_next = lock->rl_held;
+    lock->rl_held = range;
+    mutex_unlock(&lock->rl_lock);
+}
+
+void inode_range_unlock(int inumber, inode_range_t *range) {
+    range_lock_t *lock = &range_locks[inumber];
+
+    if (range->ir_fast) {
+        range_fast_release(lock);
+        return;
+    }
+
+    mutex_lock(&lock->rl_lock);
+    inode_range_t **link = &lock->rl_held;
+    while (*link != range) {
+        link = &(*link)->ir_next;
+    }
+    *link = range->ir_next;
+    if (range->ir_write) {
+        atomic_fetch_sub(&lock->rl_writers, 1);
+    }
+    range_wake(lock);
+    mutex_unlock(&lock->rl_lock);
+}
+
+/*
+ * Pins the blocks of an i-node, so that they are not freed (by truncating or
+ * deleting it) until it is unpinned. The caller must hold the i-node's lock,
+ * so that the pin can not race with a truncate.
+ */
+void inode_pin(int inumber) {
+    if (valid_inumber(inumber)) {
+        atomic_fetch_add(&inode_pin_count[inumber], 1);
+    }
+}
+
+void inode_unpin(int inumber) {
+    if (valid_inumber(inumber)) {
+        atomic_fetch_sub(&inode_pin_count[inumber], 1);
+    }
+}
+
+/*
+ * Tells whether the blocks of an i-node are pinned
+ */
+bool inode_is_pinned(int inumber) {
+    return valid_inumber(inumber) &&
+           atomic_load(&inode_pin_count[inumber]) > 0;
+}
+
+/*
+ * Returns the inumber behind an open file handle without taking the entry's
+ * lock, for operations that do not use the handle's offset. The handle must
+ * stay open while the inumber is in use.
+ * Inputs:
+ * 	- file handle
+ * Returns: the inumber if the handle is open, -1 otherwise
+ */
+int open_file_inumber(int fhandle) {
+    open_file_chunk_t *chunk;
+    open_file_entry_t *file = open_file_entry(fhandle, &chunk);
+    if (file == NULL || !open_file_taken(chunk, fhandle)) {
+        return -1;
+    }
+
+    return file->of_inumber;
 }
 
-/* Returns pointer to a given entry in the open file table
+/*
+ * Tells whether an i-node is referred to by the open file table
+ */
+bool inode_is_open(int inumber) {
+    return valid_inumber(inumber) && atomic_load(&inode_open_count[inumber]) > 0;
+}
+
+/* Returns pointer to a given entry in the open file table, locked
  * Inputs:
  * 	 - file handle
- * Returns: pointer to the entry if sucessful, NULL otherwise
+ * Returns: pointer to the entry if the handle is open, NULL otherwise
  */
 open_file_entry_t *get_open_file_entry(int fhandle) {
-    if (!valid_file_handle(fhandle)) {
+    open_file_chunk_t *chunk;
+    open_file_entry_t *file = open_file_entry(fhandle, &chunk);
+    if (file == NULL) {
         return NULL;
     }
-    open_file_entry_t *file = &open_file_table[fhandle];
 
-    if(file == NULL)
-        return NULL;
-    
     mutex_lock(&file->of_lock);
+    if (!open_file_taken(chunk, fhandle)) {
+        mutex_unlock(&file->of_lock);
+        return NULL;
+    }
 
-    return &open_file_table[fhandle];
+    return file;
 }
 
 /*
@@ -442,6 +2342,124 @@ int allocate_block_aux(int *block) {
     return 0;
 }
 
+/*
+ * Returns the entries of the indirect block referenced by slot, allocating
+ * the block (with every entry unused, -1) if it is missing and alloc is set
+ * Returns: pointer to the entries, NULL if the block is missing or the FS is
+ * full
+ */
+static int *indirect_block_get(int *slot, bool alloc) {
+    if (*slot != -1) {
+        return (int *)data_block_get(*slot);
+    }
+    if (!alloc) {
+        return NULL;
+    }
+
+    int b = data_block_alloc();
+    if (b == -1) {
+        return NULL;
+    }
+
+    int *entries = (int *)data_block_get(b);
+    for (size_t i = 0; i < INODE_INDIRECT_ENTRIES; i++) {
+        entries[i] = -1;
+    }
+
+    *slot = b;
+    return entries;
+}
+
+/*
+ * Finds the slot that holds the block number of file block `index`, walking
+ * down the indirect blocks that lead to it, so that the cost only depends on
+ * the number of levels
+ * Inputs:
+ *  - inode: inode to look in
+ *  - index: file block index (below MAX_FILE_BLOCKS)
+ *  - alloc: whether missing indirect blocks on the way are allocated
+ *  - run: set to the number of file blocks, from index on, whose slots follow
+ *    the returned one in the same array (or that are all unmapped, when the
+ *    slot is missing)
+ * Returns: pointer to the slot, NULL if an indirect block on the way is
+ * missing (and alloc is not set) or could not be allocated
+ */
+static int *inode_block_slot(inode_t *inode, int index, bool alloc, int *run) {
+    if (index < INODE_DIRECT_BLOCKS) {
+        *run = INODE_DIRECT_BLOCKS - index;
+        return &inode->i_data_direct_blocks[index];
+    }
+    index -= INODE_DIRECT_BLOCKS;
+
+    /* The tree of level l holds entries^(l+1) blocks */
+    int64_t entries = (int64_t)INODE_INDIRECT_ENTRIES;
+    int64_t covered = entries;
+    int level = 0;
+    while (index >= covered) {
+        index -= (int)covered;
+        covered *= entries;
+        level++;
+    }
+
+    int *slot = &inode->i_data_indirect_blocks[level];
+    for (;;) {
+        int *block = indirect_block_get(slot, alloc);
+        if (block == NULL) {
+            *run = (int)(covered - index < INT_MAX ? covered - index : INT_MAX);
+            return NULL;
+        }
+
+        /* Number of file blocks under each entry of this block */
+        covered /= entries;
+        slot = &block[index / covered];
+        if (covered == 1) {
+            *run = (int)(entries - index);
+            return slot;
+        }
+        index = (int)(index % covered);
+    }
+}
+
+/*
+ * Counts the indirect blocks that mapping file blocks from up to to (not
+ * included) would allocate, given the blocks the i-node has now. Each one is
+ * counted at the first block under it from file block first on, so that a
+ * range that grows from first is only charged for the indirect blocks its
+ * new blocks add.
+ */
+static int index_blocks_missing(inode_t *inode, int first, int from, int to) {
+    int64_t entries = (int64_t)INODE_INDIRECT_ENTRIES;
+    int missing = 0;
+
+    for (int b = from > INODE_DIRECT_BLOCKS ? from : INODE_DIRECT_BLOCKS;
+         b < to; b++) {
+        /* The tree of level l holds entries^(l+1) blocks */
+        int64_t index = b - INODE_DIRECT_BLOCKS;
+        int64_t covered = entries;
+        int level = 0;
+        while (index >= covered) {
+            index -= covered;
+            covered *= entries;
+            level++;
+        }
+
+        /* Walk down the tree, through the indirect blocks that exist */
+        int const *slot = &inode->i_data_indirect_blocks[level];
+        for (int64_t under = covered; under >= entries; under /= entries) {
+            int const *block =
+                slot == NULL || *slot == -1 ? NULL
+                                            : (int const *)data_block_get(*slot);
+            if (block == NULL && (index % under == 0 || b == first)) {
+                missing++;
+            }
+            slot = block == NULL ? NULL
+                                 : &block[index % under / (under / entries)];
+        }
+    }
+
+    return missing;
+}
+
 /*
  *  Iterates data blocks, applying the effect of a given function
  *  Inputs:
@@ -455,99 +2473,337 @@ int allocate_block_aux(int *block) {
  */
 int iterate_blocks(inode_t *inode, int current, int end,
                    int (*foo)(int *block)) {
-    if (current > end)
+    if (current < 0 || current > end || end > MAX_FILE_BLOCKS)
         return -1;
 
-    // The first block to access is on the first 10 blocks,
-    // which can be accessed directly
-    while (current < 10 && current < end) {
-        if (foo(&inode->i_data_direct_blocks[current++]) == -1) {
+    while (current < end) {
+        int run;
+        int *slots = inode_block_slot(inode, current, true, &run);
+        if (slots == NULL)
             return -1;
+
+        for (int i = 0; i < run && current < end; i++, current++) {
+            if (foo(&slots[i]) == -1) {
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Looks up the data blocks behind a range of file blocks, walking the
+ * indirect blocks once for each array of slots the range goes through
+ * Inputs:
+ *  - inode: inode to look in
+ *  - first: index of the first file block
+ *  - count: number of file blocks
+ *  - blocks: where the block numbers are stored (-1 for unmapped blocks)
+ * Returns: 0 if successful, -1 otherwise
+ */
+int inode_block_map(inode_t *inode, int first, int count, int *blocks) {
+    if (first < 0 || count < 0 || count > MAX_FILE_BLOCKS - first) {
+        return -1;
+    }
+
+    for (int i = 0; i < count;) {
+        int run;
+        int *slots = inode_block_slot(inode, first + i, false, &run);
+        for (int j = 0; j < run && i < count; j++, i++) {
+            blocks[i] = slots == NULL ? -1 : slots[j];
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Maps a range of file blocks, allocating the missing ones (see
+ * inode_block_alloc)
+ */
+static int block_map_alloc(inode_t *inode, int first, int count,
+                           int *blocks) {
+    for (int i = 0, run; i < count; i += run) {
+        if (inode_block_slot(inode, first + i, true, &run) == NULL) {
+            count = i;
+        }
+    }
+
+    int i = 0;
+    while (i < count) {
+        int run;
+        int *slots = inode_block_slot(inode, first + i, false, &run);
+        if (run > count - i) {
+            run = count - i;
+        }
+
+        for (int j = 0; j < run;) {
+            if (slots[j] != -1) {
+                if (blocks != NULL) {
+                    blocks[i] = slots[j];
+                }
+                i++;
+                j++;
+                continue;
+            }
+
+            /* Allocate the whole run of unmapped blocks as one extent */
+            int missing = 1;
+            while (j + missing < run && slots[j + missing] == -1) {
+                missing++;
+            }
+
+            int start;
+            int got = data_block_alloc_extent(missing, &start);
+            if (got == 0) {
+                return i;
+            }
+
+            for (int k = 0; k < got; k++) {
+                slots[j++] = start + k;
+                if (blocks != NULL) {
+                    blocks[i] = start + k;
+                }
+                i++;
+            }
         }
     }
 
-    // iterate throw direct block on indirect block
-    // Get indirect block data to access direct block
-    if (end < 10)
+    return i;
+}
+
+/*
+ * Makes sure a range of file blocks is backed by data blocks. The indirect
+ * blocks the range needs are allocated first, and then each run of unmapped
+ * file blocks is given a single extent, so that a large write ends up in
+ * contiguous blocks whenever the FS has room for them.
+ * Inputs:
+ *  - inode: inode to grow
+ *  - first: index of the first file block
+ *  - count: number of file blocks
+ *  - blocks: where the block numbers are stored (NULL if they are not
+ *    needed, to map a range of any length)
+ * Returns: number of file blocks (from first on) that are mapped, which is
+ * lower than count when the FS is full or the maximum file size is reached
+ */
+int inode_block_alloc(inode_t *inode, int first, int count, int *blocks) {
+    if (first < 0 || first >= MAX_FILE_BLOCKS) {
+        return 0;
+    }
+    if (count > MAX_FILE_BLOCKS - first) {
+        count = MAX_FILE_BLOCKS - first;
+    }
+
+    /* The block map root only changes on the way to the blocks */
+    inode_meta_write_begin(inode);
+    int mapped = block_map_alloc(inode, first, count, blocks);
+    inode_meta_write_end(inode);
+
+    return mapped;
+}
+
+
+/*
+ * Frees a data block and, for an indirect block, every block under it
+ * Inputs:
+ *  - block: slot holding the block number, set to -1 once it is freed
+ *  - depth: levels of indirect blocks from this one down to the data blocks
+ * Returns: 0 if successful, -1 otherwise
+ */
+static int block_tree_free(int *block, int depth) {
+    if (*block == -1) {
         return 0;
+    }
 
-    if (inode->i_data_indirect_block == -1)
-        if ((inode->i_data_indirect_block = data_block_alloc()) == -1)
+    if (depth > 0) {
+        int *entries = (int *)data_block_get(*block);
+        if (entries == NULL) {
             return -1;
-    int *direct_block = (int *)data_block_get(inode->i_data_indirect_block);
-    if (direct_block == NULL)
+        }
+
+        for (size_t i = 0; i < INODE_INDIRECT_ENTRIES; i++) {
+            if (block_tree_free(&entries[i], depth - 1) == -1) {
+                return -1;
+            }
+        }
+    }
+
+    if (data_block_free(block) == -1) {
         return -1;
-    while (current < end) {
-        // maybe check if the block isn't free?
-        if (foo(direct_block) == -1)
-            return -1; // Oh no, something went wrong.
-        direct_block += sizeof(int);
-        current++;
     }
+    *block = -1;
 
     return 0;
 }
 
 /*
-    Writes data on block
-    Inputs:
-        - of_offset: Offset of the file handle
-        - block_offset: Where in the block to start writting
-        - to_write: Amount of data to write in block
-        - block: Block to write on
-        - buffer: Input buffer
-        - buffer_offset: Offset in the buffer to start reading from
-        - inode: inode
-    Output:
-        0: Everything went fine
-        -1: Error
-*/
-int write_to_block(size_t *of_offset, int block_offset, size_t *to_write,
-                   void *block, void const *buffer, size_t buffer_offset,
-                   inode_t *inode) {
-    /* Perform the actual write */
-    // size_t to_write_in_block =
-    //     (size_t)((int)to_write % BLOCK_SIZE - initial_offset);
-
-    size_t to_write_in_block = (*to_write > BLOCK_SIZE)
-                                   ? (size_t)(BLOCK_SIZE - block_offset)
-                                   : (size_t)((int)*to_write - block_offset);
-
-    *to_write -= to_write_in_block;
-    memcpy(block + block_offset, buffer + buffer_offset, to_write_in_block);
-
-    /* The offset associated with the file handle is
-     * incremented accordingly */
-    *of_offset += to_write_in_block;
-    if ((size_t)*of_offset > inode->i_size) {
-        inode->i_size = (size_t)*of_offset;
+ * Frees every data block of an inode (including its indirect blocks) and sets
+ * its size to 0. The caller must hold the inode's write lock.
+ * Returns: 0 if successful, -1 otherwise (also when a read mapping pins the
+ * inode's blocks)
+ */
+int inode_truncate(inode_t *inode) {
+    if (inode_is_pinned((int)(inode - inode_table))) {
+        return -1;
     }
 
-    return 0;
+    delalloc_discard(&delallocs[inode - inode_table]);
+
+    int r = 0;
+    inode_meta_write_begin(inode);
+    for (int i = 0; i < INODE_DIRECT_BLOCKS && r == 0; i++) {
+        r = block_tree_free(&inode->i_data_direct_blocks[i], 0);
+    }
+    for (int level = 0; level < INODE_INDIRECT_LEVELS && r == 0; level++) {
+        r = block_tree_free(&inode->i_data_indirect_blocks[level], level + 1);
+    }
+    if (r == 0) {
+        inode->i_size = 0;
+    }
+    inode_meta_write_end(inode);
+
+    return r;
 }
 
-/* TODO: fix comment
-    Reads data from block
-    Inputs:
-        - of_offset: Where in the block to start reading from
-        - to_read: Amount of data to read from block
-        - block: Block to write on
-        - buffer: Output buffer
-        - buffer_offset: Offset in the buffer to start writting on
-    Output:
-        0: Everything went fine
-        -1: Error
-*/
-int read_from_block(int offset, size_t *to_read, void *block, void *buffer,
-                    size_t buffer_offset) {
-    /* Perform the actual read */
-    size_t to_read_from_block = (*to_read > BLOCK_SIZE)
-                                    ? (size_t)(BLOCK_SIZE - offset)
-                                    : (size_t)((int)*to_read - offset);
-
-    *to_read -= to_read_from_block;
-
-    memcpy(buffer + buffer_offset, block + offset, to_read_from_block);
+/*
+ * Drops a delayed allocation buffer, and its reservation
+ */
+static void delalloc_discard(delalloc_t *da) {
+    free(da->da_data);
+    atomic_fetch_sub(&delalloc_bytes, da->da_capacity);
+    data_block_unreserve(da->da_reserved);
+    *da = (delalloc_t){0};
+}
 
-    return 0;
-}
\ No newline at end of file
+/*
+ * Returns the delayed allocation buffer of an i-node (its da_data is NULL if
+ * it has none). The caller must hold the i-node's lock.
+ */
+delalloc_t const *inode_delalloc(inode_t const *inode) {
+    return &delallocs[inode - inode_table];
+}
+
+/*
+ * Makes room in the delayed allocation buffer of an i-node for the file
+ * contents from start up to end, reserving blocks for them. An i-node with no
+ * buffer gets one that starts at start, which must be at a block boundary
+ * past the last block of the file; otherwise start must be the buffer's.
+ * The caller must hold the i-node's write lock.
+ * Input:
+ *  - inode: the file's i-node
+ *  - start, end: range of file offsets the buffer must hold
+ * Returns: the buffer's data (holding offset start at index 0) if successful,
+ * NULL if the range is longer than DELALLOC_MAX_BLOCKS, or there is no memory
+ * (or room under DELALLOC_MAX_BYTES) or free blocks left for it
+ */
+char *inode_delalloc_grow(inode_t *inode, size_t start, size_t end) {
+    delalloc_t *da = &delallocs[inode - inode_table];
+    size_t blocks = (end - start + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+    if (blocks > DELALLOC_MAX_BLOCKS) {
+        return NULL;
+    }
+
+    /* Blocks the range gained need reserving, along with the indirect
+     * blocks the flush would have to allocate for them */
+    if ((int)blocks > da->da_blocks) {
+        int first = (int)(start / BLOCK_SIZE);
+        int reserve = (int)blocks - da->da_blocks +
+                      index_blocks_missing(inode, first,
+                                           first + da->da_blocks,
+                                           first + (int)blocks);
+        if (data_block_reserve(reserve) == -1) {
+            return NULL;
+        }
+        da->da_reserved += reserve;
+        da->da_blocks = (int)blocks;
+    }
+
+    if (blocks * BLOCK_SIZE > da->da_capacity) {
+        /* Grow geometrically, so that appends copy the buffer O(log n) times
+         */
+        size_t capacity = da->da_capacity * 2;
+        if (capacity < blocks * BLOCK_SIZE) {
+            capacity = blocks * BLOCK_SIZE;
+        }
+        if (capacity > DELALLOC_MAX_BLOCKS * BLOCK_SIZE) {
+            capacity = DELALLOC_MAX_BLOCKS * BLOCK_SIZE;
+        }
+
+        size_t growth = capacity - da->da_capacity;
+        if (atomic_fetch_add(&delalloc_bytes, growth) + growth >
+            DELALLOC_MAX_BYTES) {
+            atomic_fetch_sub(&delalloc_bytes, growth);
+            return NULL;
+        }
+        char *data = realloc(da->da_data, capacity);
+        if (data == NULL) {
+            atomic_fetch_sub(&delalloc_bytes, growth);
+            return NULL;
+        }
+        da->da_data = data;
+        da->da_capacity = capacity;
+    }
+
+    da->da_start = start;
+    return da->da_data;
+}
+
+/*
+ * Flushes the delayed allocation buffer of an i-node: its contents get
+ * blocks, allocated together so that they end up contiguous when the bitmap
+ * allows, and are copied there. The caller must hold the i-node's write lock.
+ * Returns: 0 if successful (or there was nothing to flush), -1 if the FS ran
+ * out of blocks, in which case the file is cut short at the data that fit
+ */
+int inode_delalloc_flush(inode_t *inode) {
+    delalloc_t *da = &delallocs[inode - inode_table];
+    int blocks[DELALLOC_MAX_BLOCKS];
+
+    if (da->da_data == NULL) {
+        return 0;
+    }
+
+    /* The reservation turns into the allocation: the blocks it holds can
+     * only be taken by this flush */
+    reserved_credit = da->da_reserved;
+    da->da_reserved = 0;
+
+    size_t len = inode->i_size - da->da_start;
+    int first = (int)(da->da_start / BLOCK_SIZE);
+    int count = (int)((len + BLOCK_SIZE - 1) / BLOCK_SIZE);
+    int mapped = count == 0 ? 0 : inode_block_alloc(inode, first, count, blocks);
+    data_block_unreserve(reserved_credit);
+    reserved_credit = 0;
+
+    size_t done = 0;
+    for (int i = 0; i < mapped;) {
+        int run = 1;
+        while (i + run < mapped && blocks[i + run] == blocks[i] + run) {
+            run++;
+        }
+        char *data = data_blocks_get(blocks[i], run);
+        if (data == NULL) {
+            break;
+        }
+
+        size_t n = (size_t)run * BLOCK_SIZE;
+        if (n > len - done) {
+            n = len - done;
+        }
+        memcpy(data, da->da_data + done, n);
+
+        done += n;
+        i += run;
+    }
+
+    int r = 0;
+    if (done < len) {
+        inode_size_set(inode, da->da_start + done);
+        r = -1;
+    }
+
+    delalloc_discard(da);
+    return r;
+}
@@ -2,12 +2,37 @@
 #define STATE_H
 
 #include "config.h"
+#include "latency.h"
 #include "lock.h"
 
+#include <stdatomic.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/types.h>
 
+/*
+ * FS geometry, chosen when the FS is initialized (see tfs_init)
+ */
+typedef struct {
+    size_t block_size;         /* bytes per data block */
+    size_t data_blocks;        /* number of data blocks */
+    size_t inode_table_size;   /* number of i-nodes */
+    size_t max_open_files;     /* most file handles open at once */
+    size_t block_cache_blocks; /* frames of the block cache (see bcache.h) */
+    char const *image_path;    /* volume image file, NULL to keep the FS
+                                  only in memory */
+    tfs_latency_t latency;     /* storage latency model */
+} tfs_params_t;
+
+/* Geometry of the running FS; the macros below read it */
+extern tfs_params_t fs_params;
+
+#define BLOCK_SIZE (fs_params.block_size)
+#define DATA_BLOCKS (fs_params.data_blocks)
+#define INODE_TABLE_SIZE (fs_params.inode_table_size)
+#define MAX_OPEN_FILES (fs_params.max_open_files)
+
 /*
  * Directory entry
  */
@@ -18,18 +43,66 @@ typedef struct {
 
 typedef enum { T_FILE, T_DIRECTORY } inode_type;
 
+/* Block map: direct blocks in the i-node, followed by a single, a double and
+ * a triple indirect block. An indirect block holds the numbers of the blocks
+ * one level below it, down to the data blocks. */
+#define INODE_DIRECT_BLOCKS (10)
+#define INODE_INDIRECT_LEVELS (3)
+#define INODE_INDIRECT_ENTRIES (BLOCK_SIZE / sizeof(int))
+
+/* Number of blocks a file can have with the running geometry (file block
+ * indexes are ints, so it never goes past INT_MAX) */
+extern int fs_max_file_blocks;
+#define MAX_FILE_BLOCKS (fs_max_file_blocks)
+
 /*
  * I-node
  */
 typedef struct {
     inode_type i_node_type;
     size_t i_size;
-    int i_data_direct_blocks[10];
-    int i_data_indirect_block;
+    int i_data_direct_blocks[INODE_DIRECT_BLOCKS];
+    int i_data_indirect_blocks[INODE_INDIRECT_LEVELS];
     pthread_rwlock_t i_lock;
+    atomic_uint i_seq; /* metadata sequence counter (see inode_meta_read) */
     /* in a real FS, more fields would exist here */
 } inode_t;
 
+/*
+ * Snapshot of an i-node's metadata (see inode_meta_read)
+ */
+typedef struct {
+    inode_type im_type;
+    size_t im_size;
+    int im_direct_blocks[INODE_DIRECT_BLOCKS];
+    int im_indirect_blocks[INODE_INDIRECT_LEVELS];
+} inode_meta_t;
+
+/*
+ * Delayed allocation buffer of a file: data appended past the last block the
+ * file has is kept here, and only gets blocks, in one go, when the buffer is
+ * flushed (see inode_delalloc_flush)
+ */
+typedef struct {
+    char *da_data;      /* file contents from da_start up to i_size */
+    size_t da_start;    /* offset of da_data[0], at a block boundary */
+    size_t da_capacity; /* bytes da_data can hold */
+    int da_reserved;    /* free blocks reserved for the flush */
+    int da_blocks;      /* blocks of data the reservation covers */
+} delalloc_t;
+
+/*
+ * Range of blocks of a file locked for reading or writing (see
+ * inode_range_lock), kept by the locking thread until it unlocks it
+ */
+typedef struct inode_range {
+    struct inode_range *ir_next;
+    size_t ir_first; /* first block */
+    size_t ir_last;  /* last block */
+    bool ir_write;
+    bool ir_fast; /* held without the i-node's range list (readers only) */
+} inode_range_t;
+
 typedef enum { FREE = 0, TAKEN = 1 } allocation_state_t;
 
 /*
@@ -38,38 +111,62 @@ typedef enum { FREE = 0, TAKEN = 1 } allocation_state_t;
 typedef struct {
     int of_inumber;
     size_t of_offset;
+    /* Readahead (see tfs_readv) */
+    size_t of_ra_next; /* offset the next sequential read starts at */
+    int of_ra_window;  /* blocks to read ahead, 0 if not reading sequentially */
+    int of_ra_end;     /* file block up to which readahead was queued */
     pthread_mutex_t of_lock;
 } open_file_entry_t;
 
-#define MAX_DIR_ENTRIES (BLOCK_SIZE / sizeof(dir_entry_t))
+/* Directories keep their entries in data blocks, just like file contents */
+#define DIR_ENTRIES_PER_BLOCK ((int)(BLOCK_SIZE / sizeof(dir_entry_t)))
 
-void state_init();
+int state_init(tfs_params_t const *params);
 void state_destroy();
 
 int inode_create(inode_type n_type);
 int inode_delete(int inumber);
 inode_t *inode_get(int inumber);
+int inode_meta_read(int inumber, inode_meta_t *meta);
+void inode_size_set(inode_t *inode, size_t size);
+bool inode_exists(int inumber);
 
 int free_block_aux(int *block);
 int allocate_block_aux(int *block);
 int iterate_blocks(inode_t *inode, int start, int end, int (*f)(int *block));
-
-int clear_dir_entry(int inumber, int sub_inumber);
+int inode_block_map(inode_t *inode, int first, int count, int *blocks);
+int inode_block_alloc(inode_t *inode, int first, int count, int *blocks);
+int inode_truncate(inode_t *inode);
+delalloc_t const *inode_delalloc(inode_t const *inode);
+char *inode_delalloc_grow(inode_t *inode, size_t start, size_t end);
+int inode_delalloc_flush(inode_t *inode);
+
+int clear_dir_entry(int inumber, int sub_inumber, char const *sub_name);
+int unlink_dir_entry(int inumber, char const *sub_name);
 int add_dir_entry(int inumber, int sub_inumber, char const *sub_name);
 int find_in_dir(int inumber, char const *sub_name);
+int dir_entry_count(int inumber);
 
 int data_block_alloc();
+int data_block_alloc_many(int *blocks, int count);
+int data_block_alloc_extent(int count, int *start);
+int data_block_free_count();
+void block_pools_drain();
 int data_block_free(int *block_number);
 void *data_block_get(int block_number);
+void *data_blocks_get(int first, int count);
 
-int read_from_block(int offset, size_t *to_read, void *block, void *buffer,
-                    size_t buffer_offset);
-int write_to_block(size_t *of_offset, int block_offset, size_t *to_write,
-                   void *block, void const *buffer, size_t buffer_offset,
-                   inode_t *inode);
 
 int add_to_open_file_table(int inumber, size_t offset);
 int remove_from_open_file_table(int fhandle);
 open_file_entry_t *get_open_file_entry(int fhandle);
+int open_file_inumber(int fhandle);
+bool inode_is_open(int inumber);
+void inode_range_lock(int inumber, size_t offset, size_t len, bool write,
+                      inode_range_t *range);
+void inode_range_unlock(int inumber, inode_range_t *range);
+void inode_pin(int inumber);
+void inode_unpin(int inumber);
+bool inode_is_pinned(int inumber);
 
 #endif // STATE_H
@@ -0,0 +1,141 @@
+#include "fs/aio.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+/*
+    This test drives files through the asynchronous interface: it opens,
+    writes, reads back and closes several files with batches of requests,
+    checks that every completion carries the result of the synchronous call
+    and its request's user data, and that a context never takes more
+    requests than it has entries for.
+*/
+#define FILES 8
+#define ENTRIES 16
+#define SIZE 3000
+
+static void run_batch(tfs_aio_t *aio, tfs_aio_sqe_t *sqes, unsigned count,
+                      ssize_t *results) {
+    tfs_aio_cqe_t cqes[FILES];
+
+    assert(tfs_aio_submit(aio, sqes, count) == count);
+    for (unsigned done = 0; done < count;) {
+        unsigned n = tfs_aio_reap(aio, cqes, FILES, 1);
+        assert(n >= 1);
+        for (unsigned i = 0; i < n; i++) {
+            assert(cqes[i].cqe_user_data < count);
+            results[cqes[i].cqe_user_data] = cqes[i].cqe_result;
+        }
+        done += n;
+    }
+}
+
+int main() {
+    static char input[FILES][SIZE];
+    static char output[FILES][SIZE];
+    char paths[FILES][MAX_FILE_NAME];
+    tfs_aio_sqe_t sqes[FILES];
+    ssize_t results[FILES];
+    int fd[FILES];
+
+    assert(tfs_init(NULL) != -1);
+    tfs_aio_t *aio = tfs_aio_create(ENTRIES, 4);
+    assert(aio != NULL);
+
+    for (int f = 0; f < FILES; f++) {
+        snprintf(paths[f], MAX_FILE_NAME, "/f%d", f);
+        memset(input[f], 'a' + f, SIZE);
+    }
+
+    /* Open every file */
+    for (int f = 0; f < FILES; f++) {
+        sqes[f] = (tfs_aio_sqe_t){.sqe_op = TFS_AIO_OPEN,
+                                  .sqe_path = paths[f],
+                                  .sqe_flags = TFS_O_CREAT,
+                                  .sqe_user_data = (uint64_t)f};
+    }
+    run_batch(aio, sqes, FILES, results);
+    for (int f = 0; f < FILES; f++) {
+        assert(results[f] != -1);
+        fd[f] = (int)results[f];
+    }
+
+    /* Write them, read them back through the offset and positionally */
+    for (int f = 0; f < FILES; f++) {
+        sqes[f] = (tfs_aio_sqe_t){.sqe_op = TFS_AIO_WRITE,
+                                  .sqe_fhandle = fd[f],
+                                  .sqe_buffer = input[f],
+                                  .sqe_len = SIZE,
+                                  .sqe_user_data = (uint64_t)f};
+    }
+    run_batch(aio, sqes, FILES, results);
+    for (int f = 0; f < FILES; f++) {
+        assert(results[f] == SIZE);
+    }
+
+    for (int f = 0; f < FILES; f++) {
+        sqes[f] = (tfs_aio_sqe_t){.sqe_op = TFS_AIO_PREAD,
+                                  .sqe_fhandle = fd[f],
+                                  .sqe_buffer = output[f],
+                                  .sqe_len = SIZE,
+                                  .sqe_offset = 0,
+                                  .sqe_user_data = (uint64_t)f};
+    }
+    run_batch(aio, sqes, FILES, results);
+    for (int f = 0; f < FILES; f++) {
+        assert(results[f] == SIZE);
+        assert(memcmp(input[f], output[f], SIZE) == 0);
+    }
+
+    /* The offset is past the data, so reading through it gets nothing */
+    for (int f = 0; f < FILES; f++) {
+        sqes[f].sqe_op = TFS_AIO_READ;
+    }
+    run_batch(aio, sqes, FILES, results);
+    for (int f = 0; f < FILES; f++) {
+        assert(results[f] == 0);
+    }
+
+    /* Failures complete with -1 */
+    sqes[0] = (tfs_aio_sqe_t){.sqe_op = TFS_AIO_OPEN, .sqe_path = "/none"};
+    run_batch(aio, sqes, 1, results);
+    assert(results[0] == -1);
+
+    /* No more requests than entries are taken, until some are reaped */
+    tfs_aio_sqe_t many[ENTRIES + 4];
+    for (unsigned i = 0; i < ENTRIES + 4; i++) {
+        many[i] = (tfs_aio_sqe_t){.sqe_op = TFS_AIO_PREAD,
+                                  .sqe_fhandle = fd[0],
+                                  .sqe_buffer = output[0],
+                                  .sqe_len = SIZE};
+    }
+    assert(tfs_aio_submit(aio, many, ENTRIES + 4) == ENTRIES);
+    assert(tfs_aio_submit(aio, many, 1) == 0);
+    tfs_aio_cqe_t cqes[ENTRIES];
+    unsigned reaped = 0;
+    while (reaped < ENTRIES) {
+        reaped += tfs_aio_reap(aio, cqes, ENTRIES, ENTRIES - reaped);
+    }
+    assert(tfs_aio_reap(aio, cqes, ENTRIES, 1) == 0);
+
+    /* Close every file */
+    for (int f = 0; f < FILES; f++) {
+        sqes[f] = (tfs_aio_sqe_t){.sqe_op = TFS_AIO_CLOSE,
+                                  .sqe_fhandle = fd[f],
+                                  .sqe_user_data = (uint64_t)f};
+    }
+    run_batch(aio, sqes, FILES, results);
+    for (int f = 0; f < FILES; f++) {
+        assert(results[f] == 0);
+    }
+
+    /* Requests still in flight are waited for by tfs_aio_destroy */
+    assert(tfs_aio_submit(aio, many, 4) == 4);
+    tfs_aio_destroy(aio);
+
+    assert(tfs_destroy() != -1);
+
+    printf("Successful test.\n");
+
+    return 0;
+}
@@ -0,0 +1,97 @@
+#include "fs/aio.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+    This file reads random blocks of a file from a single thread, first with
+    blocking tfs_pread calls and then through an asynchronous context with
+    several requests in flight, with a storage latency that sleeps 50 us per
+    access and a block cache too small to hold the file.
+*/
+#define FILE_BLOCKS 2048
+#define READS 2000
+#define CACHE_BLOCKS 16
+
+static double elapsed_s(struct timespec *start, struct timespec *end) {
+    return (double)(end->tv_sec - start->tv_sec) +
+           (double)(end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+int main() {
+    struct timespec start, end;
+    tfs_params_t params = {
+        .data_blocks = FILE_BLOCKS * 2,
+        .block_cache_blocks = CACHE_BLOCKS,
+        .latency = {.model = TFS_LATENCY_SLEEP,
+                    .cost_ns = {[TFS_ACCESS_BLOCK] = 50000}}};
+
+    assert(tfs_init(&params) != -1);
+
+    size_t size = FILE_BLOCKS * BLOCK_SIZE;
+    char *buffer = malloc(size);
+    assert(buffer != NULL);
+    memset(buffer, 'x', size);
+    int fd = tfs_open("/f", TFS_O_CREAT);
+    assert(fd != -1);
+    assert(tfs_write(fd, buffer, size) == size);
+
+    srand(1);
+    size_t *offsets = malloc(READS * sizeof(*offsets));
+    assert(offsets != NULL);
+    for (int i = 0; i < READS; i++) {
+        offsets[i] = (size_t)(rand() % FILE_BLOCKS) * BLOCK_SIZE;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < READS; i++) {
+        assert(tfs_pread(fd, buffer, BLOCK_SIZE, offsets[i]) == BLOCK_SIZE);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("blocking:       %8.0f reads/s\n",
+           READS / elapsed_s(&start, &end));
+
+    for (unsigned depth = 4; depth <= 32; depth *= 2) {
+        tfs_aio_t *aio = tfs_aio_create(depth, depth);
+        assert(aio != NULL);
+        tfs_aio_cqe_t cqes[32];
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        int submitted = 0;
+        int completed = 0;
+        while (completed < READS) {
+            while (submitted < READS) {
+                tfs_aio_sqe_t sqe = {
+                    .sqe_op = TFS_AIO_PREAD,
+                    .sqe_fhandle = fd,
+                    .sqe_buffer = buffer + (size_t)submitted * BLOCK_SIZE %
+                                               size,
+                    .sqe_len = BLOCK_SIZE,
+                    .sqe_offset = offsets[submitted]};
+                if (tfs_aio_submit(aio, &sqe, 1) == 0) {
+                    break;
+                }
+                submitted++;
+            }
+            unsigned n = tfs_aio_reap(aio, cqes, 32, 1);
+            for (unsigned i = 0; i < n; i++) {
+                assert(cqes[i].cqe_result == (ssize_t)BLOCK_SIZE);
+            }
+            completed += (int)n;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        printf("async, depth %2u: %8.0f reads/s\n", depth,
+               READS / elapsed_s(&start, &end));
+
+        tfs_aio_destroy(aio);
+    }
+
+    assert(tfs_close(fd) != -1);
+    free(offsets);
+    free(buffer);
+    assert(tfs_destroy() != -1);
+
+    return 0;
+}
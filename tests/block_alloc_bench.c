@@ -0,0 +1,88 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*
+    This file measures the cost of allocating and freeing data blocks when the
+    volume is 10%, 50% and 95% full.
+    The volume is filled by allocating every block and then freeing a random
+    subset of them, so free blocks end up scattered across the bitmap.
+*/
+#define ROUNDS 20000
+#define BATCH 8
+
+static double elapsed_ns(struct timespec *start, struct timespec *end) {
+    return (double)(end->tv_sec - start->tv_sec) * 1e9 +
+           (double)(end->tv_nsec - start->tv_nsec);
+}
+
+static void shuffle(int *blocks, int count) {
+    for (int i = count - 1; i > 0; i--) {
+        int j = rand() % (i + 1);
+        int tmp = blocks[i];
+        blocks[i] = blocks[j];
+        blocks[j] = tmp;
+    }
+}
+
+static void run(int percent_full) {
+    int batch[BATCH];
+    struct timespec start, end;
+
+    assert(tfs_init(NULL) != -1);
+
+    int *blocks = calloc(DATA_BLOCKS, sizeof(int));
+    assert(blocks != NULL);
+
+    /* Take every block left, then give back a random subset of them */
+    int taken = 0;
+    while ((blocks[taken] = data_block_alloc()) != -1) {
+        taken++;
+    }
+    shuffle(blocks, taken);
+
+    int to_keep = (int)DATA_BLOCKS * percent_full / 100;
+    while (taken > to_keep) {
+        assert(data_block_free(&blocks[--taken]) != -1);
+    }
+
+    /* Single block alloc/free pairs */
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < ROUNDS; i++) {
+        int b = data_block_alloc();
+        assert(b != -1);
+        assert(data_block_free(&b) != -1);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double single = elapsed_ns(&start, &end) / ROUNDS;
+
+    /* Batched allocation, freeing the blocks one by one */
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < ROUNDS; i++) {
+        int n = data_block_alloc_many(batch, BATCH);
+        assert(n > 0);
+        for (int j = 0; j < n; j++) {
+            assert(data_block_free(&batch[j]) != -1);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double batched = elapsed_ns(&start, &end) / ROUNDS;
+
+    printf("%3d%% full: alloc+free %8.1f ns, alloc_many(%d)+free %8.1f ns\n",
+           percent_full, single, BATCH, batched);
+
+    free(blocks);
+    assert(tfs_destroy() != -1);
+}
+
+int main() {
+    srand(1);
+
+    run(10);
+    run(50);
+    run(95);
+
+    return 0;
+}
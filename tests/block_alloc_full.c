@@ -0,0 +1,55 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+    This file tests that every data block can be allocated exactly once, that
+    allocation fails once the volume is full and that freed blocks are handed
+    out again
+*/
+int main() {
+    int b;
+
+    assert(tfs_init(NULL) != -1);
+
+    char *seen = calloc(DATA_BLOCKS, sizeof(char));
+    int *blocks = calloc(DATA_BLOCKS, sizeof(int));
+    assert(seen != NULL && blocks != NULL);
+
+    /* The root directory already holds one block */
+    int taken = 0;
+    while ((b = data_block_alloc()) != -1) {
+        assert(b >= 0 && b < DATA_BLOCKS);
+        assert(seen[b] == 0);
+        seen[b] = 1;
+        blocks[taken++] = b;
+    }
+    assert(taken == DATA_BLOCKS - 1);
+    assert(data_block_alloc_many(blocks, 4) == 0);
+
+    /* Give back a few scattered blocks and take them all again in one call */
+    int freed[] = {blocks[3], blocks[200], blocks[700], blocks[taken - 1]};
+    for (int i = 0; i < 4; i++) {
+        assert(data_block_free(&freed[i]) != -1);
+    }
+
+    int again[8];
+    assert(data_block_alloc_many(again, 8) == 4);
+    for (int i = 0; i < 4; i++) {
+        int found = 0;
+        for (int j = 0; j < 4; j++) {
+            found |= again[i] == freed[j];
+        }
+        assert(found);
+    }
+
+    free(seen);
+    free(blocks);
+
+    assert(tfs_destroy() != -1);
+
+    printf("Successful test.\n");
+
+    return 0;
+}
@@ -0,0 +1,60 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+
+/*
+    This file measures how block allocation scales with the number of threads:
+    each thread repeatedly allocates a few blocks and frees them again, for 1
+    up to 32 threads
+*/
+#define MAX_THREADS 32
+#define ROUNDS 20000
+#define BLOCKS_PER_ROUND 4
+
+void *churn(void *arg) {
+    int blocks[BLOCKS_PER_ROUND];
+    (void)arg;
+
+    for (int r = 0; r < ROUNDS; r++) {
+        for (int i = 0; i < BLOCKS_PER_ROUND; i++) {
+            assert((blocks[i] = data_block_alloc()) != -1);
+        }
+        for (int i = 0; i < BLOCKS_PER_ROUND; i++) {
+            assert(data_block_free(&blocks[i]) != -1);
+        }
+    }
+
+    return NULL;
+}
+
+int main() {
+    pthread_t threads[MAX_THREADS];
+    struct timespec start, end;
+
+    for (int count = 1; count <= MAX_THREADS; count *= 2) {
+        assert(tfs_init(NULL) != -1);
+        int initial = data_block_free_count();
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int i = 0; i < count; i++) {
+            assert(pthread_create(&threads[i], NULL, churn, NULL) == 0);
+        }
+        for (int i = 0; i < count; i++) {
+            assert(pthread_join(threads[i], NULL) == 0);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        assert(data_block_free_count() == initial);
+
+        double secs = (double)(end.tv_sec - start.tv_sec) +
+                      (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+        double ops = (double)count * ROUNDS * BLOCKS_PER_ROUND * 2;
+        printf("%2d threads: %10.0f alloc+free ops/s\n", count, ops / secs);
+
+        assert(tfs_destroy() != -1);
+    }
+
+    return 0;
+}
@@ -0,0 +1,73 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+    This file tests multiple threads allocating and freeing data blocks at the
+    same time: no block may be handed to two threads, and once every thread is
+    done the free block count must be back to where it started
+*/
+#define THREAD_COUNT 16
+#define PER_THREAD 40
+#define ROUNDS 200
+
+static atomic_char *owner;
+
+void *churn(void *arg) {
+    int blocks[PER_THREAD];
+    (void)arg;
+
+    for (int r = 0; r < ROUNDS; r++) {
+        int n = r % PER_THREAD + 1;
+        for (int i = 0; i < n; i++) {
+            assert((blocks[i] = data_block_alloc()) != -1);
+            assert(atomic_exchange(&owner[blocks[i]], 1) == 0);
+        }
+        for (int i = 0; i < n; i++) {
+            assert(atomic_exchange(&owner[blocks[i]], 0) == 1);
+            assert(data_block_free(&blocks[i]) != -1);
+        }
+    }
+
+    return NULL;
+}
+
+int main() {
+    pthread_t threads[THREAD_COUNT];
+
+    assert(tfs_init(NULL) != -1);
+
+    owner = calloc(DATA_BLOCKS, sizeof(*owner));
+    assert(owner != NULL);
+
+    int initial = data_block_free_count();
+    assert(initial == (int)DATA_BLOCKS - 1);
+
+    for (int i = 0; i < THREAD_COUNT; i++) {
+        assert(pthread_create(&threads[i], NULL, churn, NULL) == 0);
+    }
+
+    for (int i = 0; i < THREAD_COUNT; i++) {
+        assert(pthread_join(threads[i], NULL) == 0);
+    }
+
+    assert(data_block_free_count() == initial);
+
+    /* Blocks cached by the other threads must still be reachable */
+    int taken = 0;
+    while (data_block_alloc() != -1) {
+        taken++;
+    }
+    assert(taken == initial);
+    assert(data_block_free_count() == 0);
+
+    free(owner);
+    assert(tfs_destroy() != -1);
+
+    printf("Successful test.\n");
+
+    return 0;
+}
@@ -0,0 +1,101 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+    This test checks the block cache: repeated reads of a hot file and of a
+    directory hit it and skip the storage latency, blocks past its capacity
+    evict others, and its counters stay consistent when several threads
+    access blocks at once.
+*/
+#define CACHE_BLOCKS 8
+#define THREADS 4
+#define ACCESSES 100000
+
+static void *access_blocks(void *arg) {
+    unsigned seed = (unsigned)(size_t)arg;
+
+    for (int i = 0; i < ACCESSES; i++) {
+        assert(data_block_get(rand_r(&seed) % (CACHE_BLOCKS * 2)) != NULL);
+    }
+
+    return NULL;
+}
+
+int main() {
+    char buffer[4 * 1024];
+    tfs_block_cache_stats_t before, after;
+    tfs_latency_stats_t latency_before, latency_after;
+    tfs_params_t params = {.block_cache_blocks = CACHE_BLOCKS,
+                           .latency = {.model = TFS_LATENCY_NONE}};
+
+    assert(tfs_init(&params) != -1);
+    memset(buffer, 'x', sizeof(buffer));
+
+    int fd = tfs_open("/f", TFS_O_CREAT);
+    assert(fd != -1);
+    assert(tfs_write(fd, buffer, sizeof(buffer)) == sizeof(buffer));
+    assert(tfs_close(fd) != -1);
+
+    /* A hot file is read without going to storage */
+    tfs_block_cache_stats(&before);
+    tfs_latency_stats(&latency_before);
+    for (int i = 0; i < 10; i++) {
+        fd = tfs_open("/f", 0);
+        assert(fd != -1);
+        assert(tfs_read(fd, buffer, sizeof(buffer)) == sizeof(buffer));
+        assert(tfs_close(fd) != -1);
+    }
+    tfs_block_cache_stats(&after);
+    tfs_latency_stats(&latency_after);
+    assert(after.misses == before.misses);
+    assert(after.hits >= before.hits + 10);
+    assert(latency_after.accesses[TFS_ACCESS_BLOCK] ==
+           latency_before.accesses[TFS_ACCESS_BLOCK]);
+
+    /* So is the root directory, on every name lookup */
+    tfs_block_cache_stats(&before);
+    for (int i = 0; i < 10; i++) {
+        assert(find_in_dir(ROOT_DIR_INUM, "f") != -1);
+    }
+    tfs_block_cache_stats(&after);
+    assert(after.misses == before.misses);
+
+    /* Touching more blocks than the cache holds evicts some */
+    tfs_block_cache_stats(&before);
+    for (int b = 0; b < CACHE_BLOCKS * 2; b++) {
+        assert(data_block_get((int)DATA_BLOCKS - 1 - b) != NULL);
+    }
+    tfs_block_cache_stats(&after);
+    assert(after.misses == before.misses + CACHE_BLOCKS * 2);
+    assert(after.evictions >= before.evictions + CACHE_BLOCKS);
+
+    /* Every concurrent access is either a hit or a miss */
+    tfs_block_cache_stats(&before);
+    pthread_t tid[THREADS];
+    for (size_t i = 0; i < THREADS; i++) {
+        assert(pthread_create(&tid[i], NULL, access_blocks, (void *)i) == 0);
+    }
+    for (size_t i = 0; i < THREADS; i++) {
+        assert(pthread_join(tid[i], NULL) == 0);
+    }
+    tfs_block_cache_stats(&after);
+    assert((after.hits - before.hits) + (after.misses - before.misses) ==
+           THREADS * ACCESSES);
+    assert(after.misses - before.misses >= CACHE_BLOCKS);
+
+    assert(tfs_destroy() != -1);
+
+    /* The counters start over */
+    assert(tfs_init(&params) != -1);
+    tfs_block_cache_stats(&before);
+    assert(before.evictions == 0);
+    assert(tfs_destroy() != -1);
+
+    printf("Successful test.\n");
+
+    return 0;
+}
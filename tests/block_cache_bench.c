@@ -0,0 +1,72 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+    This file reads a 64-block file over and over, one block at a time and
+    with the default storage latency, for block caches smaller and larger
+    than the file, and prints the read throughput and the cache hit rate.
+*/
+#define FILE_BLOCKS 64
+#define ROUNDS 200
+
+static double elapsed_s(struct timespec *start, struct timespec *end) {
+    return (double)(end->tv_sec - start->tv_sec) +
+           (double)(end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void run(size_t cache_blocks) {
+    struct timespec start, end;
+    tfs_block_cache_stats_t before, after;
+    tfs_params_t params = {.block_cache_blocks = cache_blocks};
+
+    assert(tfs_init(&params) != -1);
+
+    size_t size = FILE_BLOCKS * BLOCK_SIZE;
+    char *buffer = malloc(size);
+    assert(buffer != NULL);
+    memset(buffer, 'x', size);
+
+    int fd = tfs_open("/f", TFS_O_CREAT);
+    assert(fd != -1);
+    assert(tfs_write(fd, buffer, size) == size);
+    assert(tfs_close(fd) != -1);
+
+    tfs_block_cache_stats(&before);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    fd = tfs_open("/f", 0);
+    assert(fd != -1);
+    for (int i = 0; i < ROUNDS; i++) {
+        for (size_t off = 0; off < size; off += BLOCK_SIZE) {
+            assert(tfs_pread(fd, buffer + off, BLOCK_SIZE, off) ==
+                   BLOCK_SIZE);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    tfs_block_cache_stats(&after);
+    assert(tfs_close(fd) != -1);
+
+    double accesses =
+        (double)(after.hits - before.hits + after.misses - before.misses);
+    printf("%4zu block cache: read %8.1f MB/s, hit rate %5.1f%%, %llu "
+           "evictions\n",
+           cache_blocks,
+           (double)size * ROUNDS / (1024 * 1024) / elapsed_s(&start, &end),
+           (double)(after.hits - before.hits) / accesses * 100,
+           (unsigned long long)(after.evictions - before.evictions));
+
+    free(buffer);
+    assert(tfs_destroy() != -1);
+}
+
+int main() {
+    run(1);
+    run(FILE_BLOCKS / 2);
+    run(FILE_BLOCKS + 1);
+    run(DEFAULT_BLOCK_CACHE_BLOCKS);
+
+    return 0;
+}
@@ -0,0 +1,72 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+    This file measures sequential write and read throughput of a single file
+    for block sizes from 512 B up to 64 KB. The volume is always 4 MB, so the
+    number of data blocks shrinks as the block size grows.
+*/
+#define VOLUME_SIZE (4 * 1024 * 1024)
+#define CHUNK 4096
+
+static double elapsed_s(struct timespec *start, struct timespec *end) {
+    return (double)(end->tv_sec - start->tv_sec) +
+           (double)(end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void run(size_t block_size, char *chunk) {
+    struct timespec start, end;
+    tfs_params_t params = {.block_size = block_size,
+                           .data_blocks = VOLUME_SIZE / block_size};
+
+    assert(tfs_init(&params) != -1);
+
+    /* Leave room for the root directory and the indirect blocks */
+    size_t file_size = VOLUME_SIZE / 4 * 3;
+
+    int fd = tfs_open("/f", TFS_O_CREAT);
+    assert(fd != -1);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t done = 0; done < file_size; done += CHUNK) {
+        assert(tfs_write(fd, chunk, CHUNK) == CHUNK);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double write_s = elapsed_s(&start, &end);
+    assert(tfs_close(fd) != -1);
+
+    fd = tfs_open("/f", 0);
+    assert(fd != -1);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t done = 0; done < file_size; done += CHUNK) {
+        assert(tfs_read(fd, chunk, CHUNK) == CHUNK);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double read_s = elapsed_s(&start, &end);
+    assert(tfs_close(fd) != -1);
+
+    double mb = (double)file_size / (1024 * 1024);
+    printf("%6zu B blocks, %5zu KB file: write %8.1f MB/s, read %8.1f MB/s\n",
+           block_size, file_size / 1024, mb / write_s, mb / read_s);
+
+    assert(tfs_destroy() != -1);
+}
+
+int main() {
+    char *chunk = malloc(CHUNK);
+    assert(chunk != NULL);
+    memset(chunk, 'x', CHUNK);
+
+    for (size_t block_size = 512; block_size <= 64 * 1024; block_size *= 2) {
+        run(block_size, chunk);
+    }
+
+    free(chunk);
+
+    return 0;
+}
@@ -0,0 +1,94 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+    This test imports binary files from the host file system, checks their
+    contents and layout, and checks that imports that can not fit leave the
+    destination empty
+*/
+#define SIZE (300 * 1024 + 77)
+
+static void write_host_file(char const *path, char const *contents,
+                            size_t size) {
+    FILE *fp = fopen(path, "w");
+    assert(fp != NULL);
+    assert(fwrite(contents, 1, size, fp) == size);
+    assert(fclose(fp) == 0);
+}
+
+int main() {
+    char *host_path = "external_import_file";
+    char *path = "/f1";
+    char *path2 = "/f2";
+
+    char *input = malloc(SIZE);
+    char *output = malloc(SIZE + 1);
+    assert(input != NULL && output != NULL);
+    for (size_t i = 0; i < SIZE; i++) {
+        input[i] = (char)(i % 5 == 0 ? 0 : i % 253);
+    }
+    write_host_file(host_path, input, SIZE);
+
+    assert(tfs_init(NULL) != -1);
+
+    /* An existing file is overwritten */
+    int fd = tfs_open(path, TFS_O_CREAT);
+    assert(fd != -1);
+    assert(tfs_write(fd, "old contents", 12) == 12);
+    assert(tfs_close(fd) != -1);
+
+    assert(tfs_copy_from_external_fs(host_path, path) != -1);
+
+    fd = tfs_open(path, 0);
+    assert(fd != -1);
+    assert(tfs_read(fd, output, SIZE + 1) == SIZE);
+    assert(memcmp(input, output, SIZE) == 0);
+    assert(tfs_close(fd) != -1);
+
+    /* The data blocks of the direct part are laid out in one extent */
+    int blocks[INODE_DIRECT_BLOCKS];
+    inode_t *inode = inode_get(tfs_lookup(path));
+    assert(inode != NULL);
+    assert(inode_block_map(inode, 0, INODE_DIRECT_BLOCKS, blocks) != -1);
+    for (int i = 1; i < INODE_DIRECT_BLOCKS; i++) {
+        assert(blocks[i] == blocks[0] + i);
+    }
+
+    /* No room for the contents: the destination is left empty and no
+     * block is lost */
+    int free_blocks = data_block_free_count();
+    size_t bigger_size = (size_t)(free_blocks + 1) * BLOCK_SIZE;
+    char *bigger = calloc(bigger_size, 1);
+    assert(bigger != NULL);
+    write_host_file(host_path, bigger, bigger_size);
+    assert(tfs_copy_from_external_fs(host_path, path2) == -1);
+    fd = tfs_open(path2, 0);
+    assert(fd != -1);
+    assert(tfs_read(fd, output, SIZE) == 0);
+    assert(tfs_close(fd) != -1);
+    assert(data_block_free_count() == free_blocks);
+
+    /* Empty files, missing files and directories */
+    write_host_file(host_path, input, 0);
+    assert(tfs_copy_from_external_fs(host_path, path) != -1);
+    fd = tfs_open(path, 0);
+    assert(fd != -1);
+    assert(tfs_read(fd, output, SIZE) == 0);
+    assert(tfs_close(fd) != -1);
+    assert(tfs_copy_from_external_fs("./no_such_file", path) == -1);
+    assert(tfs_copy_from_external_fs(".", path) == -1);
+
+    unlink(host_path);
+    free(input);
+    free(output);
+    free(bigger);
+
+    assert(tfs_destroy() != -1);
+
+    printf("Successful test.\n");
+
+    return 0;
+}
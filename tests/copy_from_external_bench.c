@@ -0,0 +1,86 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+    This file measures importing a 128 MB host file with
+    tfs_copy_from_external_fs against the loop loaders use today: fread into
+    a buffer and tfs_write it, chunk by chunk
+*/
+#define FILE_SIZE (128 * 1024 * 1024)
+#define CHUNK (64 * 1024)
+#define HOST_FILE "external_import_bench_file"
+
+static double elapsed_s(struct timespec *start, struct timespec *end) {
+    return (double)(end->tv_sec - start->tv_sec) +
+           (double)(end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void chunked_import(char const *source_path, char const *dest_path) {
+    static char buffer[CHUNK];
+
+    FILE *fp = fopen(source_path, "r");
+    assert(fp != NULL);
+    int fd = tfs_open(dest_path, TFS_O_CREAT | TFS_O_TRUNC);
+    assert(fd != -1);
+
+    size_t n;
+    while ((n = fread(buffer, 1, CHUNK, fp)) > 0) {
+        assert(tfs_write(fd, buffer, n) == n);
+    }
+
+    assert(tfs_close(fd) != -1);
+    assert(fclose(fp) == 0);
+}
+
+int main() {
+    struct timespec start, end;
+
+    char *contents = malloc(CHUNK);
+    assert(contents != NULL);
+    memset(contents, 'x', CHUNK);
+    FILE *fp = fopen(HOST_FILE, "w");
+    assert(fp != NULL);
+    for (size_t done = 0; done < FILE_SIZE; done += CHUNK) {
+        assert(fwrite(contents, 1, CHUNK, fp) == CHUNK);
+    }
+    assert(fclose(fp) == 0);
+    free(contents);
+
+    for (size_t block_size = 1024; block_size <= 16384; block_size *= 4) {
+        tfs_params_t params = {.block_size = block_size,
+                               .data_blocks = FILE_SIZE / block_size / 64 * 65};
+
+        /* Each way runs on a fresh FS, after a warm-up of the host file */
+        assert(tfs_init(&params) != -1);
+        chunked_import(HOST_FILE, "/warmup");
+        assert(tfs_destroy() != -1);
+
+        assert(tfs_init(&params) != -1);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        chunked_import(HOST_FILE, "/f");
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double chunked = elapsed_s(&start, &end);
+        assert(tfs_destroy() != -1);
+
+        assert(tfs_init(&params) != -1);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        assert(tfs_copy_from_external_fs(HOST_FILE, "/f") != -1);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double mapped = elapsed_s(&start, &end);
+        assert(tfs_destroy() != -1);
+
+        double mb = (double)FILE_SIZE / (1024 * 1024);
+        printf("%5zu B blocks: chunked %7.1f MB/s, "
+               "tfs_copy_from_external_fs %7.1f MB/s\n",
+               block_size, mb / chunked, mb / mapped);
+    }
+
+    unlink(HOST_FILE);
+
+    return 0;
+}
@@ -0,0 +1,85 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+    This test exports binary files (full of NUL bytes) that are larger than
+    a single writev batch, and a file with a hole in the middle and at the
+    end, checking every byte of the copies
+*/
+#define SIZE (600 * 1024 + 321)
+
+static void check_copy(char const *path, char const *expected, size_t size) {
+    char *copy = malloc(size + 1);
+    assert(copy != NULL);
+
+    FILE *fp = fopen(path, "r");
+    assert(fp != NULL);
+    assert(fread(copy, 1, size + 1, fp) == size);
+    assert(memcmp(copy, expected, size) == 0);
+    assert(fclose(fp) != -1);
+
+    free(copy);
+}
+
+int main() {
+    char *path = "/f1";
+    char *path2 = "/f2";
+    char *external = "external_binary_file";
+
+    char *input = malloc(SIZE);
+    assert(input != NULL);
+    for (size_t i = 0; i < SIZE; i++) {
+        input[i] = (char)(i % 7 == 0 ? 0 : i % 251);
+    }
+
+    tfs_params_t params = {.data_blocks = 4096};
+    assert(tfs_init(&params) != -1);
+
+    /* Written in small pieces, so the blocks are spread out */
+    int f1 = tfs_open(path, TFS_O_CREAT);
+    int f2 = tfs_open(path2, TFS_O_CREAT);
+    assert(f1 != -1 && f2 != -1);
+    for (size_t done = 0; done < SIZE; done += 1000) {
+        size_t len = SIZE - done < 1000 ? SIZE - done : 1000;
+        assert(tfs_write(f1, input + done, len) == len);
+        assert(tfs_write(f2, input + done, len) == len);
+    }
+    assert(tfs_close(f1) != -1);
+
+    assert(tfs_copy_to_external_fs(path, external) != -1);
+    check_copy(external, input, SIZE);
+
+    /* Holes are exported as zeros, up to the size of the file */
+    assert(tfs_close(f2) != -1);
+    f1 = tfs_open(path, TFS_O_TRUNC);
+    assert(f1 != -1);
+    memset(input, 0, SIZE);
+    memcpy(input + 10, "start", 5);
+    memcpy(input + 50000, "middle", 6);
+    assert(tfs_pwrite(f1, "start", 5, 10) == 5);
+    assert(tfs_pwrite(f1, "middle", 6, 50000) == 6);
+    assert(tfs_pwrite(f1, "", 1, SIZE - 1) == 1);
+    assert(tfs_close(f1) != -1);
+
+    assert(tfs_copy_to_external_fs(path, external) != -1);
+    check_copy(external, input, SIZE);
+
+    /* An existing file is overwritten, an empty file gives an empty copy */
+    f1 = tfs_open(path, TFS_O_TRUNC);
+    assert(f1 != -1);
+    assert(tfs_close(f1) != -1);
+    assert(tfs_copy_to_external_fs(path, external) != -1);
+    check_copy(external, input, 0);
+
+    unlink(external);
+    free(input);
+
+    assert(tfs_destroy() != -1);
+
+    printf("Successful test.\n");
+
+    return 0;
+}
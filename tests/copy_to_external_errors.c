@@ -6,7 +6,7 @@ int main() {
 
     /* Tests different scenarios where tfs_copy_to_external_fs is expected to fail */
 
-    assert(tfs_init() != -1);
+    assert(tfs_init(NULL) != -1);
     
     int f1 = tfs_open(path1, TFS_O_CREAT);
     assert(f1 != -1);
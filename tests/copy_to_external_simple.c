@@ -10,7 +10,7 @@ int main() {
     char *path2 = "external_file.txt";
     char to_read[40];
 
-    assert(tfs_init() != -1);
+    assert(tfs_init(NULL) != -1);
 
     int file = tfs_open(path, TFS_O_CREAT);
     assert(file != -1);
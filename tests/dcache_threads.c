@@ -0,0 +1,76 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+
+/*
+    This file tests the dentry cache while names come and go: each writer
+    thread creates and removes its own files and must always see its own
+    changes, while reader threads keep filling the cache with lookups of the
+    very same names
+*/
+#define WRITERS 4
+#define READERS 4
+#define ROUNDS 300
+
+void *writer(void *arg) {
+    char path[MAX_FILE_NAME];
+    snprintf(path, sizeof(path), "/d/sub/w%d", *(int *)arg);
+
+    for (int r = 0; r < ROUNDS; r++) {
+        assert(tfs_lookup(path) == -1);
+
+        int f = tfs_open(path, TFS_O_CREAT);
+        assert(f != -1);
+        assert(tfs_close(f) != -1);
+        assert(tfs_lookup(path) != -1);
+
+        assert(tfs_unlink(path) != -1);
+    }
+
+    return NULL;
+}
+
+void *reader(void *arg) {
+    char path[MAX_FILE_NAME];
+    (void)arg;
+
+    for (int r = 0; r < ROUNDS * WRITERS; r++) {
+        snprintf(path, sizeof(path), "/d/sub/w%d", r % WRITERS);
+        tfs_lookup(path);
+    }
+
+    return NULL;
+}
+
+int main() {
+    pthread_t writers[WRITERS], readers[READERS];
+    int ids[WRITERS];
+
+    assert(tfs_init(NULL) != -1);
+    assert(tfs_mkdir("/d") != -1);
+    assert(tfs_mkdir("/d/sub") != -1);
+
+    for (int i = 0; i < WRITERS; i++) {
+        ids[i] = i;
+        assert(pthread_create(&writers[i], NULL, writer, &ids[i]) == 0);
+    }
+    for (int i = 0; i < READERS; i++) {
+        assert(pthread_create(&readers[i], NULL, reader, NULL) == 0);
+    }
+
+    for (int i = 0; i < WRITERS; i++) {
+        assert(pthread_join(writers[i], NULL) == 0);
+    }
+    for (int i = 0; i < READERS; i++) {
+        assert(pthread_join(readers[i], NULL) == 0);
+    }
+
+    assert(dir_entry_count(tfs_lookup("/d/sub")) == 0);
+
+    assert(tfs_destroy() != -1);
+
+    printf("Successful test.\n");
+
+    return 0;
+}
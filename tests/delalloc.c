@@ -0,0 +1,189 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+/*
+    This test checks delayed allocation: small appends take no blocks until
+    the file is closed, are read back from the buffer meanwhile, and then get
+    contiguous blocks even when two files are appended to in turns. It also
+    checks that buffered data is dropped by truncation, flushed by a write
+    past the end of the file and by tfs_read_map, and never promised more
+    blocks than the FS has, nor given away to other allocations, while small
+    buffers only hold back the blocks they can need.
+*/
+#define PIECE 10
+#define PIECES 300
+#define SIZE (PIECE * PIECES)
+
+static char piece_char(int file, int i) {
+    return (char)('a' + (file + i) % 26);
+}
+
+static void check_contents(char const *path, int file) {
+    char buffer[SIZE];
+    int fd = tfs_open(path, 0);
+    assert(fd != -1);
+    assert(tfs_read(fd, buffer, SIZE + 1) == SIZE);
+    for (int i = 0; i < SIZE; i++) {
+        assert(buffer[i] == piece_char(file, i / PIECE));
+    }
+    assert(tfs_close(fd) != -1);
+}
+
+static void check_contiguous(char const *path) {
+    int blocks[INODE_DIRECT_BLOCKS];
+    inode_t *inode = inode_get(tfs_lookup(path));
+    assert(inode != NULL);
+    int count = (int)((inode->i_size + BLOCK_SIZE - 1) / BLOCK_SIZE);
+    assert(inode_block_map(inode, 0, count, blocks) != -1);
+    for (int i = 1; i < count; i++) {
+        assert(blocks[i] == blocks[0] + i);
+    }
+}
+
+int main() {
+    char piece[PIECE];
+    char buffer[SIZE];
+    tfs_params_t params = {.block_size = 512, .data_blocks = 64};
+
+    assert(tfs_init(&params) != -1);
+
+    /* Two files appended to in turns take no blocks until they are closed */
+    int fd[2];
+    fd[0] = tfs_open("/a", TFS_O_CREAT);
+    fd[1] = tfs_open("/b", TFS_O_CREAT);
+    assert(fd[0] != -1 && fd[1] != -1);
+    int free_blocks = data_block_free_count();
+    for (int i = 0; i < PIECES; i++) {
+        for (int f = 0; f < 2; f++) {
+            memset(piece, piece_char(f, i), PIECE);
+            assert(tfs_write(fd[f], piece, PIECE) == PIECE);
+        }
+    }
+    assert(data_block_free_count() == free_blocks);
+
+    /* Meanwhile, the data is read from the buffer */
+    assert(tfs_pread(fd[0], buffer, SIZE, 0) == SIZE);
+    for (int i = 0; i < SIZE; i++) {
+        assert(buffer[i] == piece_char(0, i / PIECE));
+    }
+
+    assert(tfs_close(fd[0]) != -1);
+    assert(tfs_close(fd[1]) != -1);
+    int used = 2 * ((SIZE + 511) / 512);
+    assert(data_block_free_count() == free_blocks - used);
+    check_contents("/a", 0);
+    check_contents("/b", 1);
+    check_contiguous("/a");
+    check_contiguous("/b");
+
+    /* Appending to a file that has blocks fills its last block first */
+    fd[0] = tfs_open("/a", TFS_O_APPEND);
+    assert(fd[0] != -1);
+    assert(tfs_write(fd[0], "xyz", 3) == 3);
+    assert(tfs_pread(fd[0], buffer, 4, SIZE - 1) == 4);
+    assert(memcmp(buffer + 1, "xyz", 3) == 0);
+    assert(tfs_close(fd[0]) != -1);
+
+    /* Truncating drops the buffered data */
+    fd[0] = tfs_open("/c", TFS_O_CREAT);
+    assert(fd[0] != -1);
+    assert(tfs_write(fd[0], buffer, 100) == 100);
+    fd[1] = tfs_open("/c", TFS_O_TRUNC);
+    assert(fd[1] != -1);
+    assert(tfs_pread(fd[1], buffer, 100, 0) == 0);
+    assert(tfs_close(fd[1]) != -1);
+
+    /* A write past the end flushes the buffer, and the gap reads as zeros */
+    memset(buffer, 'q', 100);
+    assert(tfs_pwrite(fd[0], buffer, 100, 0) == 100);
+    assert(tfs_pwrite(fd[0], "!", 1, 300) == 1);
+    assert(tfs_pread(fd[0], buffer, 301, 0) == 301);
+    for (int i = 0; i < 100; i++) {
+        assert(buffer[i] == 'q');
+    }
+    for (int i = 100; i < 300; i++) {
+        assert(buffer[i] == '\0');
+    }
+    assert(buffer[300] == '!');
+    assert(tfs_close(fd[0]) != -1);
+
+    /* Read mappings see buffered data */
+    fd[0] = tfs_open("/d", TFS_O_CREAT);
+    assert(fd[0] != -1);
+    assert(tfs_write(fd[0], "mapped", 6) == 6);
+    fd[1] = tfs_open("/d", 0);
+    assert(fd[1] != -1);
+    tfs_read_map_t map;
+    assert(tfs_read_map(fd[1], 6, &map) == 6);
+    assert(map.rm_iovcnt == 1);
+    assert(memcmp(map.rm_iov[0].iov_base, "mapped", 6) == 0);
+    assert(tfs_read_unmap(&map) != -1);
+    assert(tfs_close(fd[1]) != -1);
+    assert(tfs_close(fd[0]) != -1);
+
+    /* Buffered data never takes more blocks than there are */
+    fd[0] = tfs_open("/e", TFS_O_CREAT);
+    assert(fd[0] != -1);
+    size_t written = 0;
+    ssize_t w;
+    while ((w = tfs_write(fd[0], buffer, PIECE)) == PIECE) {
+        written += PIECE;
+    }
+    if (w > 0) {
+        written += (size_t)w;
+    }
+    assert(tfs_close(fd[0]) != -1);
+    inode_t *inode = inode_get(tfs_lookup("/e"));
+    assert(inode != NULL && inode->i_size == written);
+    assert(tfs_unlink("/e") != -1);
+
+    /* Allocations that do not go through the buffer leave its reserved
+     * blocks alone, so that it can still be flushed */
+    fd[0] = tfs_open("/f", TFS_O_CREAT);
+    assert(fd[0] != -1);
+    for (written = 0; written < 10 * 512; written += PIECE) {
+        assert(tfs_write(fd[0], buffer, PIECE) == PIECE);
+    }
+    int taken[64];
+    int taken_count = 0;
+    while ((taken[taken_count] = data_block_alloc()) != -1) {
+        taken_count++;
+    }
+    assert(tfs_mkdir("/full") == -1);
+    assert(tfs_close(fd[0]) != -1);
+    inode = inode_get(tfs_lookup("/f"));
+    assert(inode != NULL && inode->i_size == written);
+    for (int i = 0; i < taken_count; i++) {
+        assert(data_block_free(&taken[i]) != -1);
+    }
+
+    assert(tfs_destroy() != -1);
+
+    /* Files buffering a byte each reserve a block each, and no indirect
+     * blocks they can not need */
+    tfs_params_t many = {.inode_table_size = 200};
+    assert(tfs_init(&many) != -1);
+    int small[100];
+    for (int i = 0; i < 100; i++) {
+        char path[16];
+        snprintf(path, sizeof(path), "/s%d", i);
+        small[i] = tfs_open(path, TFS_O_CREAT);
+        assert(small[i] != -1);
+        assert(tfs_write(small[i], "s", 1) == 1);
+    }
+    static char large[100 * 1024];
+    fd[0] = tfs_open("/large", TFS_O_CREAT);
+    assert(fd[0] != -1);
+    assert(tfs_write(fd[0], large, sizeof(large)) == sizeof(large));
+    assert(tfs_close(fd[0]) != -1);
+    for (int i = 0; i < 100; i++) {
+        assert(tfs_close(small[i]) != -1);
+    }
+    assert(tfs_destroy() != -1);
+
+    printf("Successful test.\n");
+
+    return 0;
+}
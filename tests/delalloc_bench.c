@@ -0,0 +1,83 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/*
+    This file appends small pieces to several files in turns, as many
+    writers logging at once do, closes them, and prints how long it took,
+    how many times the free block bitmap was accessed and into how many
+    extents (runs of contiguous blocks) each file ended up split.
+*/
+#define FILES 16
+#define PIECE 100
+#define FILE_SIZE (32 * 1024)
+
+static double elapsed_ms(struct timespec *start, struct timespec *end) {
+    return (double)(end->tv_sec - start->tv_sec) * 1e3 +
+           (double)(end->tv_nsec - start->tv_nsec) / 1e6;
+}
+
+static int extents(char const *path) {
+    int blocks[FILE_SIZE / 1024 + 1];
+    inode_t *inode = inode_get(tfs_lookup(path));
+    assert(inode != NULL);
+
+    int count = (int)((inode->i_size + BLOCK_SIZE - 1) / BLOCK_SIZE);
+    assert(inode_block_map(inode, 0, count, blocks) != -1);
+    int runs = 1;
+    for (int i = 1; i < count; i++) {
+        if (blocks[i] != blocks[i - 1] + 1) {
+            runs++;
+        }
+    }
+    return runs;
+}
+
+int main() {
+    char piece[PIECE];
+    char path[MAX_FILE_NAME];
+    int fd[FILES];
+    struct timespec start, end;
+    tfs_latency_stats_t before, after;
+    tfs_params_t params = {.data_blocks = FILES * FILE_SIZE / 1024 * 2};
+
+    memset(piece, 'x', PIECE);
+    assert(tfs_init(&params) != -1);
+
+    tfs_latency_stats(&before);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int f = 0; f < FILES; f++) {
+        snprintf(path, sizeof(path), "/f%d", f);
+        fd[f] = tfs_open(path, TFS_O_CREAT);
+        assert(fd[f] != -1);
+    }
+    for (size_t done = 0; done < FILE_SIZE; done += PIECE) {
+        for (int f = 0; f < FILES; f++) {
+            assert(tfs_write(fd[f], piece, PIECE) == PIECE);
+        }
+    }
+    for (int f = 0; f < FILES; f++) {
+        assert(tfs_close(fd[f]) != -1);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    tfs_latency_stats(&after);
+
+    int total_extents = 0;
+    for (int f = 0; f < FILES; f++) {
+        snprintf(path, sizeof(path), "/f%d", f);
+        total_extents += extents(path);
+    }
+
+    printf("%d files, %d B appends: %8.2f ms, %llu bitmap accesses, %.1f "
+           "extents per file\n",
+           FILES, PIECE, elapsed_ms(&start, &end),
+           (unsigned long long)(after.accesses[TFS_ACCESS_BITMAP] -
+                                before.accesses[TFS_ACCESS_BITMAP]),
+           (double)total_extents / FILES);
+
+    assert(tfs_destroy() != -1);
+
+    return 0;
+}
@@ -0,0 +1,61 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <stdio.h>
+
+/*
+    This file tests the directory name index on a directory spanning several
+    blocks: every entry is found, removed entries stop being found, their slots
+    are reused and a name can not be added twice
+*/
+#define FILES 40
+#define NAMES (3 * DIR_ENTRIES_PER_BLOCK)
+
+int main() {
+    char name[MAX_FILE_NAME];
+    int inumbers[FILES];
+
+    assert(tfs_init(NULL) != -1);
+
+    inode_t *root = inode_get(ROOT_DIR_INUM);
+    assert(root != NULL);
+
+    for (int i = 0; i < FILES; i++) {
+        assert((inumbers[i] = inode_create(T_FILE)) != -1);
+    }
+
+    for (int i = 0; i < NAMES; i++) {
+        snprintf(name, sizeof(name), "f%d", i);
+        assert(add_dir_entry(ROOT_DIR_INUM, inumbers[i % FILES], name) != -1);
+    }
+    assert(root->i_size == 3 * BLOCK_SIZE);
+
+    for (int i = 0; i < NAMES; i++) {
+        snprintf(name, sizeof(name), "f%d", i);
+        assert(find_in_dir(ROOT_DIR_INUM, name) == inumbers[i % FILES]);
+    }
+    assert(find_in_dir(ROOT_DIR_INUM, "missing") == -1);
+
+    /* A full directory grows by one block */
+    int extra = inode_create(T_FILE);
+    assert(extra != -1);
+    assert(add_dir_entry(ROOT_DIR_INUM, extra, "f3") == -1);
+    assert(add_dir_entry(ROOT_DIR_INUM, extra, "another") != -1);
+    assert(root->i_size == 4 * BLOCK_SIZE);
+    assert(tfs_lookup("/another") == extra);
+
+    /* Removing an entry frees its slot for a new name */
+    assert(clear_dir_entry(ROOT_DIR_INUM, extra, "f3") == -1);
+    assert(clear_dir_entry(ROOT_DIR_INUM, extra, "another") != -1);
+    assert(clear_dir_entry(ROOT_DIR_INUM, extra, "another") == -1);
+    assert(find_in_dir(ROOT_DIR_INUM, "another") == -1);
+    assert(add_dir_entry(ROOT_DIR_INUM, extra, "yet another") != -1);
+    assert(find_in_dir(ROOT_DIR_INUM, "yet another") == extra);
+    assert(root->i_size == 4 * BLOCK_SIZE);
+    assert(tfs_lookup("/f4") == inumbers[4]);
+
+    assert(tfs_destroy() != -1);
+
+    printf("Successful test.\n");
+
+    return 0;
+}
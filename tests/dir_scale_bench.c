@@ -0,0 +1,67 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <stdio.h>
+#include <time.h>
+
+/*
+    This file measures the cost of adding and looking up directory entries as
+    the root directory grows towards FILE_COUNT entries (or as far as the
+    directory can grow). All entries point to the same file, so the size of
+    the i-node table does not limit the number of names. Large blocks are
+    used so that a single directory can hold every entry.
+*/
+#define FILE_COUNT 100000
+#define LOOKUPS 10000
+
+static double elapsed_ns(struct timespec *start, struct timespec *end) {
+    return (double)(end->tv_sec - start->tv_sec) * 1e9 +
+           (double)(end->tv_nsec - start->tv_nsec);
+}
+
+int main() {
+    char name[MAX_FILE_NAME];
+    struct timespec start, end;
+
+    tfs_params_t params = {.block_size = 64 * 1024, .data_blocks = 128};
+    assert(tfs_init(&params) != -1);
+
+    int inumber = inode_create(T_FILE);
+    assert(inumber != -1);
+
+    int count = 0;
+    for (int step = 1000; count < FILE_COUNT; step *= 2) {
+        int target = step < FILE_COUNT ? step : FILE_COUNT;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        int added = 0;
+        while (count < target) {
+            snprintf(name, sizeof(name), "file%d", count);
+            if (add_dir_entry(ROOT_DIR_INUM, inumber, name) == -1) {
+                break;
+            }
+            count++;
+            added++;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double add_cost = added > 0 ? elapsed_ns(&start, &end) / added : 0;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int i = 0; i < LOOKUPS; i++) {
+            snprintf(name, sizeof(name), "file%d", (i * 7919) % count);
+            assert(find_in_dir(ROOT_DIR_INUM, name) == inumber);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        printf("%6d entries: add %8.1f ns, lookup %8.1f ns\n", count,
+               add_cost, elapsed_ns(&start, &end) / LOOKUPS);
+
+        if (count < target) {
+            printf("directory is full at %d entries\n", count);
+            break;
+        }
+    }
+
+    assert(tfs_destroy() != -1);
+
+    return 0;
+}
@@ -0,0 +1,64 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <string.h>
+
+/*
+    This file tests nested directories: creating them, creating and reading
+    files inside them, and removing files and directories
+*/
+int main() {
+    char *str = "AAA!";
+    char buffer[40];
+
+    assert(tfs_init(NULL) != -1);
+
+    assert(tfs_mkdir("/a") != -1);
+    assert(tfs_mkdir("/a/b") != -1);
+    assert(tfs_mkdir("/a/b") == -1);
+    assert(tfs_mkdir("/missing/b") == -1);
+
+    int f = tfs_open("/a/b/f1", TFS_O_CREAT);
+    assert(f != -1);
+    assert(tfs_write(f, str, strlen(str)) == strlen(str));
+    assert(tfs_close(f) != -1);
+
+    /* Directories can not be opened, nor hold files through a file */
+    assert(tfs_open("/a/b", 0) == -1);
+    assert(tfs_open("/a/b/f1/f2", TFS_O_CREAT) == -1);
+    assert(tfs_open("/a/c/f1", TFS_O_CREAT) == -1);
+
+    int inumber = tfs_lookup("/a/b/f1");
+    assert(inumber != -1);
+    assert(tfs_lookup("//a/b//f1") == inumber);
+    assert(tfs_lookup("/a/f1") == -1);
+
+    f = tfs_open("/a/b/f1", 0);
+    assert(f != -1);
+    assert(tfs_read(f, buffer, sizeof(buffer)) == strlen(str));
+    assert(memcmp(buffer, str, strlen(str)) == 0);
+
+    /* Open files and non-empty directories can not be removed */
+    assert(tfs_unlink("/a/b/f1") == -1);
+    assert(tfs_close(f) != -1);
+    assert(tfs_unlink("/a/b") == -1);
+
+    assert(tfs_unlink("/a/b/f1") != -1);
+    assert(tfs_lookup("/a/b/f1") == -1);
+    assert(tfs_unlink("/a/b/f1") == -1);
+    assert(tfs_unlink("/a/b") != -1);
+    assert(tfs_lookup("/a/b") == -1);
+
+    /* Names are free again once removed */
+    assert(tfs_mkdir("/a/b") != -1);
+    assert(tfs_open("/a/b/f1", 0) == -1);
+    f = tfs_open("/a/b/f1", TFS_O_CREAT);
+    assert(f != -1);
+    assert(tfs_read(f, buffer, sizeof(buffer)) == 0);
+    assert(tfs_close(f) != -1);
+
+    assert(tfs_destroy() != -1);
+
+    printf("Successful test.\n");
+
+    return 0;
+}
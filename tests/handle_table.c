@@ -0,0 +1,78 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+    This test opens more handles than a chunk of the open file table holds,
+    from several threads at once so that they race to allocate the chunks,
+    checks that every handle is distinct and usable, that the table refuses
+    handles past its size, and that freed entries of early chunks are found
+    again.
+*/
+#define MAX_OPEN 5000
+#define THREADS 5
+#define PER_THREAD (MAX_OPEN / THREADS)
+
+static int fds[MAX_OPEN];
+
+static void *opener(void *arg) {
+    int *mine = fds + (size_t)arg * PER_THREAD;
+
+    for (int i = 0; i < PER_THREAD; i++) {
+        mine[i] = tfs_open("/f", 0);
+        assert(mine[i] != -1);
+    }
+
+    return NULL;
+}
+
+int main() {
+    pthread_t threads[THREADS];
+    char c;
+    tfs_params_t params = {.max_open_files = MAX_OPEN};
+
+    assert(tfs_init(&params) != -1);
+
+    int fd = tfs_open("/f", TFS_O_CREAT);
+    assert(fd != -1);
+    assert(tfs_write(fd, "x", 1) == 1);
+    assert(tfs_close(fd) != -1);
+
+    for (size_t i = 0; i < THREADS; i++) {
+        assert(pthread_create(&threads[i], NULL, opener, (void *)i) == 0);
+    }
+    for (int i = 0; i < THREADS; i++) {
+        assert(pthread_join(threads[i], NULL) == 0);
+    }
+
+    /* Every handle in the table was handed out exactly once */
+    char *seen = calloc(MAX_OPEN, 1);
+    assert(seen != NULL);
+    for (int i = 0; i < MAX_OPEN; i++) {
+        assert(fds[i] >= 0 && fds[i] < MAX_OPEN && !seen[fds[i]]);
+        seen[fds[i]] = 1;
+        assert(tfs_read(fds[i], &c, 1) == 1 && c == 'x');
+    }
+    free(seen);
+    assert(tfs_open("/f", 0) == -1);
+
+    /* Entries freed in the first chunks are found again */
+    for (int i = 0; i < MAX_OPEN; i++) {
+        if (fds[i] == 7 || fds[i] == 3000) {
+            assert(tfs_close(fds[i]) != -1);
+        }
+    }
+    assert(tfs_read(7, &c, 1) == -1);
+    int a = tfs_open("/f", 0);
+    int b = tfs_open("/f", 0);
+    assert((a == 7 && b == 3000) || (a == 3000 && b == 7));
+    assert(tfs_open("/f", 0) == -1);
+
+    assert(tfs_destroy() != -1);
+
+    printf("Successful test.\n");
+
+    return 0;
+}
@@ -0,0 +1,83 @@
+#include "fs/operations.h"
+#include "fs/state.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*
+    This file measures the cost of looking a handle up in the open file
+    table (open_file_inumber), with 16 up to 1M handles open at once.
+    Each round looks up the same number of handles, picked at random across
+    the whole table, so that only the table size changes between rounds and
+    not how much of it has to be cached. Looking up a single fixed handle
+    is timed as a baseline: the gap between both must not grow with the
+    number of open handles.
+*/
+#define MAX_HANDLES (1024 * 1024)
+#define SAMPLE 256
+#define LOOKUPS 4000000
+
+static double elapsed_ns(struct timespec *start, struct timespec *end) {
+    return (double)(end->tv_sec - start->tv_sec) * 1e9 +
+           (double)(end->tv_nsec - start->tv_nsec);
+}
+
+static double lookup_ns(int const *sample, int mask) {
+    struct timespec start, end;
+    int inumber = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < LOOKUPS; i++) {
+        inumber |= open_file_inumber(sample[i & mask]);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    assert(inumber >= 0);
+
+    return elapsed_ns(&start, &end) / LOOKUPS;
+}
+
+int main() {
+    struct timespec start, end;
+    int sample[SAMPLE];
+
+    tfs_params_t params = {.latency = {.model = TFS_LATENCY_NONE}};
+    assert(tfs_init(&params) != -1);
+
+    int *fds = malloc(MAX_HANDLES * sizeof(*fds));
+    assert(fds != NULL);
+    fds[0] = tfs_open("/f", TFS_O_CREAT);
+    assert(fds[0] != -1);
+    int open = 1;
+
+    srand(1);
+    for (int handles = 16; handles <= MAX_HANDLES; handles *= 16) {
+        int opened = handles - open;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (; open < handles; open++) {
+            fds[open] = tfs_open("/f", 0);
+            assert(fds[open] != -1);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double open_ns = elapsed_ns(&start, &end) / opened;
+
+        for (int i = 0; i < SAMPLE; i++) {
+            sample[i] = fds[rand() % handles];
+        }
+        double fixed_ns = lookup_ns(sample, 0);
+        double random_ns = lookup_ns(sample, SAMPLE - 1);
+
+        printf("%7d handles: open %6.1f ns, lookup of a fixed handle %5.1f ns, "
+               "of a random handle %5.1f ns\n",
+               handles, open_ns, fixed_ns, random_ns);
+    }
+
+    for (int i = 0; i < open; i++) {
+        assert(tfs_close(fds[i]) != -1);
+    }
+    free(fds);
+
+    assert(tfs_destroy() != -1);
+
+    return 0;
+}
@@ -0,0 +1,70 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+
+/*
+    This file tests multiple threads creating and deleting i-nodes at the same
+    time: no inumber may be handed to two threads at once, and afterwards
+    every i-node but the root must be free again
+*/
+#define THREAD_COUNT 8
+#define PER_THREAD 5
+#define ROUNDS 500
+
+static atomic_char *owner;
+
+void *churn(void *arg) {
+    int inumbers[PER_THREAD];
+    (void)arg;
+
+    for (int r = 0; r < ROUNDS; r++) {
+        for (int i = 0; i < PER_THREAD; i++) {
+            assert((inumbers[i] = inode_create(T_FILE)) != -1);
+            assert(inumbers[i] != ROOT_DIR_INUM);
+            assert(atomic_exchange(&owner[inumbers[i]], 1) == 0);
+        }
+        for (int i = 0; i < PER_THREAD; i++) {
+            assert(atomic_exchange(&owner[inumbers[i]], 0) == 1);
+            assert(inode_delete(inumbers[i]) != -1);
+        }
+    }
+
+    return NULL;
+}
+
+int main() {
+    pthread_t threads[THREAD_COUNT];
+
+    assert(tfs_init(NULL) != -1);
+
+    owner = calloc(INODE_TABLE_SIZE, sizeof(*owner));
+    assert(owner != NULL);
+
+    for (int i = 0; i < THREAD_COUNT; i++) {
+        assert(pthread_create(&threads[i], NULL, churn, NULL) == 0);
+    }
+
+    for (int i = 0; i < THREAD_COUNT; i++) {
+        assert(pthread_join(threads[i], NULL) == 0);
+    }
+
+    /* Every i-node but the root can be taken exactly once */
+    int taken = 0;
+    while (inode_create(T_FILE) != -1) {
+        taken++;
+    }
+    assert(taken == (int)INODE_TABLE_SIZE - 1);
+
+    /* A deleted i-node can not be deleted twice */
+    assert(inode_delete(1) != -1);
+    assert(inode_delete(1) == -1);
+
+    free(owner);
+    assert(tfs_destroy() != -1);
+
+    printf("Successful test.\n");
+
+    return 0;
+}
@@ -0,0 +1,60 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+
+/*
+    This file measures i-node create/delete churn with the i-node table almost
+    empty and almost full, for 1 up to 16 threads
+*/
+#define MAX_THREADS 16
+#define ROUNDS 5000
+
+void *churn(void *arg) {
+    (void)arg;
+
+    for (int r = 0; r < ROUNDS; r++) {
+        int inumber = inode_create(T_FILE);
+        assert(inumber != -1);
+        assert(inode_delete(inumber) != -1);
+    }
+
+    return NULL;
+}
+
+static void run(int threads_count, int prefill) {
+    pthread_t threads[MAX_THREADS];
+    struct timespec start, end;
+
+    assert(tfs_init(NULL) != -1);
+    for (int i = 0; i < prefill; i++) {
+        assert(inode_create(T_FILE) != -1);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < threads_count; i++) {
+        assert(pthread_create(&threads[i], NULL, churn, NULL) == 0);
+    }
+    for (int i = 0; i < threads_count; i++) {
+        assert(pthread_join(threads[i], NULL) == 0);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double secs = (double)(end.tv_sec - start.tv_sec) +
+                  (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("%2d threads, %2d/%zu i-nodes taken: %9.0f create+delete/s\n",
+           threads_count, prefill + 1, INODE_TABLE_SIZE,
+           (double)threads_count * ROUNDS / secs);
+
+    assert(tfs_destroy() != -1);
+}
+
+int main() {
+    for (int count = 1; count <= MAX_THREADS; count *= 4) {
+        run(count, 0);
+        run(count, DEFAULT_INODE_TABLE_SIZE - 1 - MAX_THREADS);
+    }
+
+    return 0;
+}
@@ -0,0 +1,88 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+    This file measures sequential and random access on files of a few hundred
+    MB, which reach the double and the triple indirect blocks. As file
+    handles can not seek, random access is measured on the i-node: each
+    access translates a random file block to its data block and copies it.
+*/
+#define CHUNK (1024 * 1024)
+#define RANDOM_READS 100000
+
+static double elapsed_s(struct timespec *start, struct timespec *end) {
+    return (double)(end->tv_sec - start->tv_sec) +
+           (double)(end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void run(size_t block_size, size_t file_mb, char *chunk) {
+    struct timespec start, end;
+    size_t file_size = file_mb * 1024 * 1024;
+    /* Room for the data plus its indirect blocks */
+    tfs_params_t params = {.block_size = block_size,
+                           .data_blocks = file_size / block_size / 64 * 65};
+
+    assert(tfs_init(&params) != -1);
+
+    int fd = tfs_open("/f", TFS_O_CREAT);
+    assert(fd != -1);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t done = 0; done < file_size; done += CHUNK) {
+        assert(tfs_write(fd, chunk, CHUNK) == CHUNK);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double write_s = elapsed_s(&start, &end);
+    assert(tfs_close(fd) != -1);
+
+    fd = tfs_open("/f", 0);
+    assert(fd != -1);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t done = 0; done < file_size; done += CHUNK) {
+        assert(tfs_read(fd, chunk, CHUNK) == CHUNK);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double read_s = elapsed_s(&start, &end);
+    assert(tfs_close(fd) != -1);
+
+    /* Random block reads: offset to block translation plus a copy */
+    inode_t *inode = inode_get(tfs_lookup("/f"));
+    assert(inode != NULL);
+    int file_blocks = (int)(file_size / BLOCK_SIZE);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < RANDOM_READS; i++) {
+        int block;
+        assert(inode_block_map(inode, rand() % file_blocks, 1, &block) != -1);
+        char *data = data_block_get(block);
+        assert(data != NULL);
+        memcpy(chunk, data, BLOCK_SIZE);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double random_s = elapsed_s(&start, &end);
+
+    double mb = (double)file_mb;
+    printf("%5zu B blocks, %4zu MB file: seq write %7.1f MB/s, seq read "
+           "%7.1f MB/s, random block read %6.2f us\n",
+           block_size, file_mb, mb / write_s, mb / read_s,
+           random_s / RANDOM_READS * 1e6);
+
+    assert(tfs_destroy() != -1);
+}
+
+int main() {
+    char *chunk = malloc(CHUNK);
+    assert(chunk != NULL);
+    memset(chunk, 'x', CHUNK);
+    srand(1);
+
+    run(1024, 256, chunk);
+    run(4096, 512, chunk);
+
+    free(chunk);
+
+    return 0;
+}
@@ -0,0 +1,74 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/*
+    This file runs the same small workload (creating files, writing them,
+    reading them back and deleting them) under several storage latency
+    settings, and prints how long it took and how many accesses of each
+    kind it made.
+*/
+#define FILES 20
+#define FILE_SIZE (16 * 1024)
+
+static double elapsed_ms(struct timespec *start, struct timespec *end) {
+    return (double)(end->tv_sec - start->tv_sec) * 1e3 +
+           (double)(end->tv_nsec - start->tv_nsec) / 1e6;
+}
+
+static void run(char const *name, tfs_latency_t latency) {
+    static char buffer[FILE_SIZE];
+    char path[MAX_FILE_NAME];
+    struct timespec start, end;
+    tfs_latency_stats_t stats;
+    tfs_params_t params = {.latency = latency};
+
+    assert(tfs_init(&params) != -1);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < FILES; i++) {
+        snprintf(path, sizeof(path), "/f%d", i);
+        int fd = tfs_open(path, TFS_O_CREAT);
+        assert(fd != -1);
+        assert(tfs_write(fd, buffer, FILE_SIZE) == FILE_SIZE);
+        assert(tfs_close(fd) != -1);
+    }
+    for (int i = 0; i < FILES; i++) {
+        snprintf(path, sizeof(path), "/f%d", i);
+        int fd = tfs_open(path, 0);
+        assert(fd != -1);
+        assert(tfs_read(fd, buffer, FILE_SIZE) == FILE_SIZE);
+        assert(tfs_close(fd) != -1);
+        assert(tfs_unlink(path) != -1);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    tfs_latency_stats(&stats);
+    printf("%-22s %9.2f ms  (%llu i-node, %llu bitmap, %llu block "
+           "accesses)\n",
+           name, elapsed_ms(&start, &end),
+           (unsigned long long)stats.accesses[TFS_ACCESS_INODE],
+           (unsigned long long)stats.accesses[TFS_ACCESS_BITMAP],
+           (unsigned long long)stats.accesses[TFS_ACCESS_BLOCK]);
+
+    assert(tfs_destroy() != -1);
+}
+
+int main() {
+    run("none", (tfs_latency_t){.model = TFS_LATENCY_NONE});
+    run("spin, defaults", (tfs_latency_t){.model = TFS_LATENCY_SPIN});
+    run("spin, NVMe-like",
+        (tfs_latency_t){.model = TFS_LATENCY_SPIN,
+                        .cost_ns = {[TFS_ACCESS_INODE] = 500,
+                                    [TFS_ACCESS_BITMAP] = 500,
+                                    [TFS_ACCESS_BLOCK] = 10000}});
+    run("sleep, SATA SSD-like",
+        (tfs_latency_t){.model = TFS_LATENCY_SLEEP,
+                        .cost_ns = {[TFS_ACCESS_INODE] = 50000,
+                                    [TFS_ACCESS_BITMAP] = 50000,
+                                    [TFS_ACCESS_BLOCK] = 100000}});
+
+    return 0;
+}
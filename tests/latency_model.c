@@ -0,0 +1,94 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/*
+    This test checks that accesses to the FS state are counted under every
+    latency model, that the counters start over on each tfs_init, and that
+    the spin and sleep models delay each access by about its cost.
+*/
+#define SIZE (3 * 1024)
+
+static double elapsed_ns(struct timespec *start, struct timespec *end) {
+    return (double)(end->tv_sec - start->tv_sec) * 1e9 +
+           (double)(end->tv_nsec - start->tv_nsec);
+}
+
+/* Time taken by a single access to a block that is not in the block cache */
+static double block_access_ns() {
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    assert(data_block_get((int)DATA_BLOCKS - 1) != NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    return elapsed_ns(&start, &end);
+}
+
+int main() {
+    static char buffer[SIZE];
+    tfs_latency_stats_t before, after;
+    tfs_params_t params = {.latency = {.model = TFS_LATENCY_NONE}};
+
+    memset(buffer, 'x', SIZE);
+
+    /* Every kind of access is counted, even with no delay */
+    assert(tfs_init(&params) != -1);
+    tfs_latency_stats(&before);
+
+    int fd = tfs_open("/f", TFS_O_CREAT);
+    assert(fd != -1);
+    assert(tfs_write(fd, buffer, SIZE) == SIZE);
+    assert(tfs_close(fd) != -1);
+
+    tfs_latency_stats(&after);
+    assert(after.accesses[TFS_ACCESS_INODE] >
+           before.accesses[TFS_ACCESS_INODE]);
+    assert(after.accesses[TFS_ACCESS_BITMAP] >
+           before.accesses[TFS_ACCESS_BITMAP]);
+    assert(after.accesses[TFS_ACCESS_BLOCK] >
+           before.accesses[TFS_ACCESS_BLOCK]);
+
+    /* A data_block_get of a block that is not cached counts as exactly one
+     * access, and a cached one as none */
+    tfs_latency_stats(&before);
+    assert(data_block_get((int)DATA_BLOCKS - 1) != NULL);
+    tfs_latency_stats(&after);
+    assert(after.accesses[TFS_ACCESS_BLOCK] ==
+           before.accesses[TFS_ACCESS_BLOCK] + 1);
+    assert(after.accesses[TFS_ACCESS_INODE] ==
+           before.accesses[TFS_ACCESS_INODE]);
+    assert(data_block_get((int)DATA_BLOCKS - 1) != NULL);
+    tfs_latency_stats(&before);
+    assert(before.accesses[TFS_ACCESS_BLOCK] ==
+           after.accesses[TFS_ACCESS_BLOCK]);
+    assert(tfs_destroy() != -1);
+
+    /* The counters start over */
+    assert(tfs_init(&params) != -1);
+    tfs_latency_stats(&before);
+    assert(before.accesses[TFS_ACCESS_BLOCK] <= 1);
+    assert(tfs_destroy() != -1);
+
+    /* Unknown models are refused */
+    params.latency.model = (tfs_latency_model_t)42;
+    assert(tfs_init(&params) == -1);
+
+    /* Both delaying models wait for about the cost of the access */
+    params.latency.model = TFS_LATENCY_SPIN;
+    params.latency.cost_ns[TFS_ACCESS_BLOCK] = 2000000;
+    assert(tfs_init(&params) != -1);
+    assert(block_access_ns() >= 1000000);
+    assert(tfs_destroy() != -1);
+
+    params.latency.model = TFS_LATENCY_SLEEP;
+    assert(tfs_init(&params) != -1);
+    assert(block_access_ns() >= 2000000);
+    assert(tfs_destroy() != -1);
+
+    printf("Successful test.\n");
+
+    return 0;
+}
@@ -0,0 +1,116 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <time.h>
+
+/*
+    This file measures path lookups and opens of files in one directory of
+    4096 files, from 32 threads, while another thread keeps creating new
+    files in the same directory. Storage latency is left out, so that
+    synchronization is all that is measured.
+*/
+#define FILES 4096
+#define THREADS 32
+#define OPS 20000
+#define CREATES 3000
+
+static atomic_bool done;
+
+static void *looker(void *arg) {
+    char path[MAX_FILE_NAME];
+    unsigned seed = (unsigned)(size_t)arg;
+
+    for (int i = 0; i < OPS; i++) {
+        seed = seed * 1103515245 + 12345;
+        snprintf(path, sizeof(path), "/d/f%u", (seed >> 8) % FILES);
+        assert(tfs_lookup(path) != -1);
+    }
+
+    return NULL;
+}
+
+static void *opener(void *arg) {
+    char path[MAX_FILE_NAME];
+    unsigned seed = (unsigned)(size_t)arg;
+
+    for (int i = 0; i < OPS; i++) {
+        seed = seed * 1103515245 + 12345;
+        snprintf(path, sizeof(path), "/d/f%u", (seed >> 8) % FILES);
+        int fd = tfs_open(path, 0);
+        assert(fd != -1);
+        assert(tfs_close(fd) != -1);
+    }
+
+    return NULL;
+}
+
+static void *creator(void *arg) {
+    char path[MAX_FILE_NAME];
+    (void)arg;
+
+    for (int i = 0; !atomic_load(&done); i = (i + 1) % CREATES) {
+        snprintf(path, sizeof(path), "/d/new%d", i);
+        int fd = tfs_open(path, TFS_O_CREAT);
+        assert(fd != -1);
+        assert(tfs_close(fd) != -1);
+        if (i == CREATES - 1) {
+            for (int j = 0; j < CREATES; j++) {
+                snprintf(path, sizeof(path), "/d/new%d", j);
+                assert(tfs_unlink(path) != -1);
+            }
+        }
+    }
+
+    return NULL;
+}
+
+static double run(void *(*worker)(void *)) {
+    pthread_t threads[THREADS];
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < THREADS; i++) {
+        assert(pthread_create(&threads[i], NULL, worker, (void *)(i + 1)) ==
+               0);
+    }
+    for (int i = 0; i < THREADS; i++) {
+        assert(pthread_join(threads[i], NULL) == 0);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double secs = (double)(end.tv_sec - start.tv_sec) +
+                  (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+    return (double)THREADS * OPS / secs;
+}
+
+int main() {
+    pthread_t creator_thread;
+    char path[MAX_FILE_NAME];
+    tfs_params_t params = {.inode_table_size = FILES + CREATES + 16,
+                           .data_blocks = 4096,
+                           .latency = {.model = TFS_LATENCY_NONE}};
+
+    assert(tfs_init(&params) != -1);
+    assert(tfs_mkdir("/d") != -1);
+    for (int i = 0; i < FILES; i++) {
+        snprintf(path, sizeof(path), "/d/f%d", i);
+        int fd = tfs_open(path, TFS_O_CREAT);
+        assert(fd != -1);
+        assert(tfs_close(fd) != -1);
+    }
+
+    assert(pthread_create(&creator_thread, NULL, creator, NULL) == 0);
+    double lookups = run(looker);
+    double opens = run(opener);
+    atomic_store(&done, true);
+    assert(pthread_join(creator_thread, NULL) == 0);
+
+    printf("%d threads: %9.0f lookups/s, %9.0f open/close pairs/s\n",
+           THREADS, lookups, opens);
+
+    assert(tfs_destroy() != -1);
+
+    return 0;
+}
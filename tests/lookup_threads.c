@@ -0,0 +1,138 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+
+/*
+    This file tests lock-free lookups while a directory changes under them:
+    reader threads keep looking up a set of names that never change, which
+    must always resolve to their i-nodes, while writer threads create and
+    remove enough other names to make the directory's index grow several
+    times and to retire many entries. Then more threads than there are
+    read sections (EPOCH_SLOTS) look up names in a directory that keeps
+    being deleted and made again, so that some of them go through the
+    directory's lock instead
+*/
+#define STABLE 64
+#define WRITERS 2
+#define READERS 6
+#define CHURN 600
+#define CRAWLERS (EPOCH_SLOTS + 8)
+#define REMAKES 300
+
+static int stable[STABLE];
+static atomic_int writers_left = WRITERS;
+static atomic_bool remaking = true;
+
+static void *writer(void *arg) {
+    char path[MAX_FILE_NAME];
+    int id = (int)(size_t)arg;
+
+    for (int round = 0; round < 3; round++) {
+        for (int i = 0; i < CHURN; i++) {
+            snprintf(path, sizeof(path), "/d/w%d_%d", id, i);
+            int f = tfs_open(path, TFS_O_CREAT);
+            assert(f != -1);
+            assert(tfs_close(f) != -1);
+        }
+        for (int i = 0; i < CHURN; i++) {
+            snprintf(path, sizeof(path), "/d/w%d_%d", id, i);
+            assert(tfs_unlink(path) != -1);
+        }
+    }
+    atomic_fetch_sub(&writers_left, 1);
+
+    return NULL;
+}
+
+static void *reader(void *arg) {
+    char path[MAX_FILE_NAME];
+    unsigned seed = (unsigned)(size_t)arg;
+
+    while (atomic_load(&writers_left) > 0) {
+        seed = seed * 1103515245 + 12345;
+        int i = (int)((seed >> 8) % STABLE);
+        snprintf(path, sizeof(path), "/d/s%d", i);
+        assert(tfs_lookup(path) == stable[i]);
+        snprintf(path, sizeof(path), "/d/missing%d", i);
+        assert(tfs_lookup(path) == -1);
+    }
+
+    return NULL;
+}
+
+static void *remaker(void *arg) {
+    (void)arg;
+
+    for (int i = 0; i < REMAKES; i++) {
+        assert(tfs_mkdir("/e/sub") != -1);
+        assert(tfs_unlink("/e/sub") != -1);
+    }
+    atomic_store(&remaking, false);
+
+    return NULL;
+}
+
+static void *crawler(void *arg) {
+    (void)arg;
+
+    while (atomic_load(&remaking)) {
+        assert(tfs_lookup("/e/sub/missing") == -1);
+    }
+
+    return NULL;
+}
+
+int main() {
+    pthread_t threads[WRITERS + READERS];
+    char path[MAX_FILE_NAME];
+    tfs_params_t params = {.inode_table_size = 2048, .data_blocks = 4096};
+
+    assert(tfs_init(&params) != -1);
+    assert(tfs_mkdir("/d") != -1);
+
+    for (int i = 0; i < STABLE; i++) {
+        snprintf(path, sizeof(path), "/d/s%d", i);
+        int f = tfs_open(path, TFS_O_CREAT);
+        assert(f != -1);
+        assert(tfs_close(f) != -1);
+        stable[i] = tfs_lookup(path);
+        assert(stable[i] != -1);
+    }
+
+    for (size_t i = 0; i < WRITERS; i++) {
+        assert(pthread_create(&threads[i], NULL, writer, (void *)i) == 0);
+    }
+    for (size_t i = 0; i < READERS; i++) {
+        assert(pthread_create(&threads[WRITERS + i], NULL, reader,
+                              (void *)(i + 1)) == 0);
+    }
+    for (int i = 0; i < WRITERS + READERS; i++) {
+        assert(pthread_join(threads[i], NULL) == 0);
+    }
+
+    for (int i = 0; i < STABLE; i++) {
+        snprintf(path, sizeof(path), "/d/s%d", i);
+        assert(tfs_lookup(path) == stable[i]);
+    }
+    snprintf(path, sizeof(path), "/d/w0_0");
+    assert(tfs_lookup(path) == -1);
+
+    static pthread_t crawlers[CRAWLERS + 1];
+    assert(tfs_mkdir("/e") != -1);
+    for (size_t i = 0; i < CRAWLERS; i++) {
+        assert(pthread_create(&crawlers[i], NULL, crawler, NULL) == 0);
+    }
+    assert(pthread_create(&crawlers[CRAWLERS], NULL, remaker, NULL) == 0);
+    for (int i = 0; i <= CRAWLERS; i++) {
+        assert(pthread_join(crawlers[i], NULL) == 0);
+    }
+    assert(tfs_lookup("/e/sub") == -1);
+
+    assert(tfs_destroy() != -1);
+
+    printf("Successful test.\n");
+
+    return 0;
+}
@@ -0,0 +1,82 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/*
+    This file measures open/close pairs on one file, for 1 up to 16 threads,
+    while another thread keeps overwriting the same file
+*/
+#define OPENS 20000
+#define MAX_THREADS 16
+#define MAX_OPEN 64
+
+static atomic_bool done;
+
+static void *opener(void *arg) {
+    (void)arg;
+
+    for (int i = 0; i < OPENS; i++) {
+        int fd = tfs_open("/f", 0);
+        assert(fd != -1);
+        assert(tfs_close(fd) != -1);
+    }
+
+    return NULL;
+}
+
+static void *writer(void *arg) {
+    (void)arg;
+    char buffer[4096];
+    memset(buffer, 'x', sizeof(buffer));
+
+    int fd = tfs_open("/f", 0);
+    assert(fd != -1);
+    while (!atomic_load(&done)) {
+        assert(tfs_pwrite(fd, buffer, sizeof(buffer), 0) == sizeof(buffer));
+    }
+    assert(tfs_close(fd) != -1);
+
+    return NULL;
+}
+
+int main() {
+    pthread_t threads[MAX_THREADS];
+    pthread_t writer_thread;
+    struct timespec start, end;
+    tfs_params_t params = {.max_open_files = MAX_OPEN};
+
+    assert(tfs_init(&params) != -1);
+
+    int fd = tfs_open("/f", TFS_O_CREAT);
+    assert(fd != -1);
+    assert(tfs_close(fd) != -1);
+
+    assert(pthread_create(&writer_thread, NULL, writer, NULL) == 0);
+
+    for (int count = 1; count <= MAX_THREADS; count *= 2) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int i = 0; i < count; i++) {
+            assert(pthread_create(&threads[i], NULL, opener, NULL) == 0);
+        }
+        for (int i = 0; i < count; i++) {
+            assert(pthread_join(threads[i], NULL) == 0);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        double secs = (double)(end.tv_sec - start.tv_sec) +
+                      (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+        printf("%2d threads: %9.0f open/close pairs/s\n", count,
+               (double)count * OPENS / secs);
+    }
+
+    atomic_store(&done, true);
+    assert(pthread_join(writer_thread, NULL) == 0);
+
+    assert(tfs_destroy() != -1);
+
+    return 0;
+}
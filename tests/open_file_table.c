@@ -0,0 +1,85 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+
+/*
+    This test opens and closes the same file from many threads at once,
+    checking that no handle is ever held by two threads, and then checks that
+    the table fills up, that closed handles are refused and that their
+    entries are reused.
+*/
+#define MAX_OPEN 200
+#define THREADS 8
+#define HELD 16
+#define ROUNDS 2000
+
+static atomic_int holder[MAX_OPEN];
+
+static void *storm(void *arg) {
+    int id = (int)(size_t)arg;
+    int fds[HELD];
+
+    for (int r = 0; r < ROUNDS; r++) {
+        for (int i = 0; i < HELD; i++) {
+            fds[i] = tfs_open("/f", 0);
+            assert(fds[i] != -1);
+            int expected = 0;
+            assert(atomic_compare_exchange_strong(&holder[fds[i]], &expected,
+                                                  id));
+        }
+        for (int i = 0; i < HELD; i++) {
+            assert(atomic_exchange(&holder[fds[i]], 0) == id);
+            assert(tfs_close(fds[i]) != -1);
+        }
+    }
+
+    return NULL;
+}
+
+int main() {
+    pthread_t threads[THREADS];
+    int fds[MAX_OPEN];
+    char c;
+    tfs_params_t params = {.max_open_files = MAX_OPEN};
+
+    assert(tfs_init(&params) != -1);
+
+    int fd = tfs_open("/f", TFS_O_CREAT);
+    assert(fd != -1);
+    assert(tfs_write(fd, "x", 1) == 1);
+    assert(tfs_close(fd) != -1);
+
+    for (size_t i = 0; i < THREADS; i++) {
+        assert(pthread_create(&threads[i], NULL, storm, (void *)(i + 1)) == 0);
+    }
+    for (int i = 0; i < THREADS; i++) {
+        assert(pthread_join(threads[i], NULL) == 0);
+    }
+
+    /* Every entry can be taken, and no more */
+    for (int i = 0; i < MAX_OPEN; i++) {
+        fds[i] = tfs_open("/f", 0);
+        assert(fds[i] != -1);
+    }
+    assert(tfs_open("/f", 0) == -1);
+
+    /* A closed handle is refused, and its entry goes to the next open */
+    assert(tfs_close(fds[123]) != -1);
+    assert(tfs_close(fds[123]) == -1);
+    assert(tfs_read(fds[123], &c, 1) == -1);
+    assert(tfs_write(fds[123], &c, 1) == -1);
+    assert(tfs_open("/f", 0) == fds[123]);
+    assert(tfs_read(fds[123], &c, 1) == 1 && c == 'x');
+
+    for (int i = 0; i < MAX_OPEN; i++) {
+        assert(tfs_close(fds[i]) != -1);
+    }
+
+    assert(tfs_destroy() != -1);
+
+    printf("Successful test.\n");
+
+    return 0;
+}
@@ -0,0 +1,119 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+/*
+    This test writes and reads a file at explicit offsets, checking that the
+    offset of the file handle is left alone, that a gap left past the end of
+    the file reads as zeros, as do the parts of blocks a write into a hole
+    leaves out (even when the blocks held another file's data), and that
+    many threads can read through the same handle at once
+*/
+#define SIZE (20 * 1024)
+#define THREADS 8
+#define READS 200
+
+static char content[SIZE];
+static int fd;
+
+void *reader(void *arg) {
+    char buffer[300];
+    unsigned seed = (unsigned)(size_t)arg;
+
+    for (int i = 0; i < READS; i++) {
+        seed = seed * 1103515245 + 12345;
+        size_t offset = seed % (SIZE - sizeof(buffer));
+        assert(tfs_pread(fd, buffer, sizeof(buffer), offset) ==
+               sizeof(buffer));
+        assert(memcmp(buffer, content + offset, sizeof(buffer)) == 0);
+    }
+
+    return NULL;
+}
+
+int main() {
+    char buffer[100];
+    pthread_t threads[THREADS];
+    char *path = "/f1";
+
+    for (size_t i = 0; i < SIZE; i++) {
+        content[i] = (char)('a' + i % 26);
+    }
+
+    assert(tfs_init(NULL) != -1);
+
+    fd = tfs_open(path, TFS_O_CREAT);
+    assert(fd != -1);
+
+    /* Written back to front, then read from the handle's own offset */
+    for (size_t end = SIZE; end > 0;) {
+        size_t len = end < 1000 ? end : 1000;
+        end -= len;
+        assert(tfs_pwrite(fd, content + end, len, end) == len);
+    }
+    assert(tfs_read(fd, buffer, sizeof(buffer)) == sizeof(buffer));
+    assert(memcmp(buffer, content, sizeof(buffer)) == 0);
+
+    /* Positional reads do not move the handle's offset either */
+    assert(tfs_pread(fd, buffer, sizeof(buffer), 5000) == sizeof(buffer));
+    assert(memcmp(buffer, content + 5000, sizeof(buffer)) == 0);
+    assert(tfs_read(fd, buffer, sizeof(buffer)) == sizeof(buffer));
+    assert(memcmp(buffer, content + sizeof(buffer), sizeof(buffer)) == 0);
+
+    /* Reads stop at the end of the file */
+    assert(tfs_pread(fd, buffer, sizeof(buffer), SIZE - 10) == 10);
+    assert(tfs_pread(fd, buffer, sizeof(buffer), SIZE + 10) == 0);
+
+    for (size_t i = 0; i < THREADS; i++) {
+        assert(pthread_create(&threads[i], NULL, reader, (void *)(i + 1)) ==
+               0);
+    }
+    for (size_t i = 0; i < THREADS; i++) {
+        assert(pthread_join(threads[i], NULL) == 0);
+    }
+
+    /* Writing past the end leaves a gap of zeros */
+    size_t gap = 5 * 1024 + 7;
+    assert(tfs_pwrite(fd, "end", 3, SIZE + gap) == 3);
+    assert(tfs_pread(fd, buffer, sizeof(buffer), SIZE + gap - 50) == 53);
+    for (int i = 0; i < 50; i++) {
+        assert(buffer[i] == 0);
+    }
+    assert(memcmp(buffer + 50, "end", 3) == 0);
+
+    assert(tfs_close(fd) != -1);
+    assert(tfs_pread(fd, buffer, sizeof(buffer), 0) == -1);
+    assert(tfs_pwrite(fd, buffer, sizeof(buffer), 0) == -1);
+
+    assert(tfs_destroy() != -1);
+
+    /* Blocks freed with data in them are cleared when a hole gets them */
+    tfs_params_t params = {.data_blocks = 64};
+    assert(tfs_init(&params) != -1);
+    fd = tfs_open(path, TFS_O_CREAT);
+    assert(fd != -1);
+    memset(content, 'x', sizeof(content));
+    while (tfs_write(fd, content, sizeof(content)) > 0) {
+    }
+    assert(tfs_close(fd) != -1);
+    assert(tfs_unlink(path) != -1);
+
+    fd = tfs_open(path, TFS_O_CREAT);
+    assert(fd != -1);
+    assert(tfs_pwrite(fd, "a", 1, 6 * 1024) == 1);
+    assert(tfs_pwrite(fd, "b", 1, 2 * 1024 + 100) == 1);
+    static char hole[6 * 1024 + 1];
+    assert(tfs_pread(fd, hole, sizeof(hole), 0) == sizeof(hole));
+    for (size_t i = 0; i < sizeof(hole) - 1; i++) {
+        assert(hole[i] == (i == 2 * 1024 + 100 ? 'b' : 0));
+    }
+    assert(hole[6 * 1024] == 'a');
+    assert(tfs_close(fd) != -1);
+    assert(tfs_destroy() != -1);
+
+    printf("Successful test.\n");
+
+    return 0;
+}
@@ -0,0 +1,75 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+    This file measures random 4 KB positional reads on one 64 MB file, all
+    going through a single file handle, for 1 up to 16 threads
+*/
+#define FILE_SIZE (64 * 1024 * 1024)
+#define READ_SIZE 4096
+#define READS 20000
+#define MAX_THREADS 16
+#define CHUNK (1024 * 1024)
+
+static int fd;
+
+void *reader(void *arg) {
+    char buffer[READ_SIZE];
+    unsigned seed = (unsigned)(size_t)arg;
+
+    for (int i = 0; i < READS; i++) {
+        seed = seed * 1103515245 + 12345;
+        size_t offset = (size_t)(seed % (FILE_SIZE / READ_SIZE)) * READ_SIZE;
+        assert(tfs_pread(fd, buffer, READ_SIZE, offset) == READ_SIZE);
+    }
+
+    return NULL;
+}
+
+int main() {
+    pthread_t threads[MAX_THREADS];
+    struct timespec start, end;
+
+    tfs_params_t params = {.block_size = 4096,
+                           .data_blocks = FILE_SIZE / 4096 / 64 * 65};
+    assert(tfs_init(&params) != -1);
+
+    char *chunk = malloc(CHUNK);
+    assert(chunk != NULL);
+    memset(chunk, 'x', CHUNK);
+
+    fd = tfs_open("/f", TFS_O_CREAT);
+    assert(fd != -1);
+    for (size_t done = 0; done < FILE_SIZE; done += CHUNK) {
+        assert(tfs_write(fd, chunk, CHUNK) == CHUNK);
+    }
+
+    for (int count = 1; count <= MAX_THREADS; count *= 2) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (size_t i = 0; i < count; i++) {
+            assert(pthread_create(&threads[i], NULL, reader,
+                                  (void *)(i + 1)) == 0);
+        }
+        for (int i = 0; i < count; i++) {
+            assert(pthread_join(threads[i], NULL) == 0);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        double secs = (double)(end.tv_sec - start.tv_sec) +
+                      (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+        printf("%2d threads: %9.0f reads/s\n", count,
+               (double)count * READS / secs);
+    }
+
+    assert(tfs_close(fd) != -1);
+    free(chunk);
+
+    assert(tfs_destroy() != -1);
+
+    return 0;
+}
@@ -0,0 +1,166 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/*
+    This test overwrites the regions of a file from several threads, each
+    write filling a whole region with a single byte, while other threads read
+    regions back and check that no write shows through half done, and one
+    more thread keeps appending to the file while another reads the appended
+    part, which must never show bytes that were not written yet. It also
+    checks that a read does not wait for a write to another range of the
+    file.
+*/
+#define BLOCK 512
+#define REGION (2 * BLOCK)
+#define REGIONS 16
+#define WRITERS 4
+#define READERS 4
+#define ROUNDS 5000
+#define APPENDS 500
+
+static int fd;
+
+static void *writer(void *arg) {
+    char buffer[REGION];
+    unsigned seed = (unsigned)(size_t)arg;
+
+    for (int i = 0; i < ROUNDS; i++) {
+        seed = seed * 1103515245 + 12345;
+        size_t offset = (seed >> 8) % REGIONS * REGION;
+        memset(buffer, 'a' + (int)(seed >> 16) % 26, REGION);
+        assert(tfs_pwrite(fd, buffer, REGION, offset) == REGION);
+    }
+
+    return NULL;
+}
+
+static void *reader(void *arg) {
+    char buffer[REGION];
+    unsigned seed = (unsigned)(size_t)arg;
+
+    for (int i = 0; i < ROUNDS; i++) {
+        seed = seed * 1103515245 + 12345;
+        size_t offset = (seed >> 8) % REGIONS * REGION;
+        assert(tfs_pread(fd, buffer, REGION, offset) == REGION);
+        for (int j = 1; j < REGION; j++) {
+            assert(buffer[j] == buffer[0]);
+        }
+    }
+
+    return NULL;
+}
+
+static void *appender(void *arg) {
+    (void)arg;
+    char buffer[BLOCK / 2];
+    memset(buffer, 'z', sizeof(buffer));
+
+    int afd = tfs_open("/f", TFS_O_APPEND);
+    assert(afd != -1);
+    for (int i = 0; i < APPENDS; i++) {
+        assert(tfs_write(afd, buffer, sizeof(buffer)) == sizeof(buffer));
+    }
+    assert(tfs_close(afd) != -1);
+
+    return NULL;
+}
+
+static atomic_bool appended;
+
+static void *tail_reader(void *arg) {
+    char buffer[BLOCK];
+    unsigned seed = (unsigned)(size_t)arg;
+
+    while (!atomic_load(&appended)) {
+        seed = seed * 1103515245 + 12345;
+        size_t offset = REGIONS * REGION +
+                        (seed >> 8) % (APPENDS * (BLOCK / 2) - BLOCK);
+        ssize_t read = tfs_pread(fd, buffer, BLOCK, offset);
+        assert(read != -1);
+        for (ssize_t j = 0; j < read; j++) {
+            assert(buffer[j] == 'z');
+        }
+    }
+
+    return NULL;
+}
+
+static atomic_bool other_read;
+
+static void *other_range_reader(void *arg) {
+    (void)arg;
+    char buffer[REGION];
+
+    assert(tfs_pread(fd, buffer, REGION, REGION) == REGION);
+    atomic_store(&other_read, true);
+
+    return NULL;
+}
+
+int main() {
+    pthread_t threads[WRITERS + READERS + 2];
+    char buffer[REGION];
+    tfs_params_t params = {.block_size = BLOCK, .data_blocks = 1024};
+
+    assert(tfs_init(&params) != -1);
+
+    fd = tfs_open("/f", TFS_O_CREAT);
+    assert(fd != -1);
+    memset(buffer, 'a', REGION);
+    for (int i = 0; i < REGIONS; i++) {
+        assert(tfs_write(fd, buffer, REGION) == REGION);
+    }
+
+    for (size_t i = 0; i < WRITERS; i++) {
+        assert(pthread_create(&threads[i], NULL, writer, (void *)(i + 1)) ==
+               0);
+    }
+    for (size_t i = 0; i < READERS; i++) {
+        assert(pthread_create(&threads[WRITERS + i], NULL, reader,
+                              (void *)(i + 100)) == 0);
+    }
+    assert(pthread_create(&threads[WRITERS + READERS], NULL, appender, NULL) ==
+           0);
+    assert(pthread_create(&threads[WRITERS + READERS + 1], NULL, tail_reader,
+                          (void *)200) == 0);
+    for (int i = 0; i < WRITERS + READERS + 1; i++) {
+        assert(pthread_join(threads[i], NULL) == 0);
+    }
+    atomic_store(&appended, true);
+    assert(pthread_join(threads[WRITERS + READERS + 1], NULL) == 0);
+
+    /* The appends all landed after the regions */
+    size_t size = REGIONS * REGION + APPENDS * (BLOCK / 2);
+    assert(tfs_pread(fd, buffer, REGION, size - REGION) == REGION);
+    for (int j = 0; j < REGION; j++) {
+        assert(buffer[j] == 'z');
+    }
+    assert(tfs_pread(fd, buffer, REGION, size) == 0);
+
+    /* A read of another range goes on while the first region is locked */
+    int inumber = tfs_lookup("/f");
+    assert(inumber != -1);
+    inode_range_t range;
+    inode_range_lock(inumber, 0, REGION, true, &range);
+
+    assert(pthread_create(&threads[0], NULL, other_range_reader, NULL) == 0);
+    for (int i = 0; i < 5000 && !atomic_load(&other_read); i++) {
+        nanosleep(&(struct timespec){.tv_nsec = 1000000}, NULL);
+    }
+    assert(atomic_load(&other_read));
+
+    inode_range_unlock(inumber, &range);
+    assert(pthread_join(threads[0], NULL) == 0);
+
+    assert(tfs_close(fd) != -1);
+    assert(tfs_destroy() != -1);
+
+    printf("Successful test.\n");
+
+    return 0;
+}
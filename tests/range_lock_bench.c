@@ -0,0 +1,89 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+    This file measures random one block positional writes to one file, each
+    thread writing its own slice of it, for 1 up to 8 threads, with a
+    storage latency that sleeps 50 us per access and a block cache too small
+    to hold the file
+*/
+#define FILE_BLOCKS 2048
+#define WRITES 1000
+#define MAX_THREADS 8
+#define CACHE_BLOCKS 16
+
+static int fd;
+static int slice_blocks;
+
+static void *writer(void *arg) {
+    size_t slice = (size_t)arg;
+    char *buffer = malloc(BLOCK_SIZE);
+    assert(buffer != NULL);
+    memset(buffer, 'y', BLOCK_SIZE);
+    unsigned seed = (unsigned)slice + 1;
+
+    for (int i = 0; i < WRITES; i++) {
+        seed = seed * 1103515245 + 12345;
+        size_t block = slice * (size_t)slice_blocks +
+                       (seed >> 8) % (unsigned)slice_blocks;
+        assert(tfs_pwrite(fd, buffer, BLOCK_SIZE, block * BLOCK_SIZE) ==
+               (ssize_t)BLOCK_SIZE);
+    }
+
+    free(buffer);
+    return NULL;
+}
+
+int main() {
+    pthread_t threads[MAX_THREADS];
+    struct timespec start, end;
+    tfs_params_t params = {
+        .data_blocks = FILE_BLOCKS * 2,
+        .block_cache_blocks = CACHE_BLOCKS,
+        .latency = {.model = TFS_LATENCY_SLEEP,
+                    .cost_ns = {[TFS_ACCESS_BLOCK] = 50000}}};
+
+    assert(tfs_init(&params) != -1);
+
+    size_t size = FILE_BLOCKS * BLOCK_SIZE;
+    char *buffer = malloc(size);
+    assert(buffer != NULL);
+    memset(buffer, 'x', size);
+    fd = tfs_open("/f", TFS_O_CREAT);
+    assert(fd != -1);
+    assert(tfs_write(fd, buffer, size) == size);
+    /* The file's blocks are allocated when its last handle closes */
+    assert(tfs_close(fd) != -1);
+    fd = tfs_open("/f", 0);
+    assert(fd != -1);
+
+    for (int count = 1; count <= MAX_THREADS; count *= 2) {
+        slice_blocks = FILE_BLOCKS / count;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (size_t i = 0; i < count; i++) {
+            assert(pthread_create(&threads[i], NULL, writer, (void *)i) == 0);
+        }
+        for (int i = 0; i < count; i++) {
+            assert(pthread_join(threads[i], NULL) == 0);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        double secs = (double)(end.tv_sec - start.tv_sec) +
+                      (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+        printf("%d threads: %8.0f writes/s\n", count,
+               (double)count * WRITES / secs);
+    }
+
+    assert(tfs_close(fd) != -1);
+    free(buffer);
+
+    assert(tfs_destroy() != -1);
+
+    return 0;
+}
@@ -0,0 +1,89 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+/*
+    This test maps the contents of a file with tfs_read_map, checks that the
+    ranges hold the file contents in order (including a gap of zeros), and
+    that the file can be neither truncated nor deleted while it is mapped
+*/
+#define SIZE (10 * 1024 + 500)
+
+/* Compares the ranges of a mapping, one after the other, with contents */
+static void check_map(tfs_read_map_t *map, char const *contents,
+                      size_t len) {
+    size_t done = 0;
+    for (int i = 0; i < map->rm_iovcnt; i++) {
+        assert(done + map->rm_iov[i].iov_len <= len);
+        assert(memcmp(map->rm_iov[i].iov_base, contents + done,
+                      map->rm_iov[i].iov_len) == 0);
+        done += map->rm_iov[i].iov_len;
+    }
+    assert(done == len);
+}
+
+int main() {
+    static char input[SIZE];
+    char buffer[100];
+    tfs_read_map_t map, map2;
+    char *path = "/f1";
+
+    for (size_t i = 0; i < SIZE; i++) {
+        input[i] = (char)('a' + i % 26);
+    }
+
+    assert(tfs_init(NULL) != -1);
+
+    int fd = tfs_open(path, TFS_O_CREAT);
+    assert(fd != -1);
+    assert(tfs_write(fd, input, SIZE) == SIZE);
+    assert(tfs_close(fd) != -1);
+
+    /* Two mappings, one after the other, then a plain read */
+    fd = tfs_open(path, 0);
+    assert(fd != -1);
+    assert(tfs_read_map(fd, 3000, &map) == 3000);
+    check_map(&map, input, 3000);
+    assert(tfs_read_map(fd, SIZE, &map2) == SIZE - 3000);
+    check_map(&map2, input + 3000, SIZE - 3000);
+    assert(tfs_read(fd, buffer, sizeof(buffer)) == 0);
+
+    /* The file is a single extent, so the second mapping is one range */
+    assert(map2.rm_iovcnt == 1);
+
+    /* Mapped files can not be truncated or deleted, even once closed */
+    assert(tfs_close(fd) != -1);
+    assert(tfs_open(path, TFS_O_TRUNC) == -1);
+    assert(tfs_unlink(path) == -1);
+    assert(tfs_read_unmap(&map) != -1);
+    assert(tfs_unlink(path) == -1);
+    assert(tfs_read_unmap(&map2) != -1);
+
+    /* Releasing an empty or released mapping is harmless */
+    assert(tfs_read_unmap(&map2) != -1);
+
+    /* Once unmapped, truncating works again; a gap maps as zeros */
+    fd = tfs_open(path, TFS_O_TRUNC);
+    assert(fd != -1);
+    memset(input, 0, SIZE);
+    memcpy(input + SIZE - 5, "tail", 5);
+    assert(tfs_pwrite(fd, "tail", 5, SIZE - 5) == 5);
+    assert(tfs_read_map(fd, SIZE, &map) == SIZE);
+    check_map(&map, input, SIZE);
+    assert(tfs_read_unmap(&map) != -1);
+
+    /* Nothing is mapped at the end of the file */
+    assert(tfs_read_map(fd, SIZE, &map) == 0);
+    assert(map.rm_iovcnt == 0);
+    assert(tfs_read_unmap(&map) != -1);
+    assert(tfs_close(fd) != -1);
+
+    assert(tfs_unlink(path) != -1);
+
+    assert(tfs_destroy() != -1);
+
+    printf("Successful test.\n");
+
+    return 0;
+}
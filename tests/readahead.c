@@ -0,0 +1,87 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/*
+    This test checks that a sequential reader gets the blocks ahead of it
+    prefetched into the block cache, and that positional reads and reads
+    that do not follow each other do not trigger readahead. The file is
+    four times larger than the cache, so its first blocks are no longer
+    cached when it is read back.
+*/
+#define CACHE_BLOCKS 64
+#define FILE_BLOCKS (CACHE_BLOCKS * 4)
+#define CHUNK 4096
+
+static void pause_reader() {
+    struct timespec pause = {.tv_sec = 0, .tv_nsec = 1000000};
+    nanosleep(&pause, NULL);
+}
+
+int main() {
+    static char buffer[CHUNK];
+    static char expected[CHUNK];
+    tfs_block_cache_stats_t before, after;
+    tfs_params_t params = {.block_cache_blocks = CACHE_BLOCKS,
+                           .latency = {.model = TFS_LATENCY_NONE}};
+
+    assert(tfs_init(&params) != -1);
+
+    size_t size = FILE_BLOCKS * BLOCK_SIZE;
+    int fd = tfs_open("/f", TFS_O_CREAT);
+    assert(fd != -1);
+    for (size_t done = 0; done < size; done += CHUNK) {
+        memset(buffer, 'a' + (int)(done / CHUNK % 26), CHUNK);
+        assert(tfs_write(fd, buffer, CHUNK) == CHUNK);
+    }
+    assert(tfs_close(fd) != -1);
+
+    /* Sequential reads: the blocks ahead are prefetched, and found in the
+     * cache (the reader pauses so that the workers keep ahead of it) */
+    tfs_block_cache_stats(&before);
+    fd = tfs_open("/f", 0);
+    assert(fd != -1);
+    for (size_t done = 0; done < size; done += CHUNK) {
+        memset(expected, 'a' + (int)(done / CHUNK % 26), CHUNK);
+        assert(tfs_read(fd, buffer, CHUNK) == CHUNK);
+        assert(memcmp(buffer, expected, CHUNK) == 0);
+        pause_reader();
+    }
+    assert(tfs_read(fd, buffer, CHUNK) == 0);
+    tfs_block_cache_stats(&after);
+    assert(after.prefetched - before.prefetched >= FILE_BLOCKS / 2);
+    assert(after.prefetch_hits - before.prefetch_hits >=
+           (after.prefetched - before.prefetched) / 2);
+    assert(after.misses - before.misses < FILE_BLOCKS / 2);
+
+    /* Positional reads never read ahead */
+    tfs_block_cache_stats(&before);
+    for (size_t done = 0; done < size; done += CHUNK) {
+        assert(tfs_pread(fd, buffer, CHUNK, done) == CHUNK);
+        pause_reader();
+    }
+    tfs_block_cache_stats(&after);
+    assert(after.prefetched == before.prefetched);
+    assert(tfs_close(fd) != -1);
+
+    /* Neither do reads that do not start where the previous one ended */
+    fd = tfs_open("/f", 0);
+    assert(fd != -1);
+    tfs_block_cache_stats(&before);
+    for (size_t done = 0; done < size; done += 2 * CHUNK) {
+        assert(tfs_write(fd, buffer, CHUNK) == CHUNK);
+        assert(tfs_read(fd, buffer, CHUNK) == CHUNK);
+        pause_reader();
+    }
+    tfs_block_cache_stats(&after);
+    assert(after.prefetched == before.prefetched);
+    assert(tfs_close(fd) != -1);
+
+    assert(tfs_destroy() != -1);
+
+    printf("Successful test.\n");
+
+    return 0;
+}
@@ -0,0 +1,85 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+    This file reads an 8 MB file in 4 KB chunks, sequentially through a file
+    handle (which reads ahead) and with positional reads at the same offsets
+    (which do not), with a storage latency that sleeps 20 us per access. The
+    block cache is smaller than the file, so none of it is cached when a
+    read starts.
+*/
+#define FILE_SIZE (8 * 1024 * 1024)
+#define CHUNK 4096
+#define CACHE_BLOCKS 256
+
+static double elapsed_s(struct timespec *start, struct timespec *end) {
+    return (double)(end->tv_sec - start->tv_sec) +
+           (double)(end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void report(char const *name, struct timespec *start,
+                   struct timespec *end, tfs_block_cache_stats_t *before,
+                   tfs_block_cache_stats_t *after) {
+    uint64_t prefetched = after->prefetched - before->prefetched;
+    uint64_t prefetch_hits = after->prefetch_hits - before->prefetch_hits;
+
+    printf("%-10s %7.1f MB/s, %6llu misses, readahead %6llu blocks "
+           "(%5.1f%% hit)\n",
+           name, FILE_SIZE / (1024.0 * 1024) / elapsed_s(start, end),
+           (unsigned long long)(after->misses - before->misses),
+           (unsigned long long)prefetched,
+           prefetched == 0 ? 0.0
+                           : (double)prefetch_hits / (double)prefetched * 100);
+}
+
+int main() {
+    struct timespec start, end;
+    tfs_block_cache_stats_t before, after;
+    tfs_params_t params = {
+        .data_blocks = FILE_SIZE / 1024 * 2,
+        .block_cache_blocks = CACHE_BLOCKS,
+        .latency = {.model = TFS_LATENCY_SLEEP,
+                    .cost_ns = {[TFS_ACCESS_BLOCK] = 20000}}};
+    char *chunk = malloc(CHUNK);
+    assert(chunk != NULL);
+    memset(chunk, 'x', CHUNK);
+
+    assert(tfs_init(&params) != -1);
+
+    int fd = tfs_open("/f", TFS_O_CREAT);
+    assert(fd != -1);
+    for (size_t done = 0; done < FILE_SIZE; done += CHUNK) {
+        assert(tfs_write(fd, chunk, CHUNK) == CHUNK);
+    }
+    assert(tfs_close(fd) != -1);
+
+    fd = tfs_open("/f", 0);
+    assert(fd != -1);
+    tfs_block_cache_stats(&before);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t done = 0; done < FILE_SIZE; done += CHUNK) {
+        assert(tfs_read(fd, chunk, CHUNK) == CHUNK);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    tfs_block_cache_stats(&after);
+    report("tfs_read", &start, &end, &before, &after);
+
+    tfs_block_cache_stats(&before);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t done = 0; done < FILE_SIZE; done += CHUNK) {
+        assert(tfs_pread(fd, chunk, CHUNK, done) == CHUNK);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    tfs_block_cache_stats(&after);
+    report("tfs_pread", &start, &end, &before, &after);
+    assert(tfs_close(fd) != -1);
+
+    assert(tfs_destroy() != -1);
+    free(chunk);
+
+    return 0;
+}
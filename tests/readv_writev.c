@@ -0,0 +1,80 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+/*
+    This test writes records made of a header, a payload and a trailer with
+    tfs_writev, crossing block boundaries, and reads them back with tfs_readv
+    split in a different way, checking them against plain tfs_read
+*/
+#define RECORDS 50
+#define PAYLOAD 1000
+
+int main() {
+    char header[16];
+    char payload[PAYLOAD];
+    char trailer[8];
+    char record[sizeof(header) + PAYLOAD + sizeof(trailer)];
+    char whole[RECORDS * sizeof(record)];
+    char first[100];
+    char rest[sizeof(whole) - sizeof(first)];
+    char *path = "/f1";
+
+    assert(tfs_init(NULL) != -1);
+
+    int fd = tfs_open(path, TFS_O_CREAT);
+    assert(fd != -1);
+
+    for (int r = 0; r < RECORDS; r++) {
+        memset(header, 'a' + r % 26, sizeof(header));
+        memset(payload, 'A' + r % 26, sizeof(payload));
+        memset(trailer, '0' + r % 10, sizeof(trailer));
+
+        /* The empty buffer in the middle is skipped */
+        struct iovec iov[] = {{header, sizeof(header)},
+                              {payload, sizeof(payload)},
+                              {NULL, 0},
+                              {trailer, sizeof(trailer)}};
+        assert(tfs_writev(fd, iov, 4) == sizeof(record));
+
+        memcpy(record, header, sizeof(header));
+        memcpy(record + sizeof(header), payload, PAYLOAD);
+        memcpy(record + sizeof(header) + PAYLOAD, trailer, sizeof(trailer));
+        memcpy(whole + (size_t)r * sizeof(record), record, sizeof(record));
+    }
+
+    /* Invalid arrays are refused, empty ones write nothing */
+    assert(tfs_writev(fd, NULL, 1) == -1);
+    assert(tfs_writev(fd, NULL, -1) == -1);
+    assert(tfs_writev(fd, NULL, 0) == 0);
+    assert(tfs_close(fd) != -1);
+
+    fd = tfs_open(path, 0);
+    assert(fd != -1);
+    struct iovec iov[] = {{first, sizeof(first)}, {rest, sizeof(rest)}};
+    assert(tfs_readv(fd, iov, 2) == sizeof(whole));
+    assert(memcmp(whole, first, sizeof(first)) == 0);
+    assert(memcmp(whole + sizeof(first), rest, sizeof(rest)) == 0);
+
+    /* At the end of the file there is nothing left to read */
+    assert(tfs_readv(fd, iov, 2) == 0);
+    assert(tfs_close(fd) != -1);
+
+    /* A read into buffers past the end of the file fills the first ones */
+    fd = tfs_open(path, 0);
+    assert(fd != -1);
+    assert(tfs_read(fd, rest, sizeof(rest)) == sizeof(rest));
+    memset(first, 0, sizeof(first));
+    struct iovec tail[] = {{record, 30}, {first, sizeof(first)}};
+    assert(tfs_readv(fd, tail, 2) == sizeof(whole) - sizeof(rest));
+    assert(memcmp(record, whole + sizeof(rest), 30) == 0);
+    assert(memcmp(first, whole + sizeof(rest) + 30, 70) == 0);
+    assert(tfs_close(fd) != -1);
+
+    assert(tfs_destroy() != -1);
+
+    printf("Successful test.\n");
+
+    return 0;
+}
@@ -0,0 +1,105 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+/*
+    This test checks the attributes tfs_stat reports, and that the snapshots
+    it takes while another thread keeps appending to a file are consistent:
+    the size only grows, in whole appends.
+*/
+#define BLOCK 512
+#define APPENDS 2000
+
+static atomic_bool done;
+
+static void *appender(void *arg) {
+    (void)arg;
+    char buffer[BLOCK];
+    memset(buffer, 'a', BLOCK);
+
+    int fd = tfs_open("/g", TFS_O_APPEND);
+    assert(fd != -1);
+    for (int i = 0; i < APPENDS; i++) {
+        assert(tfs_write(fd, buffer, BLOCK) == BLOCK);
+    }
+    assert(tfs_close(fd) != -1);
+    atomic_store(&done, true);
+
+    return NULL;
+}
+
+static void *checker(void *arg) {
+    (void)arg;
+    tfs_stat_t st;
+    size_t last = 0;
+
+    while (!atomic_load(&done)) {
+        assert(tfs_stat("/g", &st) != -1);
+        assert(st.st_type == T_FILE);
+        assert(st.st_size % BLOCK == 0 && st.st_size >= last);
+        last = st.st_size;
+    }
+
+    return NULL;
+}
+
+int main() {
+    pthread_t threads[3];
+    tfs_stat_t st;
+    tfs_params_t params = {.block_size = BLOCK, .data_blocks = 4096};
+
+    assert(tfs_init(&params) != -1);
+
+    assert(tfs_stat("/missing", &st) == -1);
+
+    assert(tfs_mkdir("/d") != -1);
+    assert(tfs_stat("/d", &st) != -1);
+    assert(st.st_type == T_DIRECTORY && st.st_inumber == tfs_lookup("/d"));
+
+    /* Sizes include data still waiting in the delayed allocation buffer */
+    int fd = tfs_open("/d/f", TFS_O_CREAT);
+    assert(fd != -1);
+    assert(tfs_stat("/d/f", &st) != -1);
+    assert(st.st_type == T_FILE && st.st_size == 0);
+    assert(tfs_write(fd, "hello", 5) == 5);
+    assert(tfs_stat("/d/f", &st) != -1 && st.st_size == 5);
+    assert(tfs_pwrite(fd, "x", 1, 3000) == 1);
+    assert(tfs_stat("/d/f", &st) != -1 && st.st_size == 3001);
+    assert(tfs_close(fd) != -1);
+    assert(tfs_stat("/d/f", &st) != -1 && st.st_size == 3001);
+
+    /* Appending opens start at the size */
+    fd = tfs_open("/d/f", TFS_O_APPEND);
+    assert(fd != -1);
+    assert(tfs_write(fd, "!", 1) == 1);
+    assert(tfs_close(fd) != -1);
+    assert(tfs_stat("/d/f", &st) != -1 && st.st_size == 3002);
+
+    fd = tfs_open("/d/f", TFS_O_TRUNC);
+    assert(fd != -1);
+    assert(tfs_stat("/d/f", &st) != -1 && st.st_size == 0);
+    assert(tfs_close(fd) != -1);
+
+    assert(tfs_unlink("/d/f") != -1);
+    assert(tfs_stat("/d/f", &st) == -1);
+
+    fd = tfs_open("/g", TFS_O_CREAT);
+    assert(fd != -1);
+    assert(tfs_close(fd) != -1);
+    assert(pthread_create(&threads[0], NULL, appender, NULL) == 0);
+    assert(pthread_create(&threads[1], NULL, checker, NULL) == 0);
+    assert(pthread_create(&threads[2], NULL, checker, NULL) == 0);
+    for (int i = 0; i < 3; i++) {
+        assert(pthread_join(threads[i], NULL) == 0);
+    }
+    assert(tfs_stat("/g", &st) != -1 && st.st_size == APPENDS * BLOCK);
+
+    assert(tfs_destroy() != -1);
+
+    printf("Successful test.\n");
+
+    return 0;
+}
@@ -0,0 +1,107 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/*
+    This file measures size checks on one file, for 1 up to 16 threads, while
+    another thread keeps overwriting the file: tfs_stat against a lookup
+    followed by reading the size under the i-node's read lock
+*/
+#define CHECKS 200000
+#define MAX_THREADS 16
+
+static atomic_bool done;
+
+static void *stat_checker(void *arg) {
+    (void)arg;
+    tfs_stat_t st;
+
+    for (int i = 0; i < CHECKS; i++) {
+        assert(tfs_stat("/f", &st) != -1 && st.st_size > 0);
+    }
+
+    return NULL;
+}
+
+static void *locked_checker(void *arg) {
+    (void)arg;
+
+    for (int i = 0; i < CHECKS; i++) {
+        inode_t *inode = inode_get(tfs_lookup("/f"));
+        assert(inode != NULL);
+        read_lock(&inode->i_lock);
+        size_t size = inode->i_size;
+        rw_unlock(&inode->i_lock);
+        assert(size > 0);
+    }
+
+    return NULL;
+}
+
+static void *writer(void *arg) {
+    (void)arg;
+    char buffer[4096];
+    memset(buffer, 'x', sizeof(buffer));
+
+    int fd = tfs_open("/f", 0);
+    assert(fd != -1);
+    while (!atomic_load(&done)) {
+        assert(tfs_pwrite(fd, buffer, sizeof(buffer), 0) == sizeof(buffer));
+    }
+    assert(tfs_close(fd) != -1);
+
+    return NULL;
+}
+
+static double run(int count, void *(*checker)(void *)) {
+    pthread_t threads[MAX_THREADS];
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < count; i++) {
+        assert(pthread_create(&threads[i], NULL, checker, NULL) == 0);
+    }
+    for (int i = 0; i < count; i++) {
+        assert(pthread_join(threads[i], NULL) == 0);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double secs = (double)(end.tv_sec - start.tv_sec) +
+                  (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+    return (double)count * CHECKS / secs;
+}
+
+int main() {
+    pthread_t writer_thread;
+    char buffer[4096];
+    tfs_params_t params = {.latency = {.model = TFS_LATENCY_NONE}};
+
+    assert(tfs_init(&params) != -1);
+
+    memset(buffer, 'x', sizeof(buffer));
+    int fd = tfs_open("/f", TFS_O_CREAT);
+    assert(fd != -1);
+    assert(tfs_write(fd, buffer, sizeof(buffer)) == sizeof(buffer));
+    assert(tfs_close(fd) != -1);
+
+    assert(pthread_create(&writer_thread, NULL, writer, NULL) == 0);
+
+    for (int count = 1; count <= MAX_THREADS; count *= 2) {
+        double locked = run(count, locked_checker);
+        double seq = run(count, stat_checker);
+        printf("%2d threads: lookup + read lock %9.0f checks/s, tfs_stat "
+               "%9.0f checks/s\n",
+               count, locked, seq);
+    }
+
+    atomic_store(&done, true);
+    assert(pthread_join(writer_thread, NULL) == 0);
+
+    assert(tfs_destroy() != -1);
+
+    return 0;
+}
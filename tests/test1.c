@@ -8,7 +8,7 @@ int main() {
     char *path = "/f1";
     char buffer[40];
 
-    assert(tfs_init() != -1);
+    assert(tfs_init(NULL) != -1);
 
     int f;
     ssize_t r;
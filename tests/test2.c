@@ -217,7 +217,7 @@ int main() {
     char output[strlen(input) + 1];
     char *path = "/f1";
 
-    assert(tfs_init() != -1);
+    assert(tfs_init(NULL) != -1);
 
     int f;
     ssize_t r;
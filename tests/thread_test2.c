@@ -36,7 +36,7 @@ int main() {
 
     char buffer[strlen(INPUT) + 1];
 
-    assert(tfs_init() != -1);
+    assert(tfs_init(NULL) != -1);
 
     int f;
     // Create the file for testing
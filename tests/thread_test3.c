@@ -6,8 +6,9 @@
 #include <unistd.h>
 
 /*
-    This file tests that only 20 files can be open at the same time,
-        with multiple threads testing that limit
+    This file tests that only 20 files can be open at the same time (with
+        the open file table sized for 20), with multiple threads testing that
+        limit
 */
 #define PATH "/testfile"
 #define THREAD_COUNT 100
@@ -34,7 +35,8 @@ void *wrapper_write(void *lol) {
 
 int main() {
 
-    assert(tfs_init() != -1);
+    tfs_params_t params = {.max_open_files = 20};
+    assert(tfs_init(&params) != -1);
 
     int f;
     // Create the file for testing
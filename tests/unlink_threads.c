@@ -0,0 +1,112 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+
+/*
+    This file tests unlinks racing with the operations they must not cut
+    short: a directory keeps being made and removed while other threads
+    create and remove files in it, and a file keeps being made and removed
+    while another thread opens and writes it. Once every name is gone, every
+    i-node and data block must be free again, so none was left behind in a
+    directory that got deleted, or freed while a handle still used it.
+*/
+#define FILERS 3
+#define ROUNDS 2000
+
+static atomic_bool done;
+static atomic_int written;
+
+static void *filer(void *arg) {
+    char path[MAX_FILE_NAME];
+    snprintf(path, sizeof(path), "/d/sub/f%d", (int)(size_t)arg);
+
+    for (int r = 0; r < ROUNDS; r++) {
+        tfs_mkdir("/d/sub");
+        int f = tfs_open(path, TFS_O_CREAT);
+        if (f != -1) {
+            assert(tfs_write(f, "x", 1) == 1);
+            assert(tfs_close(f) != -1);
+            atomic_fetch_add(&written, 1);
+        }
+        tfs_unlink(path);
+    }
+
+    return NULL;
+}
+
+static void *remaker(void *arg) {
+    (void)arg;
+
+    while (!atomic_load(&done)) {
+        tfs_mkdir("/d/sub");
+        tfs_unlink("/d/sub");
+        int f = tfs_open("/d/file", TFS_O_CREAT);
+        if (f != -1) {
+            assert(tfs_close(f) != -1);
+        }
+        tfs_unlink("/d/file");
+    }
+
+    return NULL;
+}
+
+static void *opener(void *arg) {
+    (void)arg;
+
+    while (!atomic_load(&done)) {
+        int f = tfs_open("/d/file", 0);
+        if (f != -1) {
+            assert(tfs_write(f, "y", 1) == 1);
+            assert(tfs_close(f) != -1);
+        }
+    }
+
+    return NULL;
+}
+
+int main() {
+    char path[MAX_FILE_NAME];
+    pthread_t filers[FILERS], others[2];
+    tfs_params_t params = {.inode_table_size = 64, .data_blocks = 256};
+
+    assert(tfs_init(&params) != -1);
+    assert(tfs_mkdir("/d") != -1);
+
+    for (size_t i = 0; i < FILERS; i++) {
+        assert(pthread_create(&filers[i], NULL, filer, (void *)i) == 0);
+    }
+    assert(pthread_create(&others[0], NULL, remaker, NULL) == 0);
+    assert(pthread_create(&others[1], NULL, opener, NULL) == 0);
+    for (int i = 0; i < FILERS; i++) {
+        assert(pthread_join(filers[i], NULL) == 0);
+    }
+    atomic_store(&done, true);
+    assert(pthread_join(others[0], NULL) == 0);
+    assert(pthread_join(others[1], NULL) == 0);
+
+    for (int i = 0; i < FILERS; i++) {
+        snprintf(path, sizeof(path), "/d/sub/f%d", i);
+        tfs_unlink(path);
+    }
+    tfs_unlink("/d/sub");
+    tfs_unlink("/d/file");
+    assert(tfs_unlink("/d") != -1);
+
+    /* Only the root directory is left, with its block */
+    int created = 0;
+    while (inode_create(T_FILE) != -1) {
+        created++;
+    }
+    assert(created == (int)INODE_TABLE_SIZE - 1);
+    assert(data_block_free_count() == (int)DATA_BLOCKS - 1);
+
+    /* Most rounds get their file made */
+    assert(atomic_load(&written) > 0);
+    assert(tfs_destroy() != -1);
+
+    printf("Successful test.\n");
+
+    return 0;
+}
@@ -0,0 +1,138 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/*
+    This test keeps the FS in a volume image file, remounts it and checks that
+    directories, file contents and free i-nodes and blocks are as they were
+    left, also after a process stopped without tfs_destroy. It also checks
+    that images that do not match are refused.
+*/
+#define IMAGE "/tmp/tfs_volume_image_test.img"
+#define SIZE (5000)
+
+int main() {
+    static char input[SIZE];
+    static char output[SIZE];
+    tfs_params_t params = {.block_size = 512, .inode_table_size = 20,
+                           .image_path = IMAGE};
+
+    for (int i = 0; i < SIZE; i++) {
+        input[i] = (char)('a' + i % 26);
+    }
+
+    unlink(IMAGE);
+
+    /* A missing image is created and formatted */
+    assert(tfs_init(&params) != -1);
+    assert(tfs_mkdir("/d") != -1);
+    int fd = tfs_open("/d/f", TFS_O_CREAT);
+    assert(fd != -1);
+    assert(tfs_write(fd, input, SIZE) == SIZE);
+    assert(tfs_close(fd) != -1);
+    int inumber = tfs_lookup("/d/f");
+    assert(inumber != -1);
+    int free_blocks = data_block_free_count();
+    assert(tfs_destroy() != -1);
+
+    /* The image is mounted with its own geometry */
+    tfs_params_t mount = {.image_path = IMAGE};
+    assert(tfs_init(&mount) != -1);
+    assert(BLOCK_SIZE == 512 && INODE_TABLE_SIZE == 20);
+    assert(data_block_free_count() == free_blocks);
+    assert(tfs_lookup("/d/f") == inumber);
+
+    fd = tfs_open("/d/f", 0);
+    assert(fd != -1);
+    assert(tfs_read(fd, output, SIZE) == SIZE);
+    assert(memcmp(input, output, SIZE) == 0);
+    assert(tfs_close(fd) != -1);
+
+    /* New i-nodes do not collide with the ones in the image */
+    fd = tfs_open("/g", TFS_O_CREAT);
+    assert(fd != -1);
+    assert(tfs_lookup("/g") != inumber);
+    assert(tfs_write(fd, "x", 1) == 1);
+    assert(tfs_close(fd) != -1);
+    assert(tfs_unlink("/d/f") != -1);
+    assert(tfs_destroy() != -1);
+
+    assert(tfs_init(&mount) != -1);
+    assert(tfs_lookup("/d/f") == -1);
+    assert(tfs_lookup("/g") != -1);
+    assert(tfs_destroy() != -1);
+
+    /* Blocks cached by the free block pools when a process stops without
+     * tfs_destroy are free again on the next mount */
+    int pipe_fds[2];
+    assert(pipe(pipe_fds) == 0);
+    pid_t child = fork();
+    assert(child != -1);
+    if (child == 0) {
+        assert(tfs_init(&mount) != -1);
+        fd = tfs_open("/h", TFS_O_CREAT);
+        assert(fd != -1);
+        assert(tfs_write(fd, input, SIZE) == SIZE);
+        assert(tfs_close(fd) != -1);
+        fd = tfs_open("/g", TFS_O_TRUNC);
+        assert(fd != -1);
+        assert(tfs_close(fd) != -1);
+        free_blocks = data_block_free_count();
+        assert(write(pipe_fds[1], &free_blocks, sizeof(free_blocks)) ==
+               sizeof(free_blocks));
+        _exit(0);
+    }
+    int status;
+    assert(waitpid(child, &status, 0) == child);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    assert(read(pipe_fds[0], &free_blocks, sizeof(free_blocks)) ==
+           sizeof(free_blocks));
+    close(pipe_fds[0]);
+    close(pipe_fds[1]);
+
+    /* So are i-nodes popped off the free stack and never taken: the stack
+     * head (the last field of the superblock, at the start of the image) is
+     * left empty */
+    int image_fd = open(IMAGE, O_WRONLY);
+    assert(image_fd != -1);
+    uint64_t empty_stack = UINT32_MAX;
+    assert(pwrite(image_fd, &empty_stack, sizeof(empty_stack), 64) ==
+           sizeof(empty_stack));
+    assert(close(image_fd) == 0);
+
+    assert(tfs_init(&mount) != -1);
+    assert(data_block_free_count() == free_blocks);
+    fd = tfs_open("/h", 0);
+    assert(fd != -1);
+    assert(tfs_read(fd, output, SIZE) == SIZE);
+    assert(memcmp(input, output, SIZE) == 0);
+    assert(tfs_close(fd) != -1);
+    int created = 0;
+    while (inode_create(T_FILE) != -1) {
+        created++;
+    }
+    assert(created == 20 - 4); // all but the root, /d, /g and /h
+    assert(tfs_destroy() != -1);
+
+    /* A geometry that does not match the image is refused */
+    tfs_params_t other = {.block_size = 1024, .image_path = IMAGE};
+    assert(tfs_init(&other) == -1);
+
+    /* So is a file that is not a volume image */
+    FILE *file = fopen(IMAGE, "w");
+    assert(file != NULL);
+    assert(fputs("not a volume", file) >= 0);
+    assert(fclose(file) == 0);
+    assert(tfs_init(&mount) == -1);
+
+    unlink(IMAGE);
+
+    printf("Successful test.\n");
+
+    return 0;
+}
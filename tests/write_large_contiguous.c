@@ -0,0 +1,100 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+    This file tests a single large tfs_write: its blocks must be allocated as
+    one contiguous extent and read back correctly, and a write past the
+    maximum file size (through the triple indirect block) must stop at that
+    size
+*/
+#define SIZE (200 * BLOCK_SIZE + 123)
+
+int main() {
+    char *path = "/f1";
+    char *path2 = "/f2";
+
+    assert(tfs_init(NULL) != -1);
+
+    char *input = malloc(SIZE);
+    char *output = malloc(SIZE);
+    int *blocks = calloc(SIZE / BLOCK_SIZE + 1, sizeof(int));
+    assert(input != NULL && output != NULL && blocks != NULL);
+
+    for (size_t i = 0; i < SIZE; i++) {
+        input[i] = (char)('A' + i % 26);
+    }
+
+    int fd = tfs_open(path, TFS_O_CREAT);
+    assert(fd != -1);
+    assert(tfs_write(fd, input, SIZE) == SIZE);
+    assert(tfs_close(fd) != -1);
+
+    /* Every block of the file follows the previous one */
+    inode_t *inode = inode_get(tfs_lookup(path));
+    assert(inode != NULL);
+    int count = (int)(SIZE / BLOCK_SIZE) + 1;
+    assert(inode_block_map(inode, 0, count, blocks) != -1);
+    for (int i = 1; i < count; i++) {
+        assert(blocks[i] == blocks[0] + i);
+    }
+
+    fd = tfs_open(path, 0);
+    assert(fd != -1);
+    assert(tfs_read(fd, output, SIZE) == SIZE);
+    assert(memcmp(input, output, SIZE) == 0);
+    assert(tfs_close(fd) != -1);
+
+    free(input);
+    free(output);
+    free(blocks);
+
+    assert(tfs_destroy() != -1);
+
+    /* Writes are cut at the maximum file size. With 64 B blocks an indirect
+     * block holds 16 block numbers, so the volume has room for the largest
+     * file and all of its indirect blocks. */
+    tfs_params_t params = {.block_size = 64, .data_blocks = 8192};
+    assert(tfs_init(&params) != -1);
+    assert(MAX_FILE_BLOCKS == 10 + 16 + 16 * 16 + 16 * 16 * 16);
+
+    size_t max_size = (size_t)MAX_FILE_BLOCKS * BLOCK_SIZE;
+    char *big = malloc(max_size + 10 * BLOCK_SIZE);
+    char *big_output = malloc(max_size);
+    assert(big != NULL && big_output != NULL);
+    for (size_t i = 0; i < max_size + 10 * BLOCK_SIZE; i++) {
+        big[i] = (char)('a' + i % 23);
+    }
+
+    int free_before = data_block_free_count();
+    fd = tfs_open(path2, TFS_O_CREAT);
+    assert(fd != -1);
+    assert(tfs_write(fd, big, max_size + 10 * BLOCK_SIZE) == max_size);
+    assert(tfs_write(fd, big, 1) == -1);
+    assert(tfs_close(fd) != -1);
+
+    /* The data blocks, plus 1 single, 1 + 16 double and 1 + 16 + 256 triple
+     * indirect blocks */
+    assert(free_before - data_block_free_count() ==
+           MAX_FILE_BLOCKS + 1 + 17 + 273);
+
+    fd = tfs_open(path2, 0);
+    assert(fd != -1);
+    assert(tfs_read(fd, big_output, max_size) == max_size);
+    assert(memcmp(big, big_output, max_size) == 0);
+    assert(tfs_close(fd) != -1);
+
+    /* Truncating gives every block back */
+    assert(tfs_open(path2, TFS_O_TRUNC) != -1);
+    assert(data_block_free_count() == free_before);
+
+    free(big);
+    free(big_output);
+
+    assert(tfs_destroy() != -1);
+
+    printf("Successful test.\n");
+
+    return 0;
+}
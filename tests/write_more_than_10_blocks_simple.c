@@ -25,7 +25,7 @@ int main() {
 
     char output [SIZE];
 
-    assert(tfs_init() != -1);
+    assert(tfs_init(NULL) != -1);
 
     /* Write input COUNT times into a new file */
     int fd = tfs_open(path, TFS_O_CREAT);
@@ -0,0 +1,83 @@
+#include "fs/operations.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/*
+    This file measures writing records made of a header, a payload and a
+    trailer as three tfs_write calls against a single tfs_writev, and reading
+    them back the same two ways
+*/
+#define RECORDS 20000
+#define HEADER 16
+#define PAYLOAD 200
+#define TRAILER 8
+#define RECORD (HEADER + PAYLOAD + TRAILER)
+
+static double elapsed_ns(struct timespec *start, struct timespec *end) {
+    return (double)(end->tv_sec - start->tv_sec) * 1e9 +
+           (double)(end->tv_nsec - start->tv_nsec);
+}
+
+int main() {
+    char header[HEADER], payload[PAYLOAD], trailer[TRAILER];
+    struct iovec iov[] = {
+        {header, HEADER}, {payload, PAYLOAD}, {trailer, TRAILER}};
+    struct timespec start, end;
+    double cost[2][2];
+
+    memset(header, 'h', HEADER);
+    memset(payload, 'p', PAYLOAD);
+    memset(trailer, 't', TRAILER);
+
+    /* Room for the records and the file's indirect blocks */
+    tfs_params_t params = {.data_blocks = 3 * RECORDS * RECORD / 1024};
+    assert(tfs_init(&params) != -1);
+
+    for (int vectored = 0; vectored < 2; vectored++) {
+        char *path = vectored ? "/writev" : "/write";
+        int fd = tfs_open(path, TFS_O_CREAT);
+        assert(fd != -1);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int r = 0; r < RECORDS; r++) {
+            if (vectored) {
+                assert(tfs_writev(fd, iov, 3) == RECORD);
+            } else {
+                assert(tfs_write(fd, header, HEADER) == HEADER);
+                assert(tfs_write(fd, payload, PAYLOAD) == PAYLOAD);
+                assert(tfs_write(fd, trailer, TRAILER) == TRAILER);
+            }
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        cost[vectored][0] = elapsed_ns(&start, &end) / RECORDS;
+        assert(tfs_close(fd) != -1);
+
+        fd = tfs_open(path, 0);
+        assert(fd != -1);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int r = 0; r < RECORDS; r++) {
+            if (vectored) {
+                assert(tfs_readv(fd, iov, 3) == RECORD);
+            } else {
+                assert(tfs_read(fd, header, HEADER) == HEADER);
+                assert(tfs_read(fd, payload, PAYLOAD) == PAYLOAD);
+                assert(tfs_read(fd, trailer, TRAILER) == TRAILER);
+            }
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        cost[vectored][1] = elapsed_ns(&start, &end) / RECORDS;
+        assert(tfs_close(fd) != -1);
+    }
+
+    printf("%d B records, 3 calls: write %8.1f ns, read %8.1f ns\n", RECORD,
+           cost[0][0], cost[0][1]);
+    printf("%d B records, 1 call:  write %8.1f ns, read %8.1f ns\n", RECORD,
+           cost[1][0], cost[1][1]);
+
+    assert(tfs_destroy() != -1);
+
+    return 0;
+}